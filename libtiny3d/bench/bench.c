@@ -0,0 +1,489 @@
+#define _USE_MATH_DEFINES
+#include "renderer.h"
+#include "animation.h"
+#include "scene.h"
+#include "parallel.h"
+#include "stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Microbenchmarks of the hot paths and a whole frame benchmark, the results are printed as JSON:
+// {"benchmarks": [{"name": ..., "iterations": ..., "ns_per_op": ..., ...}]}
+// ns_per_op is the time of one call (or one frame), the optional fields are rates that are easier to compare
+
+#define WIDTH 1024
+#define HEIGHT 1024
+
+// a benchmark runs its operation iterations times
+typedef void (*bench_fn_t)(void *state, int iterations);
+
+// what one benchmark measured
+typedef struct
+{
+    char name[64];
+    long long iterations;
+    double seconds;
+    double bytes_per_op; // data written or read by one operation (0 = no throughput)
+    double items_per_op; // edges, vertices or pixels of one operation (0 = no item rate)
+    int frames;          // 1 if one operation is a frame
+} bench_result_t;
+
+static double min_seconds = 0.25; // each benchmark runs at least this long
+static volatile float sink;       // results are added here so the compiler keeps the work
+static int result_count = 0;
+
+// run fn with more iterations until it takes min_seconds and print the result
+static void bench_run(const char *name, bench_fn_t fn, void *state, double bytes_per_op, double items_per_op, int frames)
+{
+    bench_result_t r = {.bytes_per_op = bytes_per_op, .items_per_op = items_per_op, .frames = frames};
+    snprintf(r.name, sizeof(r.name), "%s", name);
+
+    fn(state, 1); // warm up the caches and the allocations
+    for (long long n = 1;; n *= 2)
+    {
+        double start = parallel_time_seconds();
+        fn(state, (int)n);
+        double seconds = parallel_time_seconds() - start;
+        if (seconds >= min_seconds || n >= (1 << 30))
+        {
+            r.iterations = n;
+            r.seconds = seconds;
+            break;
+        }
+    }
+
+    double ns = r.seconds * 1e9 / r.iterations;
+    printf("%s\n    {\"name\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.3f",
+           result_count++ ? "," : "", r.name, r.iterations, ns);
+    if (r.frames)
+        printf(", \"frames_per_second\": %.3f", 1e9 / ns);
+    if (r.bytes_per_op > 0.0)
+        printf(", \"mb_per_second\": %.3f", r.bytes_per_op / (1024.0 * 1024.0) * 1e9 / ns);
+    if (r.items_per_op > 0.0)
+        printf(", \"items_per_second\": %.1f", r.items_per_op * 1e9 / ns);
+    printf("}");
+    fflush(stdout);
+}
+
+// math
+
+#define MATH_COUNT 1024
+
+typedef struct
+{
+    mat4_t matrices[MATH_COUNT];
+    vec3_t vectors[MATH_COUNT];
+    vec3f_t points[MATH_COUNT];
+    vec3f_t points_out[MATH_COUNT];
+    quat_t rotations[2][MATH_COUNT];
+    float times[MATH_COUNT];
+    mat4_t matrices_out[MATH_COUNT];
+} math_state_t;
+
+static void bench_mat4_multiply(void *user, int iterations)
+{
+    math_state_t *s = (math_state_t *)user;
+    float sum = 0.0f;
+    for (int it = 0; it < iterations; it++)
+    {
+        int i = it & (MATH_COUNT - 1);
+        mat4_t m = mat4_multiply(s->matrices[i], s->matrices[(i + 1) & (MATH_COUNT - 1)]);
+        sum += m.m[0][0];
+    }
+    sink += sum;
+}
+
+static void bench_mat4_transform_vec3(void *user, int iterations)
+{
+    math_state_t *s = (math_state_t *)user;
+    float sum = 0.0f;
+    for (int it = 0; it < iterations; it++)
+    {
+        int i = it & (MATH_COUNT - 1);
+        sum += mat4_transform_vec3(s->matrices[0], s->vectors[i]).x;
+    }
+    sink += sum;
+}
+
+static void bench_mat4_inverse(void *user, int iterations)
+{
+    math_state_t *s = (math_state_t *)user;
+    float sum = 0.0f;
+    for (int it = 0; it < iterations; it++)
+    {
+        mat4_t m;
+        mat4_inverse_to(&m, &s->matrices[it & (MATH_COUNT - 1)]);
+        sum += m.m[0][0];
+    }
+    sink += sum;
+}
+
+// all the vectors through one matrix, with the divide by w
+static void bench_mat4_transform_points(void *user, int iterations)
+{
+    math_state_t *s = (math_state_t *)user;
+    for (int it = 0; it < iterations; it++)
+        mat4_transform_points(&s->matrices[it & (MATH_COUNT - 1)], s->points, s->points_out, MATH_COUNT);
+    sink += s->points_out[0].x;
+}
+
+// orientations of a crowd: slerp between two keys and build the matrices
+static void bench_quat_slerp_array(void *user, int iterations)
+{
+    math_state_t *s = (math_state_t *)user;
+    quat_t rotations[MATH_COUNT];
+    for (int it = 0; it < iterations; it++)
+    {
+        quat_slerp_array(s->rotations[0], s->rotations[1], s->times, rotations, MATH_COUNT);
+        quat_to_mat4_array(rotations, s->points, s->matrices_out, MATH_COUNT);
+    }
+    sink += s->matrices_out[0].m[0][0];
+}
+
+typedef struct
+{
+    timeline_t timeline;
+    mat4_t matrices[MATH_COUNT];
+} timeline_state_t;
+
+// every track of the timeline at a new time
+static void bench_timeline_evaluate(void *user, int iterations)
+{
+    timeline_state_t *s = (timeline_state_t *)user;
+    for (int it = 0; it < iterations; it++)
+        timeline_evaluate(&s->timeline, it * 0.01f, s->matrices);
+    sink += s->matrices[0].m[0][3];
+}
+
+// add, cross, dot and normalize of one pair of vectors
+static void bench_vec3_ops(void *user, int iterations)
+{
+    math_state_t *s = (math_state_t *)user;
+    float sum = 0.0f;
+    for (int it = 0; it < iterations; it++)
+    {
+        int i = it & (MATH_COUNT - 1);
+        vec3_t a = s->vectors[i], b = s->vectors[(i + 7) & (MATH_COUNT - 1)];
+        vec3_t n = vec3_normalize(vec3_cross(vec3_add(a, b), vec3_sub(a, b)));
+        sum += vec3_dot(n, a) + vec3_length(vec3_scale(b, 0.5f));
+    }
+    sink += sum;
+}
+
+// lines
+
+typedef struct
+{
+    canvas_t *canvas;
+    float length;
+    float thickness;
+} line_state_t;
+
+// lines of one length in all directions around the center of the canvas
+static void bench_draw_line(void *user, int iterations)
+{
+    line_state_t *s = (line_state_t *)user;
+    float cx = WIDTH * 0.5f, cy = HEIGHT * 0.5f;
+    for (int it = 0; it < iterations; it++)
+    {
+        float a = (it & 63) * (float)(M_PI / 32.0);
+        float dx = cosf(a) * s->length * 0.5f, dy = sinf(a) * s->length * 0.5f;
+        draw_line_f(s->canvas, cx - dx, cy - dy, cx + dx, cy + dy, s->thickness, 0.5f);
+    }
+}
+
+// canvas
+
+typedef struct
+{
+    canvas_t *canvas;
+    const char *filename;
+} canvas_state_t;
+
+static void bench_canvas_clear(void *user, int iterations)
+{
+    canvas_state_t *s = (canvas_state_t *)user;
+    for (int it = 0; it < iterations; it++)
+        canvas_clear(s->canvas, (it & 1) * 0.5f);
+    sink += s->canvas->data[0];
+}
+
+static void bench_canvas_save_pgm(void *user, int iterations)
+{
+    canvas_state_t *s = (canvas_state_t *)user;
+    for (int it = 0; it < iterations; it++)
+        canvas_save_pgm(s->canvas, s->filename);
+}
+
+static void bench_canvas_save_pgm_binary(void *user, int iterations)
+{
+    canvas_state_t *s = (canvas_state_t *)user;
+    for (int it = 0; it < iterations; it++)
+        canvas_save_pgm_binary(s->canvas, s->filename, 8);
+}
+
+typedef struct
+{
+    canvas_t *canvas;
+    frame_stream_t stream;
+} stream_state_t;
+
+// frames appended to an open stream, there is no open and close per frame like the PGM files
+static void bench_frame_stream_write(void *user, int iterations)
+{
+    stream_state_t *s = (stream_state_t *)user;
+    for (int it = 0; it < iterations; it++)
+        frame_stream_write(&s->stream, s->canvas);
+}
+
+typedef struct
+{
+    canvas_t *canvas;
+    int level;
+} png_state_t;
+
+// PNG encoding in memory on all the cores
+static void bench_canvas_encode_png(void *user, int iterations)
+{
+    png_state_t *s = (png_state_t *)user;
+    for (int it = 0; it < iterations; it++)
+    {
+        size_t size = 0;
+        free(canvas_encode_png(s->canvas, 8, s->level, 0, &size));
+        sink += (float)size;
+    }
+}
+
+// size of a file in bytes (0 if it can not be opened)
+static double file_size(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+        return 0.0;
+    fseek(file, 0, SEEK_END);
+    double size = (double)ftell(file);
+    fclose(file);
+    return size;
+}
+
+// wireframe
+
+typedef struct
+{
+    canvas_t *canvas;
+    object3d_t *obj;
+    mat4_t world_to_camera;
+    mat4_t projection;
+    light_t lights[2];
+    float near, far;
+    scene_t scene;
+    int instances;         // balls of the frame benchmark
+    unsigned char *encoded; // the frame benchmark encodes the frame like a sequence would
+    size_t encoded_size;
+} render_state_t;
+
+// a size x size grid of vertices on a wavy surface, connected to their right and lower neighbours
+static object3d_t *generate_grid(int size)
+{
+    object3d_t *obj = object3d_create(size * size, 2 * size * (size - 1));
+    if (!obj)
+        return NULL;
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            float u = (float)x / (size - 1) * 2.0f - 1.0f, v = (float)y / (size - 1) * 2.0f - 1.0f;
+            obj->vertices[y * size + x] = vec3f_create(u, v, 0.2f * sinf(3.0f * u) * cosf(3.0f * v));
+        }
+    int e = 0;
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            int i = y * size + x;
+            if (x + 1 < size)
+            {
+                obj->edges[e][0] = i;
+                obj->edges[e][1] = i + 1;
+                e++;
+            }
+            if (y + 1 < size)
+            {
+                obj->edges[e][0] = i;
+                obj->edges[e][1] = i + size;
+                e++;
+            }
+        }
+    object3d_compute_bounds(obj);
+    return obj;
+}
+
+static void bench_wireframe(void *user, int iterations)
+{
+    render_state_t *s = (render_state_t *)user;
+    for (int it = 0; it < iterations; it++)
+    {
+        mat4_t local_to_world = mat4_rotate_xyz(0.3f, it * 0.01f, 0.0f);
+        wireframe(s->canvas, s->obj, local_to_world, s->world_to_camera, s->projection, s->lights, 2, s->near, s->far);
+    }
+}
+
+// clear, draw a grid of spinning balls with the scene and encode the frame
+static void bench_frame(void *user, int iterations)
+{
+    render_state_t *s = (render_state_t *)user;
+    int side = (int)ceilf(sqrtf((float)s->instances));
+    for (int it = 0; it < iterations; it++)
+    {
+        canvas_clear(s->canvas, 0.0f);
+        scene_begin(&s->scene, s->world_to_camera, s->projection, s->lights, 2, s->near, s->far);
+        for (int i = 0; i < s->instances; i++)
+        {
+            float x = ((i % side) - (side - 1) * 0.5f) * 0.6f, y = ((i / side) - (side - 1) * 0.5f) * 0.6f;
+            float angle = it * 0.05f + i;
+            mat4_t local_to_world = mat4_multiply(mat4_translate(x, y, 0.0f),
+                                                  mat4_multiply(mat4_rotate_xyz(angle, angle, angle), mat4_scale(0.25f, 0.25f, 0.25f)));
+            scene_add(&s->scene, s->obj, local_to_world);
+        }
+        scene_render(&s->scene, s->canvas);
+        canvas_encode_pgm(s->canvas, 8, s->encoded, s->encoded_size);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            min_seconds = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-t seconds_per_benchmark]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    canvas_t *canvas = canvas_create(WIDTH, HEIGHT);
+    if (!canvas)
+        return 1;
+    canvas_clear(canvas, 0.0f);
+    char name[64];
+
+    printf("{\n  \"library\": \"libtiny3d\",\n  \"width\": %d,\n  \"height\": %d,\n  \"benchmarks\": [", WIDTH, HEIGHT);
+
+    // math
+    static math_state_t math;
+    srand(1);
+    for (int i = 0; i < MATH_COUNT; i++)
+    {
+        float r[6];
+        for (int k = 0; k < 6; k++)
+            r[k] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+        math.matrices[i] = mat4_multiply(mat4_translate(r[3], r[4], r[5]), mat4_rotate_xyz(r[0], r[1], r[2]));
+        math.vectors[i] = vec3_create(r[3] + 0.1f, r[4], r[5]);
+        math.points[i] = vec3f_create(r[3] + 0.1f, r[4], r[5]);
+        math.rotations[0][i] = quat_from_euler_xyz(r[0], r[1], r[2]);
+        math.rotations[1][i] = quat_from_euler_xyz(r[3], r[4], r[5]);
+        math.times[i] = (r[0] + 1.0f) * 0.5f;
+    }
+    bench_run("mat4_multiply", bench_mat4_multiply, &math, 0.0, 0.0, 0);
+    bench_run("mat4_transform_vec3", bench_mat4_transform_vec3, &math, 0.0, 0.0, 0);
+    bench_run("mat4_inverse", bench_mat4_inverse, &math, 0.0, 0.0, 0);
+    bench_run("mat4_transform_points/1024", bench_mat4_transform_points, &math, 0.0, MATH_COUNT, 0);
+    bench_run("quat_slerp_array+to_mat4/1024", bench_quat_slerp_array, &math, 0.0, MATH_COUNT, 0);
+    bench_run("vec3_ops", bench_vec3_ops, &math, 0.0, 0.0, 0);
+
+    // animation, 2 segments and 3 rotation keys per track, every ease and half of them at constant speed
+    static timeline_state_t ts;
+    timeline_init(&ts.timeline);
+    for (int i = 0; i < MATH_COUNT; i++)
+    {
+        vec3f_t points[7];
+        for (int k = 0; k < 7; k++)
+            points[k] = math.points[(i + k * 37) & (MATH_COUNT - 1)];
+        quat_t keys[3] = {math.rotations[0][i], math.rotations[1][i], math.rotations[0][(i + 1) & (MATH_COUNT - 1)]};
+        timeline_add_track(&ts.timeline, points, 2, keys, 3, math.times[i], 1.0f + math.times[i],
+                           (ease_t)(i % (EASE_PING_PONG + 1)), TIMELINE_LOOP | (i & 1 ? TIMELINE_ARC_LENGTH : 0), 1.0f);
+    }
+    bench_run("timeline_evaluate/1024", bench_timeline_evaluate, &ts, 0.0, MATH_COUNT, 0);
+    timeline_free(&ts.timeline);
+
+    // lines, the item rate is pixels of line length per second
+    float lengths[] = {10.0f, 100.0f, 500.0f};
+    float thicknesses[] = {1.0f, 3.0f, 8.0f};
+    for (int t = 0; t < 3; t++)
+        for (int l = 0; l < 3; l++)
+        {
+            line_state_t line = {canvas, lengths[l], thicknesses[t]};
+            snprintf(name, sizeof(name), "draw_line_f/len%d/thick%d", (int)lengths[l], (int)thicknesses[t]);
+            bench_run(name, bench_draw_line, &line, 0.0, lengths[l], 0);
+        }
+
+    // canvas, the throughput is the float pixels cleared and the bytes of the files
+    canvas_state_t cs = {canvas, "bench_out.pgm"};
+    bench_run("canvas_clear", bench_canvas_clear, &cs, (double)WIDTH * HEIGHT * sizeof(float), 0.0, 0);
+    draw_line_f(canvas, 0, 0, WIDTH, HEIGHT, 5.0f, 1.0f); // some pixels that are not 0
+    bench_canvas_save_pgm(&cs, 1);
+    bench_run("canvas_save_pgm", bench_canvas_save_pgm, &cs, file_size(cs.filename), 0.0, 0);
+    bench_run("canvas_save_pgm_binary", bench_canvas_save_pgm_binary, &cs, (double)WIDTH * HEIGHT, 0.0, 0);
+    remove(cs.filename);
+
+    // PNG at a few levels, the throughput is of the 8 bit pixels
+    int png_levels[] = {0, 1, CANVAS_PNG_DEFAULT_LEVEL, 9};
+    for (int i = 0; i < 4; i++)
+    {
+        png_state_t ps = {canvas, png_levels[i]};
+        snprintf(name, sizeof(name), "canvas_encode_png/level%d", png_levels[i]);
+        bench_run(name, bench_canvas_encode_png, &ps, (double)WIDTH * HEIGHT, 0.0, 0);
+    }
+
+    // the y4m stream goes to the null device so the file does not grow with the iterations
+#ifdef _WIN32
+    const char *null_device = "NUL";
+#else
+    const char *null_device = "/dev/null";
+#endif
+    stream_state_t ss = {.canvas = canvas};
+    if (frame_stream_open(&ss.stream, null_device, FRAME_STREAM_Y4M, WIDTH, HEIGHT, 8, 30, 1) == 0)
+    {
+        bench_run("frame_stream_write/y4m", bench_frame_stream_write, &ss, (double)ss.stream.frame_size, 0.0, 1);
+        frame_stream_close(&ss.stream);
+    }
+
+    // wireframe on meshes of increasing size, the item rate is edges per second
+    render_state_t rs = {.canvas = canvas, .near = 0.1f, .far = 100.0f, .instances = 64};
+    float top = tanf(45.0f * (float)M_PI / 360.0f) * rs.near;
+    rs.projection = mat4_frustum_asymmetric(-top, top, -top, top, rs.near, rs.far);
+    rs.world_to_camera = mat4_look_at(vec3_create(0, 0, 3.0f), vec3_create(0, 0, 0), vec3_create(0, 1, 0));
+    rs.lights[0] = (light_t){.direction = vec3_create(0.5f, 1.0f, 1.0f), .intensity = 0.9f};
+    rs.lights[1] = (light_t){.direction = vec3_create(-1.0f, 0.5f, 0.5f), .intensity = 0.5f};
+
+    rs.obj = generate_soccer_ball();
+    bench_run("wireframe/soccer_ball", bench_wireframe, &rs, 0.0, rs.obj->edge_count, 0);
+    object3d_destroy(rs.obj);
+    int sizes[] = {16, 64, 256};
+    for (int i = 0; i < 3; i++)
+    {
+        rs.obj = generate_grid(sizes[i]);
+        if (!rs.obj)
+            continue;
+        snprintf(name, sizeof(name), "wireframe/grid%d", sizes[i]);
+        bench_run(name, bench_wireframe, &rs, 0.0, rs.obj->edge_count, 0);
+        object3d_destroy(rs.obj);
+    }
+
+    // whole frames, the throughput is the encoded frame
+    rs.obj = generate_soccer_ball();
+    rs.encoded_size = canvas_encode_pgm(canvas, 8, NULL, 0);
+    rs.encoded = (unsigned char *)malloc(rs.encoded_size);
+    scene_init(&rs.scene);
+    if (rs.encoded)
+        bench_run("frame/scene_64_balls", bench_frame, &rs, (double)rs.encoded_size, 0.0, 1);
+    scene_free(&rs.scene);
+    free(rs.encoded);
+    object3d_destroy(rs.obj);
+
+    printf("\n  ]\n}\n");
+    canvas_destroy(canvas);
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "canvas.h"
@@ -7,18 +8,129 @@
 #include "math3d.h"
 #include "animation.h"
 #include "lighting.h"
+#include "sequence.h"
+#include "scene.h"
+#include "stream.h"
 
 #define WIDTH 800
 #define HEIGHT 600
 #define NUM_FRAMES 300 // Total frames for a full loop
+#define FPS 30
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-int main()
+// everything a frame needs, shared by the render threads (read only)
+typedef struct
 {
-    // create the canvas
-    canvas_t *canvas = canvas_create(WIDTH, HEIGHT);
+    object3d_t *soccer_ball;
+    light_t *lights;
+    int num_lights;
+    mat4_t world_to_camera;
+    mat4_t projection;
+    float near;
+    float far;
+    vec3_t path1[4]; // Object 1 points
+    vec3_t path2[4]; // Object 2 points
+    frame_stream_t *stream; // NULL writes one PGM file per frame
+    FILE *log;              // progress messages (stderr when the stream is stdout)
+} animation_scene_t;
+
+// render one frame of the animation (called from the worker threads)
+static void render_frame(canvas_t *canvas, int frame, float t, void *user)
+{
+    animation_scene_t *scene = (animation_scene_t *)user;
+    (void)frame;
+
+    // Use a smoother easing function that loops perfectly
+    float eased_t = 0.5f - 0.5f * cosf(t * 2 * M_PI); // Goes 0->1->0
+
+    canvas_clear(canvas, 0.0f); // Clear canvas to black
+
+    // both objects go into one scene so their edges are sorted together
+    scene_t frame_scene;
+    scene_init(&frame_scene);
+    scene_begin(&frame_scene, scene->world_to_camera, scene->projection, scene->lights, scene->num_lights, scene->near, scene->far);
+
+    // --- Object 1 (Front) ---
+    // Animate position along the simplified Bezier curve
+    vec3_t pos1 = vec3_bezier(scene->path1[0], scene->path1[1], scene->path1[2], scene->path1[3], eased_t);
+    mat4_t translation1 = mat4_translate(pos1.x, pos1.y, pos1.z);
+    // Simple rotation around Y axis
+    mat4_t rotation1 = mat4_rotate_xyz(0, t * 4 * M_PI, 0);
+    mat4_t local_to_world1 = mat4_multiply(translation1, rotation1);
+
+    // Add the first object
+    scene_add(&frame_scene, scene->soccer_ball, local_to_world1);
+
+    // --- Object 2 (Back) - Synchronized ---
+    // Animate position along its own path using the same 't'
+    vec3_t pos2 = vec3_bezier(scene->path2[0], scene->path2[1], scene->path2[2], scene->path2[3], eased_t);
+    mat4_t translation2 = mat4_translate(pos2.x, pos2.y, pos2.z);
+    // Different rotation pattern
+    mat4_t rotation2 = mat4_rotate_xyz(t * 2 * M_PI, 0, t * 2 * M_PI);
+    mat4_t local_to_world2 = mat4_multiply(translation2, rotation2);
+
+    // Add the second object
+    scene_add(&frame_scene, scene->soccer_ball, local_to_world2);
+
+    // Render both objects
+    scene_render(&frame_scene, canvas);
+    scene_free(&frame_scene);
+}
+
+// save the finished frames in order
+static int save_frame(const canvas_t *canvas, int frame, void *user)
+{
+    animation_scene_t *scene = (animation_scene_t *)user;
+
+    if (scene->stream)
+    {
+        // Append the frame to the video stream
+        if (frame_stream_write(scene->stream, canvas) != 0)
+            return 1;
+    }
+    else
+    {
+        // Save the rendered frame to a PGM file
+        char filename[100];
+        sprintf(filename, "../tests/visual_tests/frames_animation/frame_%04d.pgm", frame);
+        canvas_save_pgm_binary(canvas, filename, 8);
+    }
+    fprintf(scene->log, "\rFrame %d/%d", frame + 1, NUM_FRAMES);
+    fflush(scene->log);
+    return 0;
+}
+
+// animation_demo.exe [-o out.y4m | out.pgm | -]
+// with -o all the frames go into one y4m stream (or concatenated PGMs for a .pgm name), - is stdout
+int main(int argc, char **argv)
+{
+    const char *stream_name = NULL;
+    if (argc == 3 && strcmp(argv[1], "-o") == 0)
+        stream_name = argv[2];
+    else if (argc != 1)
+    {
+        printf("usage: %s [-o out.y4m|out.pgm|-]\n", argv[0]);
+        return 1;
+    }
+
+    // open the stream before anything is printed so stdout only has the frames
+    frame_stream_t stream;
+    FILE *log = stdout;
+    if (stream_name)
+    {
+        size_t len = strlen(stream_name);
+        int pgm = len > 4 && strcmp(stream_name + len - 4, ".pgm") == 0;
+        if (frame_stream_open(&stream, stream_name, pgm ? FRAME_STREAM_PGM : FRAME_STREAM_Y4M, WIDTH, HEIGHT, 8, FPS, 1) != 0)
+        {
+            fprintf(stderr, "Failed to open %s\n", stream_name);
+            return 1;
+        }
+        if (strcmp(stream_name, "-") == 0)
+            log = stderr;
+    }
+
     // create the soccer ball
     object3d_t *soccer_ball = generate_soccer_ball();
 
@@ -53,66 +165,52 @@ int main()
     float left = -right; // symmetric
     mat4_t projection = mat4_frustum_asymmetric(left, right, bottom, top, near, far);
 
-    // Object 1 points
-    vec3_t path1_p0 = vec3_create(-3, 0, 2.0f); // Start left
-    vec3_t path1_p1 = vec3_create(-3, 3, 2.0f); // Control point up-left
-    vec3_t path1_p2 = vec3_create(3, -3, 2.0f); // Control point down-right
-    vec3_t path1_p3 = vec3_create(3, 0, 2.0f);  // End right
-
-    // Object 2 points
-    vec3_t path2_p0 = vec3_create(0, 3, -2.0f);   // Start top
-    vec3_t path2_p1 = vec3_create(3, 3, -2.0f);   // Control point top-right
-    vec3_t path2_p2 = vec3_create(-3, -3, -2.0f); // Control point bottom-left
-    vec3_t path2_p3 = vec3_create(0, -3, -2.0f);  // End bottom
-
-    // Animation loop
-    printf("Rendering %d frames...\n", NUM_FRAMES);
-    for (int i = 0; i < NUM_FRAMES; i++)
+    animation_scene_t scene = {
+        .soccer_ball = soccer_ball,
+        .lights = lights,
+        .num_lights = num_lights,
+        .world_to_camera = world_to_camera,
+        .projection = projection,
+        .near = near,
+        .far = far,
+        .stream = stream_name ? &stream : NULL,
+        .log = log,
+        .path1 = {
+            vec3_create(-3, 0, 2.0f), // Start left
+            vec3_create(-3, 3, 2.0f), // Control point up-left
+            vec3_create(3, -3, 2.0f), // Control point down-right
+            vec3_create(3, 0, 2.0f)}, // End right
+        .path2 = {
+            vec3_create(0, 3, -2.0f),   // Start top
+            vec3_create(3, 3, -2.0f),   // Control point top-right
+            vec3_create(-3, -3, -2.0f), // Control point bottom-left
+            vec3_create(0, -3, -2.0f)}, // End bottom
+    };
+
+    // Animation loop, the frames are rendered on all cores and saved in order
+    fprintf(log, "Rendering %d frames...\n", NUM_FRAMES);
+    sequence_desc_t sequence = {
+        .width = WIDTH,
+        .height = HEIGHT,
+        .first_frame = 0,
+        .frame_count = NUM_FRAMES,
+        .num_threads = 0,
+        .render = render_frame,
+        .output = save_frame,
+        .user = &scene,
+    };
+    int rendered = render_sequence(&sequence);
+    if (stream_name && frame_stream_close(&stream) != 0)
+        rendered = -1;
+    if (rendered != NUM_FRAMES)
     {
-        // Calculate time 't' for the current frame, looping from 0 to 1
-        float t = (float)i / (NUM_FRAMES);
-
-        // Use a smoother easing function that loops perfectly
-        float eased_t = 0.5f - 0.5f * cosf(t * 2 * M_PI); // Goes 0->1->0
-
-        canvas_clear(canvas, 0.0f); // Clear canvas to black
-
-        // --- Object 1 (Front) ---
-        // Animate position along the simplified Bezier curve
-        vec3_t pos1 = vec3_bezier(path1_p0, path1_p1, path1_p2, path1_p3, eased_t);
-        mat4_t translation1 = mat4_translate(pos1.x, pos1.y, pos1.z);
-        // Simple rotation around Y axis
-        mat4_t rotation1 = mat4_rotate_xyz(0, t * 4 * M_PI, 0);
-        mat4_t local_to_world1 = mat4_multiply(translation1, rotation1);
-
-        // Render the first object
-        wireframe(canvas, soccer_ball, local_to_world1, world_to_camera, projection, lights, num_lights, near, far);
-
-        // --- Object 2 (Back) - Synchronized ---
-        // Animate position along its own path using the same 't'
-        vec3_t pos2 = vec3_bezier(path2_p0, path2_p1, path2_p2, path2_p3, eased_t);
-        mat4_t translation2 = mat4_translate(pos2.x, pos2.y, pos2.z);
-        // Different rotation pattern
-        mat4_t rotation2 = mat4_rotate_xyz(t * 2 * M_PI, 0, t * 2 * M_PI);
-        mat4_t local_to_world2 = mat4_multiply(translation2, rotation2);
-
-        // Render the second object
-        wireframe(canvas, soccer_ball, local_to_world2, world_to_camera, projection, lights, num_lights, near, far);
-
-        // Save the rendered frame to a PGM file
-        char filename[100];
-        sprintf(filename, "../tests/visual_tests/frames_animation/frame_%04d.pgm", i);
-        canvas_save_pgm(canvas, filename);
-        printf("\rFrame %d/%d", i + 1, NUM_FRAMES);
-        fflush(stdout);
+        fprintf(log, "\nFailed to render the animation\n");
+        return 1;
     }
-    printf("\nAnimation rendered successfully!\n");
+    fprintf(log, "\nAnimation rendered successfully!\n");
 
     // --- Cleanup ---
-    canvas_destroy(canvas);
-    free(soccer_ball->vertices);
-    free(soccer_ball->edges);
-    free(soccer_ball);
+    object3d_destroy(soccer_ball);
 
     return 0;
-}
\ No newline at end of file
+}
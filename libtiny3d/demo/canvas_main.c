@@ -31,7 +31,7 @@ int main()
 
     char filename[128];
     snprintf(filename, sizeof(filename), "../tests/visual_tests/task_1_demo.pgm");
-    canvas_save_pgm(canvas, filename);
+    canvas_save_pgm_binary(canvas, filename, 8);
 
     canvas_destroy(canvas);
 
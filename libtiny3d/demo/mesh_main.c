@@ -0,0 +1,110 @@
+#define _USE_MATH_DEFINES
+#include "mesh_io.h"
+#include "mesh_opt.h"
+#include "lod.h"
+#include "scene.h"
+#include "raster.h"
+#include "parallel.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define WIDTH 1024
+#define HEIGHT 1024
+
+// load a mesh, print the load throughput and draw it
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: %s mesh.obj|mesh.ply|mesh.t3d [threads]\n", argv[0]);
+        return 1;
+    }
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    mesh_load_stats_t stats;
+    object3d_t *mesh = mesh_load(argv[1], threads, &stats);
+    if (!mesh)
+    {
+        printf("Failed to load %s\n", argv[1]);
+        return 1;
+    }
+    printf("%s: %d vertices, %d faces, %d edges (%d duplicates dropped)\n",
+           argv[1], stats.vertex_count, stats.face_count, stats.edge_count, stats.duplicate_edges);
+    printf("%.1f MB in %.3f s on %d threads (%.1f MB/s)\n",
+           stats.file_bytes / (1024.0 * 1024.0), stats.seconds, stats.threads, mesh_load_mb_per_second(&stats));
+
+    // cache friendly vertex and edge order (a .t3d from mesh2t3d already has it)
+    double start = parallel_time_seconds();
+    mesh_optimize_locality(mesh);
+    int index16 = mesh_build_index16(mesh, 1) == 0;
+    printf("reordered in %.3f s%s\n", parallel_time_seconds() - start, index16 ? ", 16 bit indices" : "");
+
+    // simplified copies for when the mesh is small on screen
+    object3d_lod_t lod;
+    start = parallel_time_seconds();
+    if (object3d_lod_build(&lod, mesh, OBJECT3D_LOD_MAX_LEVELS) != 0)
+    {
+        printf("Failed to build the levels of detail\n");
+        object3d_destroy(mesh);
+        return 1;
+    }
+    printf("%d levels of detail in %.3f s:", lod.level_count, parallel_time_seconds() - start);
+    for (int i = 0; i < lod.level_count; i++)
+        printf(" %d", lod.levels[i]->edge_count);
+    printf(" edges\n");
+
+    // center the mesh and scale it to a unit sphere
+    float radius = mesh->bounds_radius > 0.0f ? mesh->bounds_radius : 1.0f;
+    vec3f_t c = mesh->bounds_center;
+    mat4_t local_to_world = mat4_multiply(mat4_scale(1.0f / radius, 1.0f / radius, 1.0f / radius),
+                                          mat4_translate(-c.x, -c.y, -c.z));
+
+    // camera at a distance that fits the sphere in the view
+    float fov = 45.0f * M_PI / 180.0f;
+    float near = 0.1f, far = 100.0f;
+    float top = tanf(fov / 2.0f) * near;
+    mat4_t projection = mat4_frustum_asymmetric(-top, top, -top, top, near, far);
+    mat4_t world_to_camera = mat4_look_at(vec3_create(0, 0, 3.0f), vec3_create(0, 0, 0), vec3_create(0, 1, 0));
+    light_t lights[] = {
+        {.direction = vec3_create(0.5f, 1.0f, 1.0f), .intensity = 0.9f},
+        {.direction = vec3_create(-1.0f, 0.5f, 0.5f), .intensity = 0.5f}};
+
+    canvas_t *canvas = canvas_create(WIDTH, HEIGHT);
+    canvas_set_tiling(canvas, RASTER_DEFAULT_TILE_SIZE, 0);
+    canvas_clear(canvas, 0.0f);
+
+    // time the frame stage by stage (only when the library is built with -DTINY3D_STATS)
+    render_stats_reset();
+    render_stats_trace(1);
+
+    scene_t scene;
+    scene_init(&scene);
+    scene_begin(&scene, world_to_camera, projection, lights, 2, near, far);
+    scene_add_lod(&scene, &lod, local_to_world);
+    scene_render(&scene, canvas);
+    for (int i = 0; i < lod.level_count; i++)
+        if (scene.items[0].obj == lod.levels[i])
+            printf("drew level %d (%d edges)\n", i, lod.levels[i]->edge_count);
+    scene_free(&scene);
+
+    canvas_save_pgm_binary(canvas, "mesh_view.pgm", 8);
+
+    if (render_stats_enabled())
+    {
+        render_stats_t frame_stats;
+        render_stats_get(&frame_stats);
+        for (int i = 0; i < RENDER_STAGE_COUNT; i++)
+            printf("%-8s %8.3f ms (%lld runs)\n", render_stats_stage_name(i), frame_stats.seconds[i] * 1000.0, frame_stats.calls[i]);
+        for (int i = 0; i < RENDER_COUNTER_COUNT; i++)
+            printf("%-14s %lld\n", render_stats_counter_name(i), frame_stats.counters[i]);
+        if (render_stats_write_trace("mesh_trace.json") == 0)
+            printf("trace written to mesh_trace.json\n");
+    }
+
+    canvas_destroy(canvas);
+    object3d_lod_free(&lod);
+    object3d_destroy(mesh);
+    return 0;
+}
@@ -4,17 +4,57 @@
 #include <stdlib.h>
 #include <math.h>
 #include <lighting.h>
+#include "sequence.h"
 
-int main()
+#define WIDTH 512
+#define HEIGHT 512
+#define NUM_FRAMES 200
+
+// shared by the render threads (read only)
+typedef struct
 {
-    // Create canvas
-    canvas_t *canvas = canvas_create(512, 512);
-    if (!canvas)
-    {
-        printf("Failed to create canvas\n");
-        return 1;
-    }
+    object3d_t *soccer_ball;
+    light_t *lights;
+    int num_lights;
+    mat4_t world_to_camera;
+    mat4_t projection;
+    float near;
+    float far;
+} pipeline_scene_t;
+
+// render one frame (called from the worker threads)
+static void render_frame(canvas_t *canvas, int frame, float t, void *user)
+{
+    pipeline_scene_t *scene = (pipeline_scene_t *)user;
+    (void)t;
+
+    canvas_clear(canvas, 0.0f);
+
+    // Rotate object
+    float angle = frame * 0.1f;
+    mat4_t rotation = mat4_rotate_xyz(angle, angle, angle);
+    mat4_t scale = mat4_scale(1.5, 1.5, 1.5);
 
+    mat4_t local_to_world = mat4_multiply(rotation, scale);
+
+    // Render wireframe
+    wireframe(canvas, scene->soccer_ball, local_to_world, scene->world_to_camera, scene->projection, scene->lights, scene->num_lights, scene->near, scene->far);
+}
+
+// save the finished frames in order
+static int save_frame(const canvas_t *canvas, int frame, void *user)
+{
+    (void)user;
+
+    // Save frame
+    char filename[128];
+    snprintf(filename, sizeof(filename), "../tests/visual_tests/frames_pipeline/frame_%03d.pgm", frame);
+    canvas_save_pgm_binary(canvas, filename, 8);
+    return 0;
+}
+
+int main()
+{
     // Generate soccer ball
     object3d_t *soccer_ball = generate_soccer_ball();
 
@@ -26,7 +66,7 @@ int main()
 
     // Projection setup - fruntum is along z axis
     float near = 0.1f, far = 100.0f;
-    float aspect = (float)canvas->width / canvas->height;
+    float aspect = (float)WIDTH / HEIGHT;
     float fov = 60.0f * (M_PI / 180.0f); // in radians
     float top = near * tanf(fov / 2.0f);
     float right = top * aspect;
@@ -43,32 +83,27 @@ int main()
         {.direction = vec3_create(0.0f, -1.0f, 0.5f), .intensity = 0.2f}};
     int num_lights = sizeof(lights) / sizeof(lights[0]);
 
-    // Animation loop (generate multiple frames)
-    for (int frame = 0; frame < 200; frame++)
-    {
-        canvas_clear(canvas, 0.0f);
+    pipeline_scene_t scene = {soccer_ball, lights, num_lights, world_to_camera, projection, near, far};
 
-        // Rotate object
-        float angle = frame * 0.1f;
-        mat4_t rotation = mat4_rotate_xyz(angle, angle, angle);
-        mat4_t scale = mat4_scale(1.5, 1.5, 1.5);
-
-        mat4_t local_to_world = mat4_multiply(rotation, scale);
-
-        // Render wireframe
-        wireframe(canvas, soccer_ball, local_to_world, world_to_camera, projection, lights, 4, near, far);
-
-        // Save frame
-        char filename[128];
-        snprintf(filename, sizeof(filename), "../tests/visual_tests/frames_pipeline/frame_%03d.pgm", frame);
-        canvas_save_pgm(canvas, filename);
+    // Animation loop (generate multiple frames on all cores)
+    sequence_desc_t sequence = {
+        .width = WIDTH,
+        .height = HEIGHT,
+        .first_frame = 0,
+        .frame_count = NUM_FRAMES,
+        .num_threads = 0,
+        .render = render_frame,
+        .output = save_frame,
+        .user = &scene,
+    };
+    if (render_sequence(&sequence) != NUM_FRAMES)
+    {
+        printf("Failed to render the frames\n");
+        return 1;
     }
 
     // Cleanup
-    free(soccer_ball->vertices);
-    free(soccer_ball->edges);
-    free(soccer_ball);
-    canvas_destroy(canvas);
+    object3d_destroy(soccer_ball);
 
     return 0;
 }
\ No newline at end of file
@@ -15,4 +15,76 @@
 
 vec3_t vec3_bezier(vec3_t p0, vec3_t p1, vec3_t p2, vec3_t p3, float t);
 
+// how a track moves through its curve over its duration
+typedef enum
+{
+    EASE_LINEAR,
+    EASE_IN,        // t^2, starts slow
+    EASE_OUT,       // t (2 - t), ends slow
+    EASE_IN_OUT,    // smoothstep
+    EASE_PING_PONG, // 0.5 - 0.5 cos(2 pi t), goes to the end and back
+} ease_t;
+
+// track flags
+#define TIMELINE_LOOP 1u       // repeat after the duration instead of stopping at the end
+#define TIMELINE_ARC_LENGTH 2u // move at a constant speed along the curve (uses a precomputed table)
+
+#define TIMELINE_ARC_TABLE_SIZE 65 // curve parameter at evenly spaced fractions of the arc length
+
+// Many animated objects in structure of arrays form. A track is a chain of cubic Bezier segments for the position,
+// a chain of rotation keys and a uniform scale, all following one eased parameter from 0 to 1.
+// timeline_evaluate runs every stage over all the tracks before the next one, so there is no per object call.
+typedef struct
+{
+    // per track
+    float *start;         // time the track starts
+    float *inv_duration;  // 1 / duration
+    float *scale;         // uniform scale
+    unsigned char *ease;  // ease_t
+    unsigned char *flags; // TIMELINE_*
+    int *segment_first;   // first segment of the track
+    int *segment_count;   //
+    int *key_first;       // first rotation key of the track
+    int *key_count;       //
+    float *arc;           // TIMELINE_ARC_TABLE_SIZE values per track (only used with TIMELINE_ARC_LENGTH)
+    int track_count;
+    int track_capacity;
+
+    // the control points of all the segments, p[k][i] is point k of segment i
+    float *px[4], *py[4], *pz[4];
+    int segment_total;
+    int segment_capacity;
+
+    // the rotation keys of all the tracks
+    quat_t *keys;
+    int key_total;
+    int key_capacity;
+
+    // per track results of the stages, reused between calls
+    float *u;           // eased parameter
+    vec3f_t *positions; //
+    quat_t *rot_a;      // the two keys around the parameter
+    quat_t *rot_b;      //
+    float *rot_t;       // parameter between them
+    quat_t *rotations;  //
+    int work_capacity;
+} timeline_t;
+
+// Start an empty timeline
+void timeline_init(timeline_t *timeline);
+
+// Free the arrays
+void timeline_free(timeline_t *timeline);
+
+// Add a track: segment_count cubic segments given as 3 * segment_count + 1 points (the segments share their ends),
+// key_count rotation keys spread evenly over the track (0 keys is no rotation), keys can be NULL when key_count is 0
+// returns the index of the track (and of its matrix) or -1 if the arguments are not valid or the memory ran out
+int timeline_add_track(timeline_t *timeline, const vec3f_t *points, int segment_count,
+                       const quat_t *keys, int key_count,
+                       float start, float duration, ease_t ease, unsigned flags, float scale);
+
+// Evaluate all the tracks at time into local_to_world[0 .. track_count - 1]
+// returns 0 on success and -1 if the work arrays could not be allocated
+int timeline_evaluate(timeline_t *timeline, float time, mat4_t *local_to_world);
+
 #endif // ANIMATION_H
@@ -2,31 +2,146 @@
 #define CANVAS_H
 
 #include <stdio.h>
+#include <stddef.h>
+
+// alignment of the pixel buffer in bytes (one cache line / one AVX-512 register)
+#define CANVAS_ALIGNMENT 64
+
+// a pixel passes the depth test if it is at most this much behind the stored depth,
+// so lines that meet at a vertex do not cut into each other
+// (the stamps of one line never reject each other, see depth_owner)
+#define CANVAS_DEPTH_EPSILON 0.001f
+
+// depth of an empty pixel in the depth plane
+#define CANVAS_DEPTH_EMPTY 3.0e38f
+
+// how canvas_draw_lines draws a line
+typedef enum
+{
+    LINE_MODE_BRUSH,   // draw_line_f: a circular brush stamped every half pixel
+    LINE_MODE_COVERAGE // draw_line_coverage_f: coverage from the distance to the segment, one visit per pixel
+} line_mode_t;
 
 // canvas structure that store the canvas data
 typedef struct
 {
     int width;
     int height;
-    float **pixels; // a 2D array to store the pixel values
+    int stride;     // number of floats between the start of two rows (multiple of 16)
+    float *data;    // one 64-byte aligned block of stride * height floats
+    float **pixels; // row pointers into data so pixels[y][x] keeps working
+    float *depth;   // optional log depth plane with the same layout as data (NULL when it is off)
+    unsigned *depth_owner; // id of the line that last passed the depth test of each pixel (0 = none)
+    unsigned depth_line;   // id of the last line drawn with the depth test
+
+    // rasterization settings used by canvas_draw_lines (see raster.h)
+    int line_mode;      // LINE_MODE_BRUSH or LINE_MODE_COVERAGE
+    int tile_size;      // 0 draws the lines one after another on the calling thread
+    int raster_threads; // threads used for the tiles (0 = one per core)
 } canvas_t;
 
+// one line in screen coordinates
+typedef struct
+{
+    float x0, y0;
+    float x1, y1;
+    float thickness;
+    float intensity;
+    float z0, z1; // normalized log depth of the ends, only used when the canvas has a depth plane
+} line_t;
+
+// rectangle of pixels, x0 and y0 are inside and x1 and y1 are not
+typedef struct
+{
+    int x0, y0;
+    int x1, y1;
+} canvas_rect_t;
+
+// Get a pointer to the first pixel of row y
+static inline float *canvas_row(const canvas_t *canvas, int y)
+{
+    return canvas->data + (size_t)y * canvas->stride;
+}
+
 // Create a canvas with given width and height
 canvas_t *canvas_create(int width, int height);
 
 // Destroy the canvas and free memory
 void canvas_destroy(canvas_t *canvas);
 
-// Clear the canvas to a specific value
+// Clear the canvas to a specific value (and the depth plane to empty if it is on)
 void canvas_clear(canvas_t *canvas, float value);
 
+// Turn on the depth buffer: a log depth plane that the line functions test and update per pixel
+// returns 0 on success and -1 if the plane could not be allocated
+int canvas_enable_depth(canvas_t *canvas);
+
+// Turn off the depth buffer and free the plane
+void canvas_disable_depth(canvas_t *canvas);
+
+// Set every depth to CANVAS_DEPTH_EMPTY (and forget which line wrote it)
+void canvas_clear_depth(canvas_t *canvas);
+
+// Fill the rectangle (x, y, width, height) with a value, the rectangle is clipped to the canvas
+void canvas_fill_rect(canvas_t *canvas, int x, int y, int width, int height, float value);
+
+// Copy row src_y of src into row dst_y of dst (the widths must match)
+void canvas_copy_row(canvas_t *dst, int dst_y, const canvas_t *src, int src_y);
+
+// Copy the whole canvas src into dst (the sizes must match)
+void canvas_copy(canvas_t *dst, const canvas_t *src);
+
+// SIMD kernels used by the functions above, usable on any float span
+void span_fill_f(float *dst, float value, int count);
+void span_copy_f(float *dst, const float *src, int count);
+
 // Set pixel brightness at floating-point coordinates with bilinear filtering
 void set_pixel_f(canvas_t *canvas, float x, float y, float intensity);
 
 // Draw a line from (x0, y0) to (x1, y1) with thickness and intensity
 void draw_line_f(canvas_t *canvas, float x0, float y0, float x1, float y1, float thickness, float intensity);
 
+// Draw a line like draw_line_f but only change the pixels inside clip
+// the pixels inside clip end up exactly as draw_line_f would leave them
+// with a depth plane the depth goes from z0 to z1 along the line and each pixel is depth tested
+void draw_line_f_clipped(canvas_t *canvas, const line_t *line, const canvas_rect_t *clip);
+
+// Draw an anti-aliased line with the same soft falloff as draw_line_f,
+// the coverage of each pixel is computed from its distance to the segment and every pixel is visited once
+void draw_line_coverage_f(canvas_t *canvas, float x0, float y0, float x1, float y1, float thickness, float intensity);
+
+// draw_line_coverage_f that only changes the pixels inside clip
+void draw_line_coverage_f_clipped(canvas_t *canvas, const line_t *line, const canvas_rect_t *clip);
+
+// Choose how canvas_draw_lines draws the lines (LINE_MODE_BRUSH is the default)
+void canvas_set_line_mode(canvas_t *canvas, line_mode_t mode);
+
 // Save canvas to PGM file
 void canvas_save_pgm(canvas_t *canvas, const char *filename);
 
+// Save canvas to a binary PGM (P5) file with 8 or 16 bits per pixel, returns 0 on success and -1 on failure
+int canvas_save_pgm_binary(const canvas_t *canvas, const char *filename, int bit_depth);
+
+// Encode the canvas as a binary PGM (P5) image into buffer
+// returns the number of bytes the image needs, nothing is written if buffer is NULL or buffer_size is too small
+// returns 0 if the canvas or the bit depth is not valid
+size_t canvas_encode_pgm(const canvas_t *canvas, int bit_depth, unsigned char *buffer, size_t buffer_size);
+
+// PNG compression levels go from 0 (the rows are stored uncompressed) through 1 (fastest) to 9 (smallest file)
+#define CANVAS_PNG_DEFAULT_LEVEL 6
+
+// Encode the canvas as an 8 or 16 bit grayscale PNG with the built in deflate, each row gets the filter that suits it best
+// the rows are compressed in bands of about 256 KB on num_threads threads (0 = one per core), the bytes do not depend on the thread count
+// returns the image to free with free() and its size in *size, or NULL if the arguments are not valid or the memory ran out
+unsigned char *canvas_encode_png(const canvas_t *canvas, int bit_depth, int level, int num_threads, size_t *size);
+
+// Save canvas to a grayscale PNG file like canvas_encode_png, returns 0 on success and -1 on failure
+int canvas_save_png(const canvas_t *canvas, const char *filename, int bit_depth, int level, int num_threads);
+
+// Convert count floats in [0, 1] to 8 bit values the same way canvas_save_pgm does (v * 255, truncated and clamped)
+void span_quantize_u8(const float *src, unsigned char *dst, int count);
+
+// Convert count floats in [0, 1] to big-endian 16 bit values (v * 65535, truncated and clamped)
+void span_quantize_u16be(const float *src, unsigned char *dst, int count);
+
 #endif // CANVAS_H
@@ -0,0 +1,28 @@
+#ifndef DEPTH_SORT_H
+#define DEPTH_SORT_H
+
+#include <stdint.h>
+
+// Sorts depth values with an LSD radix sort (O(n)), the scratch buffers are kept between calls
+typedef struct
+{
+    int key_bits;        // 32: exact float order, 16: depths in [0, 1] quantized to 65536 levels
+    uint32_t *keys;      // radix keys and their copy for the passes
+    uint32_t *keys_tmp;  //
+    int *order;          // sorted indices (the result)
+    int *order_tmp;      //
+    int capacity;        // allocated size of the buffers
+} depth_sorter_t;
+
+// Start a sorter with 16 or 32 bit keys (anything else is 32)
+void depth_sorter_init(depth_sorter_t *sorter, int key_bits);
+
+// Free the scratch buffers
+void depth_sorter_free(depth_sorter_t *sorter);
+
+// Sort the indices of depths from the largest depth to the smallest (painter's order)
+// the sort is stable so equal depths keep their input order
+// returns the indices (owned by the sorter, valid until the next call) or NULL if the buffers could not be allocated
+const int *depth_sort_back_to_front(depth_sorter_t *sorter, const float *depths, int count);
+
+#endif // DEPTH_SORT_H
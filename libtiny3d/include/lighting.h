@@ -15,4 +15,40 @@ typedef struct
 //   Computes the total light intensity on an edge based on Lambert's cosine law.
 float compute_lighting(vec3_t edge_dir, light_t *lights, int num_lights);
 
+// compute_lighting for a vec3f_t edge direction (no spherical values are computed)
+float compute_lighting_f(vec3f_t edge_dir, const light_t *lights, int num_lights);
+
+// A set of lights with the directions normalized once, when the set changes
+typedef struct
+{
+    light_t *lights;     // the lights as they were given
+    vec3f_t *directions; // unit direction of every light
+    float *intensities;  //
+    int count;           // number of lights
+    int capacity;        // allocated size of the arrays
+    unsigned version;    // changes every time the set changes, for caches of computed intensities
+} light_set_t;
+
+// Start an empty light set
+void light_set_init(light_set_t *set);
+
+// Free the arrays of the set
+void light_set_free(light_set_t *set);
+
+// Replace the lights of the set with a copy of lights, nothing changes (not even the version) if they are the same
+// returns 0 on success and -1 if the arrays could not grow
+int light_set_assign(light_set_t *set, const light_t *lights, int num_lights);
+
+// Add a light, returns its index or -1 if the arrays could not grow
+int light_set_add(light_set_t *set, light_t light);
+
+// Replace light index, returns 0 on success and -1 if the index is not valid
+int light_set_update(light_set_t *set, int index, light_t light);
+
+// compute_lighting_f with the normalized lights of the set (same result)
+float light_set_evaluate(const light_set_t *set, vec3f_t edge_dir);
+
+// Compute the intensities of count edge directions at once (SIMD), out[i] is light_set_evaluate(set, edge_dirs[i])
+void light_set_evaluate_batch(const light_set_t *set, const vec3f_t *edge_dirs, int count, float *out);
+
 #endif // LIGHTING_H
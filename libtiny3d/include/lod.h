@@ -0,0 +1,34 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "renderer.h"
+
+#define OBJECT3D_LOD_MAX_LEVELS 8
+#define OBJECT3D_LOD_MAX_ERROR 1.0f // default error in pixels a level may have on screen
+
+// A chain of simplified copies of one mesh, level 0 is the source and every level has fewer edges than the last
+typedef struct
+{
+    object3d_t *levels[OBJECT3D_LOD_MAX_LEVELS]; // levels[0] is the source (not owned), the others are freed by object3d_lod_free
+    float cell_size[OBJECT3D_LOD_MAX_LEVELS];    // object space size of the clusters of every level (0 for the source)
+    int level_count;                             //
+    float max_error;                             // largest cell size in pixels a selected level may have
+} object3d_lod_t;
+
+// Build up to max_levels levels (the source included) by vertex clustering obj on grids that halve every level,
+// grids that remove less than a third of the edges of the last level are skipped
+// obj must stay alive while the chain is used, returns 0 on success and -1 on failure
+int object3d_lod_build(object3d_lod_t *lod, object3d_t *obj, int max_levels);
+
+// Free the simplified levels
+void object3d_lod_free(object3d_lod_t *lod);
+
+// Diameter in pixels of the bounding sphere of obj on a canvas of the given size
+// returns FLT_MAX if the sphere reaches the camera plane (or obj has no bounds), 0 if it is behind the camera
+float object3d_projected_size(const object3d_t *obj, mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection,
+                              int canvas_width, int canvas_height);
+
+// Get the coarsest level whose clusters are at most max_error pixels when the source covers projected_size pixels
+int object3d_lod_select(const object3d_lod_t *lod, float projected_size);
+
+#endif // LOD_H
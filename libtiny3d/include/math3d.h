@@ -3,6 +3,8 @@
 
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 // structure to holds the 3D vercor in cartesian and spherical
 typedef struct
@@ -16,12 +18,25 @@ typedef struct
     float phi;   // polar angle from Z-axis (0 to π)
 } vec3_t;
 
+// compact cartesian 3D vector (12 bytes) for the rendering path,
+// it has no spherical values, use vec3f_to_spherical / vec3f_from_spherical when they are needed
+typedef struct
+{
+    float x, y, z;
+} vec3f_t;
+
 typedef struct
 {
     // cartesian values for 4d
     float x, y, z, w;
 } vec4_t;
 
+// unit quaternion for rotations, w is the real part
+typedef struct
+{
+    float x, y, z, w;
+} quat_t;
+
 // 4x4 Matrix structure (column-major order)
 // 4x4 Matrix structure
 typedef struct
@@ -54,8 +69,169 @@ mat4_t mat4_rotate_xyz(float rx, float ry, float rz);
 mat4_t mat4_frustum_asymmetric(float left, float right, float bottom, float top, float near, float far);
 mat4_t mat4_multiply(mat4_t a, mat4_t b);
 vec3_t mat4_transform_vec3(mat4_t m, vec3_t v);
+mat4_t mat4_inverse(mat4_t m); // the identity if m can not be inverted
+
+// Pointer versions of the matrix functions, they take no copies of the matrices and use SSE when it is available
+// the SSE versions do the same operations in the same order as the scalar ones, so their results are the same,
+// except mat4_inverse_to which matches the scalar inverse within MAT4_INVERSE_TOLERANCE (see mat4_nearly_equal)
+// for transform and projection matrices, badly conditioned matrices can differ more
+// out can be one of the inputs
+#define MAT4_INVERSE_TOLERANCE 1e-5f
+
+// out = a * b (mat4_transform_vec4_to is inline below)
+void mat4_multiply_to(mat4_t *out, const mat4_t *a, const mat4_t *b);
+
+// out = inverse of m, returns 0 on success and -1 if m can not be inverted (out is not changed)
+int mat4_inverse_to(mat4_t *out, const mat4_t *m);
+
+// out[i] = m * (in[i], 1) divided by w when |w| > 0.0001 (like mat4_transform_point), in and out can be the same
+void mat4_transform_points(const mat4_t *m, const vec3f_t *in, vec3f_t *out, int count);
+
+// out[i] = m * (in[i], 1) without the divide (homogeneous clip space positions)
+void mat4_transform_points_h(const mat4_t *m, const vec3f_t *in, vec4_t *out, int count);
+
+// Returns 1 if every element of a and b differs by at most tolerance, relative to the element size when that is above 1
+int mat4_nearly_equal(const mat4_t *a, const mat4_t *b, float tolerance);
+
+// Quaternions, a * b rotates by b first and then by a like mat4_multiply
+quat_t quat_identity(void);
+quat_t quat_from_axis_angle(vec3f_t axis, float angle); // axis must be a unit vector
+quat_t quat_from_euler_xyz(float rx, float ry, float rz); // same rotation as mat4_rotate_xyz
+quat_t quat_multiply(quat_t a, quat_t b);
+quat_t quat_normalize(quat_t q);
+vec3f_t quat_rotate(quat_t q, vec3f_t v);
+
+// Interpolate from a to b along the shorter way round, the results are unit quaternions
+// nlerp is a normalized straight line (no trig, its speed is not constant), slerp has a constant speed
+quat_t quat_nlerp(quat_t a, quat_t b, float t);
+quat_t quat_slerp(quat_t a, quat_t b, float t);
+
+// Rotation matrix of a unit quaternion
+mat4_t quat_to_mat4(quat_t q);
+
+// Interpolate count orientations at once, out[i] = nlerp or slerp of a[i] and b[i] at t[i] (out can be a or b)
+// the array slerp uses a polynomial correction of nlerp instead of trig, its angle is within 0.002 rad of quat_slerp
+void quat_nlerp_array(const quat_t *a, const quat_t *b, const float *t, quat_t *out, int count);
+void quat_slerp_array(const quat_t *a, const quat_t *b, const float *t, quat_t *out, int count);
+
+// out[i] = translate(translations[i]) * rotation of rotations[i], translations can be NULL for no translation
+void quat_to_mat4_array(const quat_t *rotations, const vec3f_t *translations, mat4_t *out, int count);
 
 // mat4 loockat function
 mat4_t mat4_look_at(vec3_t eye, vec3_t target, vec3_t up);
 
+// Conversions between vec3f_t and vec3_t / spherical coordinates (these do the trig)
+vec3_t vec3_from_vec3f(vec3f_t v);
+void vec3f_to_spherical(vec3f_t v, float *r, float *theta, float *phi);
+vec3f_t vec3f_from_spherical(float r, float theta, float phi);
+
+// vec3f_t operations, these never touch trig functions
+
+static inline vec3f_t vec3f_create(float x, float y, float z)
+{
+    vec3f_t v = {x, y, z};
+    return v;
+}
+
+// drop the spherical values of a vec3_t
+static inline vec3f_t vec3f_from_vec3(vec3_t v)
+{
+    return vec3f_create(v.x, v.y, v.z);
+}
+
+static inline vec3f_t vec3f_add(vec3f_t a, vec3f_t b)
+{
+    return vec3f_create(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+static inline vec3f_t vec3f_sub(vec3f_t a, vec3f_t b)
+{
+    return vec3f_create(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline vec3f_t vec3f_scale(vec3f_t v, float s)
+{
+    return vec3f_create(v.x * s, v.y * s, v.z * s);
+}
+
+static inline float vec3f_dot(vec3f_t a, vec3f_t b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline vec3f_t vec3f_cross(vec3f_t a, vec3f_t b)
+{
+    return vec3f_create(a.y * b.z - a.z * b.y,
+                        a.z * b.x - a.x * b.z,
+                        a.x * b.y - a.y * b.x);
+}
+
+static inline float vec3f_length(vec3f_t v)
+{
+    return sqrtf(vec3f_dot(v, v));
+}
+
+// accurate normalize, a zero vector is returned as it is
+static inline vec3f_t vec3f_normalize(vec3f_t v)
+{
+    float len = vec3f_length(v);
+    if (len == 0.0f)
+        return v;
+    return vec3f_scale(v, 1.0f / len);
+}
+
+// Quake III inverse square root, the same result as vec3_normalize_fast
+static inline vec3f_t vec3f_normalize_fast(vec3f_t v)
+{
+    float len_sq = vec3f_dot(v, v);
+    if (len_sq == 0.0f)
+        return v;
+
+    float half_len = 0.5f * len_sq;
+    int32_t i;
+    memcpy(&i, &len_sq, sizeof(i));
+    i = 0x5f3759df - (i >> 1);
+    float y;
+    memcpy(&y, &i, sizeof(y));
+    y = y * (1.5f - (half_len * y * y));
+
+    return vec3f_scale(v, y);
+}
+
+// m * (x, y, z, 1), divided by w like mat4_transform_vec3
+static inline vec3f_t mat4_transform_point(const mat4_t *m, vec3f_t v)
+{
+    float x = m->m[0][0] * v.x + m->m[0][1] * v.y + m->m[0][2] * v.z + m->m[0][3];
+    float y = m->m[1][0] * v.x + m->m[1][1] * v.y + m->m[1][2] * v.z + m->m[1][3];
+    float z = m->m[2][0] * v.x + m->m[2][1] * v.y + m->m[2][2] * v.z + m->m[2][3];
+    float w = m->m[3][0] * v.x + m->m[3][1] * v.y + m->m[3][2] * v.z + m->m[3][3];
+
+    if (fabsf(w) > 0.0001f)
+    {
+        x /= w;
+        y /= w;
+        z /= w;
+    }
+    return vec3f_create(x, y, z);
+}
+
+// out = m * v (v and out can be the same)
+static inline void mat4_transform_vec4_to(vec4_t *out, const mat4_t *m, const vec4_t *v)
+{
+    vec4_t result;
+    result.x = m->m[0][0] * v->x + m->m[0][1] * v->y + m->m[0][2] * v->z + m->m[0][3] * v->w;
+    result.y = m->m[1][0] * v->x + m->m[1][1] * v->y + m->m[1][2] * v->z + m->m[1][3] * v->w;
+    result.z = m->m[2][0] * v->x + m->m[2][1] * v->y + m->m[2][2] * v->z + m->m[2][3] * v->w;
+    result.w = m->m[3][0] * v->x + m->m[3][1] * v->y + m->m[3][2] * v->z + m->m[3][3] * v->w;
+    *out = result;
+}
+
+// only the 3x3 part of m, for directions
+static inline vec3f_t mat4_transform_dir(const mat4_t *m, vec3f_t v)
+{
+    return vec3f_create(m->m[0][0] * v.x + m->m[0][1] * v.y + m->m[0][2] * v.z,
+                        m->m[1][0] * v.x + m->m[1][1] * v.y + m->m[1][2] * v.z,
+                        m->m[2][0] * v.x + m->m[2][1] * v.y + m->m[2][2] * v.z);
+}
+
 #endif // MATH3D_H
\ No newline at end of file
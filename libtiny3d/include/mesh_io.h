@@ -0,0 +1,79 @@
+#ifndef MESH_IO_H
+#define MESH_IO_H
+
+#include "renderer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// .t3d is a binary mesh file whose blocks are used in place from a memory mapped file:
+// the header, then the vertices (vec3f_t) and the edges (int[2]) at T3D_ALIGNMENT aligned offsets,
+// all little endian
+#define T3D_MAGIC "T3DM"
+#define T3D_VERSION 1
+#define T3D_ALIGNMENT 64
+
+// header flags
+#define T3D_FLAG_BOUNDS 1u  // the bounds fields are set
+#define T3D_FLAG_INDEX16 2u // the edge block is uint16_t[2] (loaded into edges16) instead of int[2]
+
+// the first bytes of a .t3d file
+typedef struct
+{
+    char magic[4];          // T3D_MAGIC
+    uint32_t version;       // T3D_VERSION
+    uint32_t header_size;   // sizeof(t3d_header_t)
+    uint32_t flags;         // T3D_FLAG_*
+    uint32_t vertex_count;  //
+    uint32_t edge_count;    //
+    uint64_t vertex_offset; // byte offset of the vertex block from the start of the file
+    uint64_t edge_offset;   // byte offset of the edge block
+    uint64_t file_size;     // size of the whole file
+    float bounds_min[3];    // object3d_t bounds, valid with T3D_FLAG_BOUNDS
+    float bounds_max[3];    //
+    float bounds_center[3]; //
+    float bounds_radius;    //
+    uint32_t reserved[10];  // zero, pads the header to 128 bytes
+} t3d_header_t;
+
+// what a mesh load did, for throughput reports
+typedef struct
+{
+    size_t file_bytes;   // size of the file
+    int vertex_count;    // vertices of the object
+    int face_count;      // faces (and OBJ polylines) that were read
+    int edge_count;      // unique edges of the object
+    int duplicate_edges; // face edges dropped because another face already had them
+    int threads;         // threads used to parse the file
+    double seconds;      // wall time of the whole load
+} mesh_load_stats_t;
+
+// Megabytes of file read per second
+static inline double mesh_load_mb_per_second(const mesh_load_stats_t *stats)
+{
+    return stats->seconds > 0.0 ? (double)stats->file_bytes / (1024.0 * 1024.0) / stats->seconds : 0.0;
+}
+
+// Load a Wavefront OBJ file: the v lines are the vertices and the f and l lines become edges,
+// the edge shared by two faces is only kept once (the first time it appears)
+// the file is memory mapped and parsed in chunks on num_threads threads (0 = one per core), the edges of a chunk
+// are deduplicated on its thread and merged into the object, so only a few chunks are in memory at once
+// stats can be NULL, returns NULL if the file could not be read or is not valid
+object3d_t *mesh_load_obj(const char *filename, int num_threads, mesh_load_stats_t *stats);
+
+// Load a binary (little or big endian) PLY file: x, y and z of the vertex element and the
+// vertex_indices (or vertex_index) list of the face element, with the same edge deduplication as the OBJ loader
+// (the faces are read in blocks on num_threads threads after one walk that finds where the blocks start)
+object3d_t *mesh_load_ply(const char *filename, int num_threads, mesh_load_stats_t *stats);
+
+// Write obj as a .t3d file (with 16 bit edges if obj has edges16), returns 0 on success and -1 on failure
+int mesh_save_t3d(const object3d_t *obj, const char *filename);
+
+// Map a .t3d file, the vertices and edges of the object point into the mapped pages (nothing is copied or parsed)
+// the pages are copy on write so changing the object never changes the file, object3d_destroy unmaps it
+// the header and block sizes are always checked, with verify the edge indices are checked too (this reads every edge)
+object3d_t *mesh_load_t3d(const char *filename, int verify, mesh_load_stats_t *stats);
+
+// Load an .obj, .ply or .t3d file, the format is chosen from the extension (.t3d files are loaded with verify)
+object3d_t *mesh_load(const char *filename, int num_threads, mesh_load_stats_t *stats);
+
+#endif // MESH_IO_H
@@ -0,0 +1,22 @@
+#ifndef MESH_OPT_H
+#define MESH_OPT_H
+
+#include "renderer.h"
+
+// Renumber the vertices of obj in Morton (Z curve) order of their positions and sort the edges by their
+// lower vertex, so the vertex stage and the edge loops walk memory mostly forward instead of jumping around
+// the direction of every edge is kept (the lighting depends on it), the bounds are computed if they are missing
+// returns 0 on success and -1 if the scratch memory could not be allocated
+int mesh_optimize_locality(object3d_t *obj);
+
+// Build obj->edges16, the 16 bit copy of the edges, returns -1 if obj has more than 65536 vertices
+// with drop_wide the int edges are freed (or just forgotten if a mapped file owns them) and only edges16 is kept
+int mesh_build_index16(object3d_t *obj, int drop_wide);
+
+// Simplify obj by vertex clustering: the bounding box is cut into grid^3 cells (grid <= 2^21), the vertices of a cell
+// become one vertex at their average and the edges are renumbered, edges inside one cell and repeated edges are
+// dropped (the first one keeps its direction)
+// returns a new object (free it with object3d_destroy) or NULL if the memory could not be allocated
+object3d_t *mesh_simplify_clusters(const object3d_t *obj, int grid);
+
+#endif // MESH_OPT_H
@@ -0,0 +1,22 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// a task run by parallel_for, index goes from 0 to count - 1
+typedef void (*parallel_task_fn)(int index, void *user);
+
+// Number of threads used when a caller asks for 0 threads (the number of online cores)
+int parallel_thread_count(void);
+
+// most worker threads parallel_for keeps (a call asking for more threads uses this many)
+#define PARALLEL_POOL_MAX 64
+
+// Run task for every index in [0, count) on num_threads threads (0 = one per core)
+// the calling thread is one of the workers and the call returns when all the tasks are done
+// the other workers come from a pool of threads that are started on first use and kept,
+// while one call uses the pool a call from another thread (or from a task) runs its tasks on its own thread
+void parallel_for(int count, int num_threads, parallel_task_fn task, void *user);
+
+// Wall clock time in seconds from a monotonic clock, for timing work (only differences are meaningful)
+double parallel_time_seconds(void);
+
+#endif // PARALLEL_H
@@ -0,0 +1,18 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "canvas.h"
+
+// tile size that works well for large frames (64 x 64 floats = 16 KB, fits in L1/L2)
+#define RASTER_DEFAULT_TILE_SIZE 64
+
+// Turn on tiled rasterization for canvas_draw_lines, tile_size 0 turns it off
+// num_threads is the number of threads for the tiles (0 = one per core)
+void canvas_set_tiling(canvas_t *canvas, int tile_size, int num_threads);
+
+// Draw the lines in array order
+// with tiling on, the lines are binned into screen tiles and the tiles are drawn in parallel,
+// every tile draws its lines in array order so the blending is the same as drawing them one by one
+void canvas_draw_lines(canvas_t *canvas, const line_t *lines, int count);
+
+#endif // RASTER_H
@@ -8,12 +8,89 @@
 // Represents a 3D object with vertices and edges
 typedef struct
 {
-    vec3_t *vertices;
+    vec3f_t *vertices;
     int (*edges)[2];
+    uint16_t (*edges16)[2]; // optional 16 bit copy of edges (vertex_count <= 65536), used instead of edges when set
+                            // edges can be NULL when an object only has these (see mesh_build_index16)
     int vertex_count;
     int edge_count;
+
+    // bounding volumes in object space, set by object3d_compute_bounds
+    int has_bounds;       // 0 means the object is never culled
+    vec3f_t bounds_min;   // axis aligned box
+    vec3f_t bounds_max;   //
+    vec3f_t bounds_center; // bounding sphere
+    float bounds_radius;  //
+
+    // set when vertices and edges point into memory owned by something else (a mapped file),
+    // object3d_destroy then calls release(owner) instead of freeing the arrays
+    void *owner;
+    void (*release)(void *owner);
+    int edges16_owned; // edges16 was allocated on the heap, object3d_destroy frees it even with a release
+
 } object3d_t;
 
+// Allocates an object with room for vertex_count vertices and edge_count edges (not initialized)
+// returns NULL if the memory could not be allocated
+object3d_t *object3d_create(int vertex_count, int edge_count);
+
+// Frees an object from object3d_create, generate_soccer_ball or the mesh loaders (or releases its owner)
+void object3d_destroy(object3d_t *obj);
+
+// Computes the bounding box and sphere of the object's vertices
+void object3d_compute_bounds(object3d_t *obj);
+
+// Returns 0 if the bounding sphere of obj is completely outside the frustum of mvp (projection * view * model)
+// between the depths z_near and z_far, objects without bounds always return 1
+// the camera looks along +z like mat4_look_at, so clip w is minus the depth and negative in front of the camera
+int object3d_in_frustum(const object3d_t *obj, mat4_t mvp, float z_near, float z_far);
+
+// The vertices of an object after the vertex stage, the arrays are reused between runs
+typedef struct
+{
+    vec3f_t *world;  // local_to_world * vertex
+    vec3f_t *camera; // world_to_camera * world
+    vec3f_t *screen; // screen x and y in pixels, z is the NDC depth (same as project_vertex)
+    vec4_t *clip;    // homogeneous clip space position (before the divide by w)
+    int count;      // number of vertices in the arrays
+    int capacity;   // allocated size of the arrays
+    float *soa;       // scratch x, y and z arrays of the object in vertex_stage_append_instances
+    int soa_capacity; // allocated floats of soa
+} vertex_stage_t;
+
+// Start with empty arrays
+void vertex_stage_init(vertex_stage_t *stage);
+
+// Free the arrays
+void vertex_stage_free(vertex_stage_t *stage);
+
+// Transforms all the vertices of obj into world, camera and screen space in one pass
+// the MVP matrix is built once for the whole object, returns 0 on success and -1 if the arrays could not be allocated
+int vertex_stage_run(vertex_stage_t *stage, const object3d_t *obj,
+                     mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection,
+                     int canvas_width, int canvas_height);
+
+// Same as vertex_stage_run but the vertices are added after the ones already in the stage
+// (the first vertex of obj ends up at the old stage->count)
+int vertex_stage_append(vertex_stage_t *stage, const object3d_t *obj,
+                        mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection,
+                        int canvas_width, int canvas_height);
+
+// Appends instance_count copies of obj, one per local_to_world matrix, to the stage
+// the object's vertices are read once into SIMD friendly arrays and transformed 4 at a time for every instance,
+// the results are the same as calling vertex_stage_append for every instance
+int vertex_stage_append_instances(vertex_stage_t *stage, const object3d_t *obj,
+                                  const mat4_t *local_to_world, int instance_count,
+                                  mat4_t world_to_camera, mat4_t projection,
+                                  int canvas_width, int canvas_height);
+
+// Clips a segment with camera space depths z0 and z1 against the near plane z >= z_near
+// returns 0 if all of it is in front of the plane, otherwise the visible part is from t0 to t1 (0 <= t0 <= t1 <= 1)
+int clip_segment_near(float z0, float z1, float z_near, float *t0, float *t1);
+
+// Divides a clip space position by w and maps it to the screen like the vertex stage
+vec3f_t clip_to_screen(vec4_t clip, int canvas_width, int canvas_height);
+
 // Projects a 3D vertex to 2D screen coordinates
 vec3_t project_vertex(vec3_t vertex, mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection, int canvas_width, int canvas_height);
 
@@ -26,6 +103,14 @@ void wireframe(canvas_t *canvas, object3d_t *obj,
                light_t *lights, int num_lights,
                float z_near, float z_far);
 
+// Renders instance_count copies of one object, instance i uses local_to_world[i] and its lighting is
+// multiplied by intensities[i] (NULL means 1), all the edges are sorted together
+void wireframe_instanced(canvas_t *canvas, const object3d_t *obj,
+                         const mat4_t *local_to_world, const float *intensities, int instance_count,
+                         mat4_t world_to_camera, mat4_t projection,
+                         const light_t *lights, int num_lights,
+                         float z_near, float z_far);
+
 // Generates a 3D soccer ball object (truncated icosahedron)
 object3d_t *generate_soccer_ball();
 object3d_t *generate_letter_P();
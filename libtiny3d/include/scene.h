@@ -0,0 +1,100 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "renderer.h"
+#include "depth_sort.h"
+#include "viewport.h"
+#include "lod.h"
+
+// one object submitted to a scene
+typedef struct
+{
+    const object3d_t *obj;
+    mat4_t local_to_world;
+    float intensity; // multiplies the lighting of the object's edges
+    const object3d_lod_t *lod; // when set obj is picked from this chain by scene_render every frame
+} scene_item_t;
+
+// lighting of the edges of one item, kept between frames
+// the edge directions only depend on the linear part of local_to_world, so a moved object keeps its lighting
+typedef struct
+{
+    const object3d_t *obj; // mesh the intensities belong to (NULL if the entry is empty)
+    float linear[3][3];    // upper 3x3 of local_to_world
+    unsigned light_version; // version of the light set
+    float *edge_light;     // intensity of every edge of obj
+    int capacity;          // allocated size of edge_light
+} scene_light_cache_t;
+
+// A batch of objects that share one camera, projection and light set.
+// All the objects are projected in one pass and their edges are sorted and drawn as one list,
+// so the edges of different objects are in the right order. The buffers are kept between frames.
+typedef struct
+{
+    // set by scene_begin
+    mat4_t world_to_camera;
+    mat4_t projection;
+    light_set_t lights;     // copy of the lights with the directions normalized
+    float z_near;
+    float z_far;
+
+    // the objects of the frame
+    scene_item_t *items;
+    int item_count;
+    int item_capacity;
+
+    // buffers reused by scene_render
+    vertex_stage_t stage;   // vertices of all the objects
+    int *visible;           // indices of the items that passed the frustum test
+    int visible_count;      //
+    int *vertex_base;       // first vertex of every visible item in the stage
+    int (*edges)[2];        // edges of all the objects with stage vertex indices
+    float *edge_depths;     // normalized log depth of every edge
+    float *edge_light;      // lit intensity of every edge, times the item intensity
+    line_t *lines;          // lines to draw
+    int edge_capacity;      // allocated size of edges, edge_depths, edge_light and lines
+    int base_capacity;      // allocated size of visible and vertex_base
+    vec3f_t *edge_dirs;     // world space directions of the edges of one item for the lighting
+    int dir_capacity;       // allocated size of edge_dirs
+    scene_light_cache_t *light_cache; // lighting of item i of the last frames
+    int cache_capacity;     // allocated size of light_cache
+    unsigned char *vertex_inside; // 1 for the stage vertices inside the circular viewport
+    int inside_capacity;    // allocated size of vertex_inside
+    mat4_t *transforms;     // transforms of a run of instances for vertex_stage_append_instances
+    int transform_capacity; //
+    depth_sorter_t sorter;
+} scene_t;
+
+// Start an empty scene
+void scene_init(scene_t *scene);
+
+// Free the buffers of the scene
+void scene_free(scene_t *scene);
+
+// Start a new frame: remove the objects and set the camera, projection and lights
+// the lights are copied, the lighting of an item is reused if the item with the same index in the last frame
+// had the same mesh and rotation/scale and the lights did not change
+void scene_begin(scene_t *scene, mat4_t world_to_camera, mat4_t projection,
+                 const light_t *lights, int num_lights, float z_near, float z_far);
+
+// Add an object with its transform, the object is not copied
+// returns 0 on success and -1 if the item list could not grow
+int scene_add(scene_t *scene, const object3d_t *obj, mat4_t local_to_world);
+
+// Add an object with a level of detail chain, scene_render draws the level that fits its size on the canvas
+// returns 0 on success and -1 if the item list could not grow
+int scene_add_lod(scene_t *scene, const object3d_lod_t *lod, mat4_t local_to_world);
+
+// Add count instances of one mesh, transforms[i] is the local_to_world of instance i and
+// intensities[i] multiplies its lighting (NULL means 1 for all), the arrays are copied
+// consecutive items with the same mesh are transformed together with SIMD and the mesh is only read once
+// returns 0 on success and -1 if the item list could not grow
+int scene_add_instances(scene_t *scene, const object3d_t *obj,
+                        const mat4_t *transforms, const float *intensities, int count);
+
+// Project all the objects, sort all their edges back to front (unless the canvas has a depth plane) and draw them
+// objects with bounds that are outside the view frustum are skipped and edges are clipped at the near plane
+// and trimmed to the circular viewport
+void scene_render(scene_t *scene, canvas_t *canvas);
+
+#endif // SCENE_H
@@ -0,0 +1,31 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include "canvas.h"
+
+// Renders one frame into canvas, t is (frame - first_frame) / frame_count so it goes from 0 to 1
+// the canvas still holds an older frame so the callback has to clear it first
+// it is called from worker threads at the same time for different frames
+typedef void (*frame_render_fn)(canvas_t *canvas, int frame, float t, void *user);
+
+// Receives the finished frames in order on the calling thread, return non zero to stop the sequence
+typedef int (*frame_output_fn)(const canvas_t *canvas, int frame, void *user);
+
+// describes a range of frames to render
+typedef struct
+{
+    int width;            // size of the canvases
+    int height;           //
+    int first_frame;      // index of the first frame
+    int frame_count;      // number of frames to render
+    int num_threads;      // number of render threads (0 = one per core)
+    frame_render_fn render;
+    frame_output_fn output; // can be NULL
+    void *user;           // passed to both callbacks
+} sequence_desc_t;
+
+// Renders the frames concurrently, each thread into its own canvas, and hands them to output in frame order
+// returns the number of frames that were output or -1 if the setup failed
+int render_sequence(const sequence_desc_t *desc);
+
+#endif // SEQUENCE_H
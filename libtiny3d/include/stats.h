@@ -0,0 +1,78 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Render pipeline instrumentation, compiled in with -DTINY3D_STATS (add it to CFLAGS for the library and the program)
+// without it the STATS_* macros are empty, nothing is timed or counted and render_stats_get returns zeros
+
+// timed stages of the pipeline
+typedef enum
+{
+    RENDER_STAGE_SCENE,   // a whole scene_render (contains the stages below except output)
+    RENDER_STAGE_CULL,    // frustum culling and level of detail selection
+    RENDER_STAGE_PROJECT, // vertex stage
+    RENDER_STAGE_LIGHT,   // edge list and lighting
+    RENDER_STAGE_DEPTH,   // viewport classification and edge depths
+    RENDER_STAGE_SORT,    // depth sort
+    RENDER_STAGE_CLIP,    // near plane and viewport clipping into lines
+    RENDER_STAGE_RASTER,  // canvas_draw_lines
+    RENDER_STAGE_OUTPUT,  // PGM encoding and writing
+    RENDER_STAGE_COUNT
+} render_stage_t;
+
+// counters
+typedef enum
+{
+    RENDER_COUNTER_VERTICES,      // vertices through the vertex stage
+    RENDER_COUNTER_EDGES_CULLED,  // edges of culled objects and edges clipped away completely
+    RENDER_COUNTER_EDGES_DRAWN,   // lines sent to the rasterizer
+    RENDER_COUNTER_PIXELS,        // brush splats of draw_line_f and pixels written by the coverage lines
+    RENDER_COUNTER_BYTES_WRITTEN, // bytes of PGM images encoded or written
+    RENDER_COUNTER_COUNT
+} render_counter_t;
+
+// totals since the last render_stats_reset, from all threads
+typedef struct
+{
+    double seconds[RENDER_STAGE_COUNT]; // time spent in every stage
+    long long calls[RENDER_STAGE_COUNT]; // times every stage ran
+    long long counters[RENDER_COUNTER_COUNT];
+} render_stats_t;
+
+// Returns 1 if the library was built with TINY3D_STATS
+int render_stats_enabled(void);
+
+// Copy the totals into stats
+void render_stats_get(render_stats_t *stats);
+
+// Set the totals to zero and drop the recorded trace events
+void render_stats_reset(void);
+
+// Start (1) or stop (0) recording one trace event per stage run, at most 1M events are kept
+void render_stats_trace(int enable);
+
+// Write the recorded events as Chrome trace event JSON (chrome://tracing or Perfetto) with the counters at the end
+// returns 0 on success and -1 if the file could not be written or the stats are compiled out
+int render_stats_write_trace(const char *filename);
+
+// Names of the stages and counters for reports
+const char *render_stats_stage_name(int stage);
+const char *render_stats_counter_name(int counter);
+
+// used by the macros
+double render_stats_now(void);
+void render_stats_record(int stage, double start);
+void render_stats_add(int counter, long long count);
+
+#ifdef TINY3D_STATS
+#define STATS_BEGIN(stage) double stats_start_##stage = render_stats_now()
+#define STATS_END(stage) render_stats_record(stage, stats_start_##stage)
+#define STATS_ADD(counter, count) render_stats_add(counter, count)
+#define STATS_ONLY(code) code
+#else
+#define STATS_BEGIN(stage) ((void)0)
+#define STATS_END(stage) ((void)0)
+#define STATS_ADD(counter, count) ((void)0)
+#define STATS_ONLY(code)
+#endif
+
+#endif // STATS_H
@@ -0,0 +1,53 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "canvas.h"
+#include <stddef.h>
+
+// A sequence of frames written to one file descriptor (a file, a pipe or stdout) instead of one file per frame,
+// so the frames can go straight into an encoder, e.g.
+//   animation_demo.exe -o - | ffmpeg -i - out.mp4
+typedef enum
+{
+    FRAME_STREAM_Y4M, // YUV4MPEG2, 8 bit 4:2:0 with gray chroma and full range luma
+    FRAME_STREAM_PGM, // binary PGM (P5) images one after the other, 8 or 16 bit
+} frame_stream_format_t;
+
+typedef struct
+{
+    int fd;
+    int owns_fd; // close fd in frame_stream_close
+    frame_stream_format_t format;
+    int width;
+    int height;
+    int bit_depth;
+    unsigned char *frame;    // the encoded frame, allocated once and rewritten for every frame
+    size_t frame_size;       // bytes of one frame with its header
+    size_t pixel_offset;     // where the pixels start in frame
+    int frame_count;         // frames written so far
+    unsigned long long bytes_written;
+    int failed;              // a write failed, nothing more is written
+} frame_stream_t;
+
+// Start a stream of width x height frames on fd, the y4m header is written now
+// (on Windows fd has to be in binary mode, frame_stream_open does that for the files it opens and for stdout)
+// y4m streams are 8 bit and play at fps_num / fps_den frames per second, PGM streams are 8 or 16 bit and ignore the rate
+// returns 0 on success and -1 if the arguments are not valid, the buffer could not be allocated or the header write failed
+int frame_stream_open_fd(frame_stream_t *stream, int fd, frame_stream_format_t format,
+                         int width, int height, int bit_depth, int fps_num, int fps_den);
+
+// frame_stream_open_fd on a file that is created (or truncated), "-" is stdout
+int frame_stream_open(frame_stream_t *stream, const char *filename, frame_stream_format_t format,
+                      int width, int height, int bit_depth, int fps_num, int fps_den);
+
+// Append the canvas as the next frame, it must have the size of the stream
+// returns 0 on success and -1 on failure (and every later call fails too)
+int frame_stream_write(frame_stream_t *stream, const canvas_t *canvas);
+
+// frame_stream_write with the frame_output_fn signature of render_sequence, user is the stream
+int frame_stream_output(const canvas_t *canvas, int frame, void *user);
+
+// Free the buffer and close the file if the stream opened it, returns -1 if a write or the close failed
+int frame_stream_close(frame_stream_t *stream);
+
+#endif // STREAM_H
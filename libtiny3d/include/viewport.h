@@ -0,0 +1,39 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include "canvas.h"
+#include "math3d.h"
+
+// the circular drawing area of a canvas (the area clip_to_circular_viewport tests)
+typedef struct
+{
+    float cx, cy;    // center in pixels
+    float radius;    //
+    float radius_sq; // radius * radius, all the inside tests use squared distances
+} viewport_circle_t;
+
+// Get the largest circle centered on the canvas that fits in it
+viewport_circle_t viewport_circle_for_canvas(const canvas_t *canvas);
+
+// Returns 1 if (x, y) is inside the circle or on its border
+static inline int viewport_circle_contains(const viewport_circle_t *circle, float x, float y)
+{
+    float dx = x - circle->cx;
+    float dy = y - circle->cy;
+    return dx * dx + dy * dy <= circle->radius_sq;
+}
+
+// Classify count screen points at once, inside[i] is 1 if points[i] (x and y) is in the circle and 0 if not
+void viewport_classify_circle(const viewport_circle_t *circle, const vec3f_t *points, int count, unsigned char *inside);
+
+// Clip the segment (x0, y0) -> (x1, y1) against the circle
+// returns 0 if no part of it is inside, otherwise the inside part is from t0 to t1 (0 <= t0 <= t1 <= 1)
+// a segment with both ends inside is accepted without a square root
+int clip_segment_circle(const viewport_circle_t *circle, float x0, float y0, float x1, float y1, float *t0, float *t1);
+
+// Clip the segment (x0, y0) -> (x1, y1) against the rectangle x_min <= x <= x_max, y_min <= y <= y_max
+// returns 0 if no part of it is inside, otherwise the inside part is from t0 to t1 (0 <= t0 <= t1 <= 1)
+int clip_segment_rect(float x_min, float y_min, float x_max, float y_max,
+                      float x0, float y0, float x1, float y1, float *t0, float *t1);
+
+#endif // VIEWPORT_H
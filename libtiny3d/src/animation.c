@@ -1,5 +1,7 @@
 #include "animation.h"
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 /**
  * @brief Calculates a point on a 3D cubic Bezier curve.
@@ -29,4 +31,307 @@ vec3_t vec3_bezier(vec3_t p0, vec3_t p1, vec3_t p2, vec3_t p3, float t)
     position = vec3_add(position, term3);
 
     return position;
-}
\ No newline at end of file
+}
+
+// Start an empty timeline
+void timeline_init(timeline_t *timeline)
+{
+    memset(timeline, 0, sizeof(*timeline));
+}
+
+// Free the arrays
+void timeline_free(timeline_t *timeline)
+{
+    if (!timeline)
+        return;
+    free(timeline->start);
+    free(timeline->inv_duration);
+    free(timeline->scale);
+    free(timeline->ease);
+    free(timeline->flags);
+    free(timeline->segment_first);
+    free(timeline->segment_count);
+    free(timeline->key_first);
+    free(timeline->key_count);
+    free(timeline->arc);
+    for (int k = 0; k < 4; k++)
+    {
+        free(timeline->px[k]);
+        free(timeline->py[k]);
+        free(timeline->pz[k]);
+    }
+    free(timeline->keys);
+    free(timeline->u);
+    free(timeline->positions);
+    free(timeline->rot_a);
+    free(timeline->rot_b);
+    free(timeline->rot_t);
+    free(timeline->rotations);
+    timeline_init(timeline);
+}
+
+// grow one array to capacity elements of size bytes, returns 0 on success
+static int grow(void **array, int capacity, size_t size)
+{
+    void *grown = realloc(*array, (size_t)capacity * size);
+    if (!grown)
+        return -1;
+    *array = grown;
+    return 0;
+}
+
+// the next capacity for count elements, or 0 if the arrays are big enough
+static int next_capacity(int capacity, int count)
+{
+    if (count <= capacity)
+        return 0;
+    int grown = capacity < 16 ? 16 : capacity + capacity / 2;
+    return grown < count ? count : grown;
+}
+
+// make room for more tracks, segments and keys
+static int timeline_reserve(timeline_t *timeline, int tracks, int segments, int keys)
+{
+    int capacity = next_capacity(timeline->track_capacity, timeline->track_count + tracks);
+    if (capacity)
+    {
+        if (grow((void **)&timeline->start, capacity, sizeof(float)) || grow((void **)&timeline->inv_duration, capacity, sizeof(float)) ||
+            grow((void **)&timeline->scale, capacity, sizeof(float)) || grow((void **)&timeline->ease, capacity, 1) ||
+            grow((void **)&timeline->flags, capacity, 1) || grow((void **)&timeline->segment_first, capacity, sizeof(int)) ||
+            grow((void **)&timeline->segment_count, capacity, sizeof(int)) || grow((void **)&timeline->key_first, capacity, sizeof(int)) ||
+            grow((void **)&timeline->key_count, capacity, sizeof(int)) ||
+            grow((void **)&timeline->arc, capacity, TIMELINE_ARC_TABLE_SIZE * sizeof(float)))
+            return -1;
+        timeline->track_capacity = capacity;
+    }
+
+    capacity = next_capacity(timeline->segment_capacity, timeline->segment_total + segments);
+    if (capacity)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            if (grow((void **)&timeline->px[k], capacity, sizeof(float)) || grow((void **)&timeline->py[k], capacity, sizeof(float)) ||
+                grow((void **)&timeline->pz[k], capacity, sizeof(float)))
+                return -1;
+        }
+        timeline->segment_capacity = capacity;
+    }
+
+    capacity = next_capacity(timeline->key_capacity, timeline->key_total + keys);
+    if (capacity)
+    {
+        if (grow((void **)&timeline->keys, capacity, sizeof(quat_t)))
+            return -1;
+        timeline->key_capacity = capacity;
+    }
+    return 0;
+}
+
+// point of segment s at t
+static inline vec3f_t segment_point(const timeline_t *timeline, int s, float t)
+{
+    float mt = 1.0f - t;
+    float w0 = mt * mt * mt, w1 = 3.0f * mt * mt * t, w2 = 3.0f * mt * t * t, w3 = t * t * t;
+    return vec3f_create(w0 * timeline->px[0][s] + w1 * timeline->px[1][s] + w2 * timeline->px[2][s] + w3 * timeline->px[3][s],
+                        w0 * timeline->py[0][s] + w1 * timeline->py[1][s] + w2 * timeline->py[2][s] + w3 * timeline->py[3][s],
+                        w0 * timeline->pz[0][s] + w1 * timeline->pz[1][s] + w2 * timeline->pz[2][s] + w3 * timeline->pz[3][s]);
+}
+
+// table of the chain parameter at evenly spaced arc lengths, from a polyline through the curve
+static void build_arc_table(const timeline_t *timeline, int first, int count, float *table)
+{
+    enum { STEPS = 32 }; // polyline points per segment
+    int samples = count * STEPS;
+    float length = 0.0f;
+    vec3f_t last = segment_point(timeline, first, 0.0f);
+    table[0] = 0.0f;
+
+    // walk the polyline and write the parameter every time the next arc length fraction is passed
+    // (two passes: the first one only measures the total length)
+    for (int pass = 0; pass < 2; pass++)
+    {
+        float total = length;
+        int next = 1;
+        length = 0.0f;
+        last = segment_point(timeline, first, 0.0f);
+        for (int i = 1; i <= samples; i++)
+        {
+            int s = (i - 1) / STEPS;
+            vec3f_t p = segment_point(timeline, first + s, (float)(i - s * STEPS) / STEPS);
+            float step = vec3f_length(vec3f_sub(p, last));
+            if (pass == 1)
+            {
+                while (next < TIMELINE_ARC_TABLE_SIZE && length + step >= total * next / (TIMELINE_ARC_TABLE_SIZE - 1))
+                {
+                    float target = total * next / (TIMELINE_ARC_TABLE_SIZE - 1);
+                    float f = step > 0.0f ? (target - length) / step : 0.0f;
+                    table[next++] = ((float)(i - 1) + f) / samples;
+                }
+            }
+            length += step;
+            last = p;
+        }
+        // the last entries when rounding left them out (and a curve with no length)
+        if (pass == 1)
+        {
+            for (; next < TIMELINE_ARC_TABLE_SIZE; next++)
+                table[next] = total > 0.0f ? 1.0f : (float)next / (TIMELINE_ARC_TABLE_SIZE - 1);
+        }
+    }
+}
+
+// Add a track
+int timeline_add_track(timeline_t *timeline, const vec3f_t *points, int segment_count,
+                       const quat_t *keys, int key_count,
+                       float start, float duration, ease_t ease, unsigned flags, float scale)
+{
+    if (!timeline || !points || segment_count < 1 || key_count < 0 || (key_count > 0 && !keys) || !(duration > 0.0f) ||
+        ease < EASE_LINEAR || ease > EASE_PING_PONG)
+        return -1;
+    if (timeline_reserve(timeline, 1, segment_count, key_count) != 0)
+        return -1;
+
+    int track = timeline->track_count++;
+    timeline->start[track] = start;
+    timeline->inv_duration[track] = 1.0f / duration;
+    timeline->scale[track] = scale;
+    timeline->ease[track] = (unsigned char)ease;
+    timeline->flags[track] = (unsigned char)flags;
+    timeline->segment_first[track] = timeline->segment_total;
+    timeline->segment_count[track] = segment_count;
+    timeline->key_first[track] = timeline->key_total;
+    timeline->key_count[track] = key_count;
+
+    for (int i = 0; i < segment_count; i++)
+    {
+        int s = timeline->segment_total++;
+        for (int k = 0; k < 4; k++)
+        {
+            vec3f_t p = points[i * 3 + k];
+            timeline->px[k][s] = p.x;
+            timeline->py[k][s] = p.y;
+            timeline->pz[k][s] = p.z;
+        }
+    }
+    for (int i = 0; i < key_count; i++)
+        timeline->keys[timeline->key_total++] = quat_normalize(keys[i]);
+
+    float *table = timeline->arc + (size_t)track * TIMELINE_ARC_TABLE_SIZE;
+    if (flags & TIMELINE_ARC_LENGTH)
+        build_arc_table(timeline, timeline->segment_first[track], segment_count, table);
+    return track;
+}
+
+// make room for the per track results
+static int timeline_reserve_work(timeline_t *timeline)
+{
+    int capacity = timeline->track_capacity;
+    if (capacity <= timeline->work_capacity)
+        return 0;
+    if (grow((void **)&timeline->u, capacity, sizeof(float)) || grow((void **)&timeline->positions, capacity, sizeof(vec3f_t)) ||
+        grow((void **)&timeline->rot_a, capacity, sizeof(quat_t)) || grow((void **)&timeline->rot_b, capacity, sizeof(quat_t)) ||
+        grow((void **)&timeline->rot_t, capacity, sizeof(float)) || grow((void **)&timeline->rotations, capacity, sizeof(quat_t)))
+        return -1;
+    timeline->work_capacity = capacity;
+    return 0;
+}
+
+// Evaluate every track
+int timeline_evaluate(timeline_t *timeline, float time, mat4_t *local_to_world)
+{
+    if (!timeline || (timeline->track_count > 0 && !local_to_world))
+        return -1;
+    if (timeline_reserve_work(timeline) != 0)
+        return -1;
+    int n = timeline->track_count;
+    float *u = timeline->u;
+
+    // the parameter of every track: where the time is in the track, then the ease
+    for (int i = 0; i < n; i++)
+    {
+        float x = (time - timeline->start[i]) * timeline->inv_duration[i];
+        if (timeline->flags[i] & TIMELINE_LOOP)
+            x -= floorf(x);
+        x = fmaxf(0.0f, fminf(1.0f, x));
+        switch (timeline->ease[i])
+        {
+        case EASE_IN:
+            x = x * x;
+            break;
+        case EASE_OUT:
+            x = x * (2.0f - x);
+            break;
+        case EASE_IN_OUT:
+            x = x * x * (3.0f - 2.0f * x);
+            break;
+        case EASE_PING_PONG:
+            x = 0.5f - 0.5f * cosf(x * 6.28318531f);
+            break;
+        default:
+            break;
+        }
+        u[i] = x;
+    }
+
+    // constant speed: look the parameter up in the arc length table
+    for (int i = 0; i < n; i++)
+    {
+        if (!(timeline->flags[i] & TIMELINE_ARC_LENGTH))
+            continue;
+        const float *table = timeline->arc + (size_t)i * TIMELINE_ARC_TABLE_SIZE;
+        float x = u[i] * (TIMELINE_ARC_TABLE_SIZE - 1);
+        int k = (int)x;
+        if (k > TIMELINE_ARC_TABLE_SIZE - 2)
+            k = TIMELINE_ARC_TABLE_SIZE - 2;
+        u[i] = table[k] + (table[k + 1] - table[k]) * (x - k);
+    }
+
+    // positions: the segment of the chain and the Bernstein weights
+    vec3f_t *positions = timeline->positions;
+    for (int i = 0; i < n; i++)
+    {
+        int count = timeline->segment_count[i];
+        float x = u[i] * count;
+        int s = (int)x;
+        if (s > count - 1)
+            s = count - 1;
+        positions[i] = segment_point(timeline, timeline->segment_first[i] + s, x - s);
+    }
+
+    // rotations: the two keys around the parameter, then all the slerps together
+    for (int i = 0; i < n; i++)
+    {
+        int count = timeline->key_count[i];
+        const quat_t *keys = timeline->keys + timeline->key_first[i];
+        if (count < 2)
+        {
+            timeline->rot_a[i] = timeline->rot_b[i] = count ? keys[0] : quat_identity();
+            timeline->rot_t[i] = 0.0f;
+            continue;
+        }
+        float x = u[i] * (count - 1);
+        int k = (int)x;
+        if (k > count - 2)
+            k = count - 2;
+        timeline->rot_a[i] = keys[k];
+        timeline->rot_b[i] = keys[k + 1];
+        timeline->rot_t[i] = x - k;
+    }
+    quat_slerp_array(timeline->rot_a, timeline->rot_b, timeline->rot_t, timeline->rotations, n);
+
+    // the matrices, scaled in place
+    quat_to_mat4_array(timeline->rotations, positions, local_to_world, n);
+    for (int i = 0; i < n; i++)
+    {
+        float s = timeline->scale[i];
+        if (s == 1.0f)
+            continue;
+        for (int r = 0; r < 3; r++)
+        {
+            local_to_world[i].m[r][0] *= s;
+            local_to_world[i].m[r][1] *= s;
+            local_to_world[i].m[r][2] *= s;
+        }
+    }
+    return 0;
+}
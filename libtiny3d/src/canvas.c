@@ -1,7 +1,36 @@
 #include "canvas.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// round the row length up so every row starts on a 64 byte boundary
+#define CANVAS_STRIDE_FLOATS (CANVAS_ALIGNMENT / sizeof(float))
+
+// allocate size bytes aligned to CANVAS_ALIGNMENT, the original pointer is kept just before the block
+static void *canvas_aligned_alloc(size_t size)
+{
+    unsigned char *raw = (unsigned char *)malloc(size + CANVAS_ALIGNMENT + sizeof(void *));
+    if (!raw)
+        return NULL;
+
+    uintptr_t start = (uintptr_t)(raw + sizeof(void *));
+    uintptr_t aligned = (start + CANVAS_ALIGNMENT - 1) & ~(uintptr_t)(CANVAS_ALIGNMENT - 1);
+    ((void **)aligned)[-1] = raw;
+    return (void *)aligned;
+}
+
+// free a block from canvas_aligned_alloc
+static void canvas_aligned_free(void *ptr)
+{
+    if (ptr)
+        free(((void **)ptr)[-1]);
+}
 
 // Create a canvas with given width and height
 canvas_t *canvas_create(int width, int height)
@@ -18,33 +47,35 @@ canvas_t *canvas_create(int width, int height)
     // assgin width and height to the canvas object  values
     canvas->width = width;
     canvas->height = height;
+    canvas->depth = NULL;
+    canvas->depth_owner = NULL;
+    canvas->depth_line = 0;
+    canvas->line_mode = LINE_MODE_BRUSH;
+    canvas->tile_size = 0;
+    canvas->raster_threads = 0;
+    canvas->stride = (int)((width + CANVAS_STRIDE_FLOATS - 1) / CANVAS_STRIDE_FLOATS * CANVAS_STRIDE_FLOATS);
 
-    // create arrays of float values
+    // one block for all the rows
+    size_t count = (size_t)canvas->stride * height;
+    canvas->data = (float *)canvas_aligned_alloc(count * sizeof(float));
+    // row pointers so the old pixels[y][x] access still works
     canvas->pixels = (float **)malloc(height * sizeof(float *));
-    // free the canvas if the array memory allocation was not successful
-    if (!canvas->pixels)
+
+    // free everything if one of the allocations was not successful
+    if (!canvas->data || !canvas->pixels)
     {
+        canvas_aligned_free(canvas->data);
+        free(canvas->pixels);
         free(canvas);
         return NULL;
     }
 
     for (int y = 0; y < height; y++)
     {
-        // assign each array with dynamically allocated values intially 0
-        canvas->pixels[y] = (float *)calloc(width, sizeof(float));
-
-        // if it fails free the height array and the canvas
-        if (!canvas->pixels[y])
-        {
-            for (int i = 0; i < y; i++)
-            {
-                free(canvas->pixels[i]);
-            }
-            free(canvas->pixels);
-            free(canvas);
-            return NULL;
-        }
+        canvas->pixels[y] = canvas_row(canvas, y);
     }
+    // intially 0 (including the padding at the end of the rows)
+    span_fill_f(canvas->data, 0.0f, (int)count);
     return canvas;
 }
 
@@ -54,29 +85,224 @@ void canvas_destroy(canvas_t *canvas)
     if (!canvas)
         return;
 
-    for (int y = 0; y < canvas->height; y++)
-    {
-        free(canvas->pixels[y]);
-    }
+    canvas_aligned_free(canvas->data);
+    canvas_aligned_free(canvas->depth);
+    canvas_aligned_free(canvas->depth_owner);
     free(canvas->pixels);
     free(canvas);
 }
 
+// fill count floats with a value
+void span_fill_f(float *dst, float value, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    __m128 v = _mm_set1_ps(value);
+    // 16 floats (one cache line) per iteration
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm_storeu_ps(dst + i, v);
+        _mm_storeu_ps(dst + i + 4, v);
+        _mm_storeu_ps(dst + i + 8, v);
+        _mm_storeu_ps(dst + i + 12, v);
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(dst + i, v);
+    }
+#endif
+    // the remaining values
+    for (; i < count; i++)
+    {
+        dst[i] = value;
+    }
+}
+
+// copy count floats from src to dst (the spans must not overlap)
+void span_copy_f(float *dst, const float *src, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128 a = _mm_loadu_ps(src + i);
+        __m128 b = _mm_loadu_ps(src + i + 4);
+        __m128 c = _mm_loadu_ps(src + i + 8);
+        __m128 d = _mm_loadu_ps(src + i + 12);
+        _mm_storeu_ps(dst + i, a);
+        _mm_storeu_ps(dst + i + 4, b);
+        _mm_storeu_ps(dst + i + 8, c);
+        _mm_storeu_ps(dst + i + 12, d);
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_loadu_ps(src + i));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
 // Set pixels to a specific value
 void canvas_clear(canvas_t *canvas, float value)
 {
     if (!canvas)
         return;
 
-    for (int y = 0; y < canvas->height; y++)
+    // the buffer is contiguous so the whole canvas is a single fill
+    span_fill_f(canvas->data, value, canvas->stride * canvas->height);
+    canvas_clear_depth(canvas);
+}
+
+// Turn on the depth plane
+int canvas_enable_depth(canvas_t *canvas)
+{
+    if (!canvas)
+        return -1;
+    if (canvas->depth)
+        return 0;
+
+    size_t count = (size_t)canvas->stride * canvas->height;
+    canvas->depth = (float *)canvas_aligned_alloc(count * sizeof(float));
+    canvas->depth_owner = (unsigned *)canvas_aligned_alloc(count * sizeof(unsigned));
+    if (!canvas->depth || !canvas->depth_owner)
     {
-        for (int x = 0; x < canvas->width; x++)
-        {
-            canvas->pixels[y][x] = value;
-        }
+        canvas_disable_depth(canvas);
+        return -1;
+    }
+    canvas_clear_depth(canvas);
+    return 0;
+}
+
+// Turn off the depth plane
+void canvas_disable_depth(canvas_t *canvas)
+{
+    if (!canvas)
+        return;
+
+    canvas_aligned_free(canvas->depth);
+    canvas_aligned_free(canvas->depth_owner);
+    canvas->depth = NULL;
+    canvas->depth_owner = NULL;
+}
+
+// Reset the depth plane
+void canvas_clear_depth(canvas_t *canvas)
+{
+    if (canvas && canvas->depth)
+    {
+        span_fill_f(canvas->depth, CANVAS_DEPTH_EMPTY, canvas->stride * canvas->height);
+        memset(canvas->depth_owner, 0, (size_t)canvas->stride * canvas->height * sizeof(unsigned));
+        canvas->depth_line = 0;
+    }
+}
+
+// a new id for a line that is about to be drawn (0 when there is no depth plane)
+// the tiles of one line are drawn on several threads, each call gets its own id and their pixels do not overlap
+static unsigned depth_line_begin(canvas_t *canvas)
+{
+    if (!canvas->depth)
+        return 0;
+    unsigned id = __atomic_add_fetch(&canvas->depth_line, 1, __ATOMIC_RELAXED);
+    // 0 means no line, after 2^32 lines without a clear the ids start over
+    return id ? id : __atomic_add_fetch(&canvas->depth_line, 1, __ATOMIC_RELAXED);
+}
+
+// depth test of one pixel for line id, keeps the nearest depth and returns 1 if the pixel can be drawn
+// once a pixel passed for a line the later stamps of that line always pass, so a line going away from the camera
+// is not rejected by its own nearer stamps (the canvas must have a depth plane)
+static inline int depth_test(canvas_t *canvas, int x, int y, float z, unsigned id)
+{
+    size_t i = (size_t)y * canvas->stride + x;
+    float *stored = canvas->depth + i;
+    if (canvas->depth_owner[i] != id)
+    {
+        if (z > *stored + CANVAS_DEPTH_EPSILON)
+            return 0;
+        canvas->depth_owner[i] = id;
+    }
+    if (z < *stored)
+        *stored = z;
+    return 1;
+}
+
+// Fill a rectangle with a value
+void canvas_fill_rect(canvas_t *canvas, int x, int y, int width, int height, float value)
+{
+    if (!canvas)
+        return;
+
+    // clip the rectangle to the canvas
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + width > canvas->width ? canvas->width : x + width;
+    int y1 = y + height > canvas->height ? canvas->height : y + height;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    for (int row = y0; row < y1; row++)
+    {
+        span_fill_f(canvas_row(canvas, row) + x0, value, x1 - x0);
     }
 }
 
+// Copy one row between canvases of the same width
+void canvas_copy_row(canvas_t *dst, int dst_y, const canvas_t *src, int src_y)
+{
+    if (!dst || !src || dst->width != src->width)
+        return;
+    if (dst_y < 0 || dst_y >= dst->height || src_y < 0 || src_y >= src->height)
+        return;
+
+    span_copy_f(canvas_row(dst, dst_y), canvas_row(src, src_y), dst->width);
+}
+
+// Copy a whole canvas into another of the same size
+void canvas_copy(canvas_t *dst, const canvas_t *src)
+{
+    if (!dst || !src || dst->width != src->width || dst->height != src->height)
+        return;
+
+    // same stride means the blocks have the same layout
+    span_copy_f(dst->data, src->data, dst->stride * dst->height);
+}
+
+// add the four bilinear taps of a splat whose pixels (x0, y0) to (x0 + 1, y0 + 1) are all on the canvas
+static inline void splat_inside(canvas_t *canvas, int x0, int y0, float fx, float fy, float intensity)
+{
+    int x1 = x0 + 1;
+
+    // calculate the weight values
+    float w00 = (1.0f - fx) * (1.0f - fy);
+    float w10 = fx * (1.0f - fy);
+    float w01 = (1.0f - fx) * fy;
+    float w11 = fx * fy;
+
+    // the two rows touched by the splat
+    float *row0 = canvas_row(canvas, y0);
+    float *row1 = row0 + canvas->stride;
+
+    //
+    row0[x0] += intensity * w00;
+    // clamping the wieght to 1 if it exceds 1
+    if (row0[x0] > 1.0f)
+        row0[x0] = 1.0f;
+
+    row0[x1] += intensity * w10;
+    if (row0[x1] > 1.0f)
+        row0[x1] = 1.0f;
+
+    row1[x0] += intensity * w01;
+    if (row1[x0] > 1.0f)
+        row1[x0] = 1.0f;
+
+    row1[x1] += intensity * w11;
+    if (row1[x1] > 1.0f)
+        row1[x1] = 1.0f;
+}
+
 // Set pixel intensity at floating-point coordinates with bilinear filtering
 void set_pixel_f(canvas_t *canvas, float x, float y, float intensity)
 {
@@ -92,51 +318,155 @@ void set_pixel_f(canvas_t *canvas, float x, float y, float intensity)
     if (x0 < 0 || x1 >= canvas->width || y0 < 0 || y1 >= canvas->height)
         return;
 
-    //
+    splat_inside(canvas, x0, y0, x - x0, y - y0, intensity);
+}
+
+// set_pixel_f that only changes the pixels inside clip
+static inline void splat_clipped(canvas_t *canvas, float x, float y, float intensity, const canvas_rect_t *clip)
+{
+    if (intensity <= 0.0f)
+        return;
+
+    int x0 = (int)floorf(x);
+    int x1 = x0 + 1;
+    int y0 = (int)floorf(y);
+    int y1 = y0 + 1;
+
+    // same bounds rule as set_pixel_f so a clipped draw gives the same pixels
+    if (x0 < 0 || x1 >= canvas->width || y0 < 0 || y1 >= canvas->height)
+        return;
+    if (x1 < clip->x0 || x0 >= clip->x1 || y1 < clip->y0 || y0 >= clip->y1)
+        return;
+
     float fx = x - x0;
     float fy = y - y0;
 
-    // calculate the weight values
-    float w00 = (1.0f - fx) * (1.0f - fy);
-    float w10 = fx * (1.0f - fy);
-    float w01 = (1.0f - fx) * fy;
-    float w11 = fx * fy;
+    // the usual case (always when the clip rectangle is the whole canvas): all four pixels are inside
+    if (x0 >= clip->x0 && x1 < clip->x1 && y0 >= clip->y0 && y1 < clip->y1)
+    {
+        splat_inside(canvas, x0, y0, fx, fy, intensity);
+        return;
+    }
 
-    //
-    canvas->pixels[y0][x0] += intensity * w00;
-    // clamping the wieght to 1 if it exceds 1
-    if (canvas->pixels[y0][x0] > 1.0f)
-        canvas->pixels[y0][x0] = 1.0f;
+    // the stamp is on the edge of the clip rectangle, test the pixels one by one
+    int px[4] = {x0, x1, x0, x1};
+    int py[4] = {y0, y0, y1, y1};
+    float w[4] = {(1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy};
 
-    canvas->pixels[y0][x1] += intensity * w10;
-    if (canvas->pixels[y0][x1] > 1.0f)
-        canvas->pixels[y0][x1] = 1.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        if (px[i] < clip->x0 || px[i] >= clip->x1 || py[i] < clip->y0 || py[i] >= clip->y1)
+            continue;
 
-    canvas->pixels[y1][x0] += intensity * w01;
-    if (canvas->pixels[y1][x0] > 1.0f)
-        canvas->pixels[y1][x0] = 1.0f;
+        float *pixel = canvas_row(canvas, py[i]) + px[i];
+        *pixel += intensity * w[i];
+        // clamping the wieght to 1 if it exceds 1
+        if (*pixel > 1.0f)
+            *pixel = 1.0f;
+    }
+}
 
-    canvas->pixels[y1][x1] += intensity * w11;
-    if (canvas->pixels[y1][x1] > 1.0f)
-        canvas->pixels[y1][x1] = 1.0f;
+// splat_clipped with the depth test of line id at depth z on each of the four pixels
+static void splat_clipped_depth(canvas_t *canvas, float x, float y, float intensity, float z, unsigned id,
+                                const canvas_rect_t *clip)
+{
+    if (intensity <= 0.0f)
+        return;
+
+    int x0 = (int)floorf(x);
+    int x1 = x0 + 1;
+    int y0 = (int)floorf(y);
+    int y1 = y0 + 1;
+
+    if (x0 < 0 || x1 >= canvas->width || y0 < 0 || y1 >= canvas->height)
+        return;
+    if (x1 < clip->x0 || x0 >= clip->x1 || y1 < clip->y0 || y0 >= clip->y1)
+        return;
+
+    float fx = x - x0;
+    float fy = y - y0;
+
+    int px[4] = {x0, x1, x0, x1};
+    int py[4] = {y0, y0, y1, y1};
+    float w[4] = {(1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy};
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (px[i] < clip->x0 || px[i] >= clip->x1 || py[i] < clip->y0 || py[i] >= clip->y1)
+            continue;
+        if (!depth_test(canvas, px[i], py[i], z, id))
+            continue;
+
+        float *pixel = canvas_row(canvas, py[i]) + px[i];
+        *pixel += intensity * w[i];
+        if (*pixel > 1.0f)
+            *pixel = 1.0f;
+    }
+}
+
+// find the steps i in [0, steps] where start + i * inc is inside [lo, hi]
+// returns 0 if there are none
+static int clip_steps(float start, float inc, int steps, float lo, float hi, int *i_min, int *i_max)
+{
+    if (inc == 0.0f)
+        return start >= lo && start <= hi;
+
+    float a = (lo - start) / inc;
+    float b = (hi - start) / inc;
+    if (a > b)
+    {
+        float tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    // keep the values in int range for nearly flat lines
+    a = fminf(fmaxf(a, -1.0f), (float)steps + 1.0f);
+    b = fminf(fmaxf(b, -1.0f), (float)steps + 1.0f);
+
+    // one extra step on each side for the rounding
+    int first = (int)floorf(a) - 1;
+    int last = (int)ceilf(b) + 1;
+    if (first > *i_min)
+        *i_min = first;
+    if (last < *i_max)
+        *i_max = last;
+    return *i_min <= *i_max && *i_max >= 0 && *i_min <= steps;
 }
 
 // Draw a line from (x0, y0) to (x1, y1) with thickness and intensity
 void draw_line_f(canvas_t *canvas, float x0, float y0, float x1, float y1, float thickness, float intensity)
 {
-    if (!canvas || intensity <= 0.0f)
+    if (!canvas)
         return;
 
-    // calcluate the dx
-    float dx = x1 - x0;
-    // printf("%f", dx);
+    line_t line = {x0, y0, x1, y1, thickness, intensity, .z0 = 0.0f, .z1 = 0.0f};
+    canvas_rect_t clip = {0, 0, canvas->width, canvas->height};
+    draw_line_f_clipped(canvas, &line, &clip);
+}
+
+// Draw a line but only change the pixels inside clip
+void draw_line_f_clipped(canvas_t *canvas, const line_t *line, const canvas_rect_t *clip)
+{
+    if (!canvas || !line || !clip || line->intensity <= 0.0f)
+        return;
 
+    float x0 = line->x0, y0 = line->y0;
+    float intensity = line->intensity;
+
+    // calcluate the dx
+    float dx = line->x1 - x0;
     // calculate dy
-    float dy = y1 - y0;
+    float dy = line->y1 - y0;
     // get the lenth
     float len = sqrtf(dx * dx + dy * dy);
     // get the radius of the ticknexss
-    float radius = thickness / 2.0f;
+    float radius = line->thickness / 2.0f;
+
+    // the depth plane is checked once per line, without one the stamps skip the depth code
+    int depth_on = canvas->depth != NULL;
+    unsigned id = depth_line_begin(canvas);
+    STATS_ONLY(long long splats = 0;)
 
     // if the length of line is 0 draw a point if it should be visible
     if (len == 0.0f)
@@ -148,10 +478,15 @@ void draw_line_f(canvas_t *canvas, float x0, float y0, float x1, float y1, float
                 if (s * s + t * t <= radius * radius)
                 {
                     // set the intensity of the point form the middle of it
-                    set_pixel_f(canvas, x0 + s, y0 + t, intensity);
+                    if (depth_on)
+                        splat_clipped_depth(canvas, x0 + s, y0 + t, intensity, line->z0, id, clip);
+                    else
+                        splat_clipped(canvas, x0 + s, y0 + t, intensity, clip);
+                    STATS_ONLY(splats++;)
                 }
             }
         }
+        STATS_ADD(RENDER_COUNTER_PIXELS, splats);
         return;
     }
 
@@ -160,10 +495,20 @@ void draw_line_f(canvas_t *canvas, float x0, float y0, float x1, float y1, float
     float x_increment = dx / steps;
     float y_increment = dy / steps;
 
-    for (int i = 0; i <= steps; i++)
+    // only the steps whose brush can reach the clip rectangle
+    float reach = radius + 2.0f;
+    int i_min = 0, i_max = steps;
+    if (!clip_steps(x0, x_increment, steps, clip->x0 - reach, clip->x1 + reach, &i_min, &i_max) ||
+        !clip_steps(y0, y_increment, steps, clip->y0 - reach, clip->y1 + reach, &i_min, &i_max))
+        return;
+
+    float z_increment = (line->z1 - line->z0) / steps;
+
+    for (int i = i_min; i <= i_max; i++)
     {
         float x = x0 + i * x_increment;
         float y = y0 + i * y_increment;
+        float z = line->z0 + i * z_increment;
 
         // make the line smooth
         // Draw a circular brush at each step along the line
@@ -183,11 +528,175 @@ void draw_line_f(canvas_t *canvas, float x0, float y0, float x1, float y1, float
 
                     float brush_intensity = 1.0f - (dist / radius);
                     // set the intensity
-                    set_pixel_f(canvas, x + brush_dx, y + brush_dy, intensity * brush_intensity);
+                    if (depth_on)
+                        splat_clipped_depth(canvas, x + brush_dx, y + brush_dy, intensity * brush_intensity, z, id, clip);
+                    else
+                        splat_clipped(canvas, x + brush_dx, y + brush_dy, intensity * brush_intensity, clip);
+                    STATS_ONLY(splats++;)
                 }
             }
         }
     }
+    STATS_ADD(RENDER_COUNTER_PIXELS, splats);
+}
+
+// total weight one brush stamp of draw_line_f puts on the canvas
+static float brush_weight(float radius)
+{
+    float total = 0.0f;
+    for (float brush_dx = -radius; brush_dx <= radius; brush_dx += 0.5f)
+    {
+        for (float brush_dy = -radius; brush_dy <= radius; brush_dy += 0.5f)
+        {
+            float dist_sq = brush_dx * brush_dx + brush_dy * brush_dy;
+            if (dist_sq <= radius * radius)
+                total += 1.0f - sqrtf(dist_sq) / radius;
+        }
+    }
+    return total;
+}
+
+// x interval of the row y where a*x + b is inside [lo, hi], returns 0 if it is empty
+static int row_interval(float a, float b, float lo, float hi, float *x_lo, float *x_hi)
+{
+    if (a == 0.0f)
+        return b >= lo && b <= hi;
+
+    float p = (lo - b) / a;
+    float q = (hi - b) / a;
+    *x_lo = fmaxf(*x_lo, fminf(p, q));
+    *x_hi = fminf(*x_hi, fmaxf(p, q));
+    return *x_lo <= *x_hi;
+}
+
+// grow [x_lo, x_hi] so it holds the part of the row y inside the circle (cx, cy, r)
+static void row_disc(float cx, float cy, float r, float y, float *x_lo, float *x_hi)
+{
+    float h_sq = r * r - (y - cy) * (y - cy);
+    if (h_sq < 0.0f)
+        return;
+
+    float h = sqrtf(h_sq);
+    *x_lo = fminf(*x_lo, cx - h);
+    *x_hi = fmaxf(*x_hi, cx + h);
+}
+
+// Draw an anti-aliased line from its distance to the segment
+void draw_line_coverage_f(canvas_t *canvas, float x0, float y0, float x1, float y1, float thickness, float intensity)
+{
+    if (!canvas)
+        return;
+
+    line_t line = {x0, y0, x1, y1, thickness, intensity, .z0 = 0.0f, .z1 = 0.0f};
+    canvas_rect_t clip = {0, 0, canvas->width, canvas->height};
+    draw_line_coverage_f_clipped(canvas, &line, &clip);
+}
+
+// Draw an anti-aliased line, only inside clip
+void draw_line_coverage_f_clipped(canvas_t *canvas, const line_t *line, const canvas_rect_t *clip)
+{
+    if (!canvas || !line || !clip || line->intensity <= 0.0f)
+        return;
+
+    float x0 = line->x0, y0 = line->y0;
+    float dx = line->x1 - x0;
+    float dy = line->y1 - y0;
+    float len_sq = dx * dx + dy * dy;
+    float len = sqrtf(len_sq);
+    float radius = line->thickness / 2.0f;
+
+    // the brush falloff spread by the bilinear splat reaches half a pixel further
+    float reach = radius + 0.5f;
+    float reach_sq = reach * reach;
+    int depth_on = canvas->depth != NULL;
+    unsigned id = depth_line_begin(canvas);
+
+    // scale the cone 1 - d / reach so the line has the same weight as the brush version:
+    // the brush puts 2 stamps per pixel of length, a cone across the line has an area of reach,
+    // a point is one stamp spread over a cone with a volume of pi * reach^2 / 3
+    float stamp = brush_weight(radius) * line->intensity;
+    float peak = len > 0.0f ? 2.0f * stamp / reach : 3.0f * stamp / (3.14159265f * reach_sq);
+
+    // the rows the line covers, inside the clip rectangle
+    int row_first = (int)ceilf(fminf(y0, line->y1) - reach);
+    int row_last = (int)floorf(fmaxf(y0, line->y1) + reach);
+    if (row_first < clip->y0)
+        row_first = clip->y0;
+    if (row_first < 0)
+        row_first = 0;
+    if (row_last > clip->y1 - 1)
+        row_last = clip->y1 - 1;
+    if (row_last > canvas->height - 1)
+        row_last = canvas->height - 1;
+
+    // unit vectors along and across the line
+    float ux = len > 0.0f ? dx / len : 0.0f;
+    float uy = len > 0.0f ? dy / len : 0.0f;
+    STATS_ONLY(long long written = 0;)
+
+    for (int py = row_first; py <= row_last; py++)
+    {
+        float ry = py - y0;
+
+        // the span of the row inside the capsule: the band around the segment plus the two end discs
+        float x_lo = 1e30f, x_hi = -1e30f;
+        if (len > 0.0f)
+        {
+            float band_lo = -1e30f, band_hi = 1e30f;
+            // across the line: |(-uy) * (x - x0) + ux * ry| <= reach
+            // along the line: 0 <= ux * (x - x0) + uy * ry <= len
+            if (row_interval(-uy, ux * ry + uy * x0, -reach, reach, &band_lo, &band_hi) &&
+                row_interval(ux, uy * ry - ux * x0, 0.0f, len, &band_lo, &band_hi))
+            {
+                x_lo = band_lo;
+                x_hi = band_hi;
+            }
+        }
+        row_disc(x0, y0, reach, (float)py, &x_lo, &x_hi);
+        row_disc(line->x1, line->y1, reach, (float)py, &x_lo, &x_hi);
+        if (x_lo > x_hi)
+            continue;
+
+        int px_first = (int)ceilf(x_lo);
+        int px_last = (int)floorf(x_hi);
+        if (px_first < clip->x0)
+            px_first = clip->x0;
+        if (px_first < 0)
+            px_first = 0;
+        if (px_last > clip->x1 - 1)
+            px_last = clip->x1 - 1;
+        if (px_last > canvas->width - 1)
+            px_last = canvas->width - 1;
+
+        float *row = canvas_row(canvas, py);
+        for (int px = px_first; px <= px_last; px++)
+        {
+            // closest point of the segment
+            float rx = px - x0;
+            float t = len_sq > 0.0f ? (rx * dx + ry * dy) / len_sq : 0.0f;
+            t = fmaxf(0.0f, fminf(1.0f, t));
+            float ex = rx - t * dx;
+            float ey = ry - t * dy;
+            float dist_sq = ex * ex + ey * ey;
+            if (dist_sq >= reach_sq)
+                continue;
+            if (depth_on && !depth_test(canvas, px, py, line->z0 + t * (line->z1 - line->z0), id))
+                continue;
+
+            row[px] += peak * (1.0f - sqrtf(dist_sq) / reach);
+            if (row[px] > 1.0f)
+                row[px] = 1.0f;
+            STATS_ONLY(written++;)
+        }
+    }
+    STATS_ADD(RENDER_COUNTER_PIXELS, written);
+}
+
+// Set the line mode of the canvas
+void canvas_set_line_mode(canvas_t *canvas, line_mode_t mode)
+{
+    if (canvas)
+        canvas->line_mode = mode;
 }
 
 // Save canvas to PGM file
@@ -200,6 +709,7 @@ void canvas_save_pgm(canvas_t *canvas, const char *filename)
     // check if it is successful it is null
     if (!fp)
         return;
+    STATS_BEGIN(RENDER_STAGE_OUTPUT);
 
     // print the pgm header
     fprintf(fp, "P2\n%d %d\n255\n", canvas->width, canvas->height);
@@ -211,7 +721,7 @@ void canvas_save_pgm(canvas_t *canvas, const char *filename)
         for (int x = 0; x < canvas->width; x++)
         {
             // calculate the reavant value for in 0 -255 range
-            int pixel_value = (int)(canvas->pixels[y][x] * 255.0f);
+            int pixel_value = (int)(canvas_row(canvas, y)[x] * 255.0f);
             // clamping the value to 255
             if (pixel_value > 255)
                 pixel_value = 255;
@@ -219,6 +729,156 @@ void canvas_save_pgm(canvas_t *canvas, const char *filename)
         }
         fprintf(fp, "\n");
     }
+    STATS_ADD(RENDER_COUNTER_BYTES_WRITTEN, ftell(fp));
     // close the file
     fclose(fp);
+    STATS_END(RENDER_STAGE_OUTPUT);
+}
+
+// write the P5 header into buffer (if it is not NULL) and return its length
+static size_t pgm_header(const canvas_t *canvas, int bit_depth, char *buffer, size_t buffer_size)
+{
+    int max_value = bit_depth == 16 ? 65535 : 255;
+    int len = snprintf(buffer, buffer_size, "P5\n%d %d\n%d\n", canvas->width, canvas->height, max_value);
+    return len < 0 ? 0 : (size_t)len;
+}
+
+// Quantize a row of floats to bytes
+void span_quantize_u8(const float *src, unsigned char *dst, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    __m128 scale = _mm_set1_ps(255.0f);
+    // 16 pixels per iteration, the packs saturate to 0..255 which is the clamping
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+        __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+        __m128i c = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 8), scale));
+        __m128i d = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 12), scale));
+        __m128i ab = _mm_packs_epi32(a, b);
+        __m128i cd = _mm_packs_epi32(c, d);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(ab, cd));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        int value = (int)(src[i] * 255.0f);
+        if (value > 255)
+            value = 255;
+        if (value < 0)
+            value = 0;
+        dst[i] = (unsigned char)value;
+    }
+}
+
+// Quantize a row of floats to big-endian 16 bit values
+void span_quantize_u16be(const float *src, unsigned char *dst, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 scale = _mm_set1_ps(65535.0f);
+    __m128i bias = _mm_set1_epi32(32768);
+    __m128i flip = _mm_set1_epi16((short)0x8000);
+    for (; i + 8 <= count; i += 8)
+    {
+        // clamp first so the values fit, then move them into the signed range for the pack
+        __m128 fa = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+        __m128 fb = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), zero), one);
+        __m128i a = _mm_sub_epi32(_mm_cvttps_epi32(_mm_mul_ps(fa, scale)), bias);
+        __m128i b = _mm_sub_epi32(_mm_cvttps_epi32(_mm_mul_ps(fb, scale)), bias);
+        __m128i packed = _mm_xor_si128(_mm_packs_epi32(a, b), flip);
+        // swap the bytes of each value to big-endian
+        __m128i swapped = _mm_or_si128(_mm_slli_epi16(packed, 8), _mm_srli_epi16(packed, 8));
+        _mm_storeu_si128((__m128i *)(dst + i * 2), swapped);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float v = src[i];
+        int value = v <= 0.0f ? 0 : v >= 1.0f ? 65535 : (int)(v * 65535.0f);
+        dst[i * 2] = (unsigned char)(value >> 8);
+        dst[i * 2 + 1] = (unsigned char)(value & 0xff);
+    }
+}
+
+// quantize row y of the canvas into dst
+static void pgm_quantize_row(const canvas_t *canvas, int y, int bit_depth, unsigned char *dst)
+{
+    if (bit_depth == 16)
+        span_quantize_u16be(canvas_row(canvas, y), dst, canvas->width);
+    else
+        span_quantize_u8(canvas_row(canvas, y), dst, canvas->width);
+}
+
+// Encode the canvas as P5 into a memory buffer
+size_t canvas_encode_pgm(const canvas_t *canvas, int bit_depth, unsigned char *buffer, size_t buffer_size)
+{
+    if (!canvas || (bit_depth != 8 && bit_depth != 16))
+        return 0;
+
+    // get the size of the image
+    char header[64];
+    size_t header_len = pgm_header(canvas, bit_depth, header, sizeof(header));
+    size_t row_bytes = (size_t)canvas->width * (bit_depth / 8);
+    size_t total = header_len + row_bytes * canvas->height;
+
+    // only report the size if there is no room for the image
+    if (!buffer || buffer_size < total)
+        return total;
+
+    STATS_BEGIN(RENDER_STAGE_OUTPUT);
+    memcpy(buffer, header, header_len);
+    unsigned char *dst = buffer + header_len;
+    for (int y = 0; y < canvas->height; y++)
+    {
+        pgm_quantize_row(canvas, y, bit_depth, dst);
+        dst += row_bytes;
+    }
+    STATS_END(RENDER_STAGE_OUTPUT);
+    STATS_ADD(RENDER_COUNTER_BYTES_WRITTEN, total);
+    return total;
+}
+
+// Save canvas to a binary PGM file
+int canvas_save_pgm_binary(const canvas_t *canvas, const char *filename, int bit_depth)
+{
+    if (!canvas || !filename || (bit_depth != 8 && bit_depth != 16))
+        return -1;
+
+    size_t row_bytes = (size_t)canvas->width * (bit_depth / 8);
+    unsigned char *row = (unsigned char *)malloc(row_bytes);
+    if (!row)
+        return -1;
+
+    // open the file
+    FILE *fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        free(row);
+        return -1;
+    }
+
+    STATS_BEGIN(RENDER_STAGE_OUTPUT);
+    char header[64];
+    size_t header_len = pgm_header(canvas, bit_depth, header, sizeof(header));
+    int ok = fwrite(header, 1, header_len, fp) == header_len;
+
+    // one write per row
+    for (int y = 0; ok && y < canvas->height; y++)
+    {
+        pgm_quantize_row(canvas, y, bit_depth, row);
+        ok = fwrite(row, 1, row_bytes, fp) == row_bytes;
+    }
+
+    // close the file
+    if (fclose(fp) != 0)
+        ok = 0;
+    free(row);
+    STATS_END(RENDER_STAGE_OUTPUT);
+    if (ok)
+        STATS_ADD(RENDER_COUNTER_BYTES_WRITTEN, header_len + row_bytes * canvas->height);
+    return ok ? 0 : -1;
 }
@@ -0,0 +1,155 @@
+#include "depth_sort.h"
+#include <stdlib.h>
+#include <string.h>
+
+// below this size an insertion sort is faster than the radix passes
+#define DEPTH_SORT_SMALL 32
+
+// Start a sorter
+void depth_sorter_init(depth_sorter_t *sorter, int key_bits)
+{
+    sorter->key_bits = key_bits == 16 ? 16 : 32;
+    sorter->keys = NULL;
+    sorter->keys_tmp = NULL;
+    sorter->order = NULL;
+    sorter->order_tmp = NULL;
+    sorter->capacity = 0;
+}
+
+// Free the scratch buffers
+void depth_sorter_free(depth_sorter_t *sorter)
+{
+    free(sorter->keys);
+    free(sorter->keys_tmp);
+    free(sorter->order);
+    free(sorter->order_tmp);
+    depth_sorter_init(sorter, sorter->key_bits);
+}
+
+// make room for count keys, the buffers only grow
+static int depth_sorter_reserve(depth_sorter_t *sorter, int count)
+{
+    if (count <= sorter->capacity)
+        return 1;
+
+    int key_bits = sorter->key_bits;
+    depth_sorter_free(sorter);
+    sorter->key_bits = key_bits;
+    sorter->keys = (uint32_t *)malloc(count * sizeof(uint32_t));
+    sorter->keys_tmp = (uint32_t *)malloc(count * sizeof(uint32_t));
+    sorter->order = (int *)malloc(count * sizeof(int));
+    sorter->order_tmp = (int *)malloc(count * sizeof(int));
+    if (!sorter->keys || !sorter->keys_tmp || !sorter->order || !sorter->order_tmp)
+    {
+        depth_sorter_free(sorter);
+        return 0;
+    }
+    sorter->capacity = count;
+    return 1;
+}
+
+// key that sorts in ascending order for back to front (largest depth first)
+static uint32_t depth_key(float depth, int key_bits)
+{
+    if (key_bits == 16)
+    {
+        // quantize the normalized log depth
+        float d = depth < 0.0f ? 0.0f : depth > 1.0f ? 1.0f : depth;
+        return 65535u - (uint32_t)(d * 65535.0f + 0.5f);
+    }
+
+    // the float bits turned into an unsigned value with the same order, then flipped
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    return ~bits;
+}
+
+// Sort the depths back to front
+const int *depth_sort_back_to_front(depth_sorter_t *sorter, const float *depths, int count)
+{
+    if (!sorter || count < 0 || (count > 0 && !depths))
+        return NULL;
+    if (!depth_sorter_reserve(sorter, count > 0 ? count : 1))
+        return NULL;
+
+    uint32_t *keys = sorter->keys;
+    int *order = sorter->order;
+    for (int i = 0; i < count; i++)
+    {
+        keys[i] = depth_key(depths[i], sorter->key_bits);
+        order[i] = i;
+    }
+
+    // stable insertion sort for small lists
+    if (count <= DEPTH_SORT_SMALL)
+    {
+        for (int i = 1; i < count; i++)
+        {
+            uint32_t key = keys[i];
+            int index = order[i];
+            int j = i - 1;
+            while (j >= 0 && keys[j] > key)
+            {
+                keys[j + 1] = keys[j];
+                order[j + 1] = order[j];
+                j--;
+            }
+            keys[j + 1] = key;
+            order[j + 1] = index;
+        }
+        return order;
+    }
+
+    // one histogram per 8 bit digit, all filled in one pass over the keys
+    int passes = sorter->key_bits / 8;
+    int counts[4][256];
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < count; i++)
+    {
+        for (int p = 0; p < passes; p++)
+            counts[p][(keys[i] >> (p * 8)) & 0xff]++;
+    }
+
+    uint32_t *keys_tmp = sorter->keys_tmp;
+    int *order_tmp = sorter->order_tmp;
+    for (int p = 0; p < passes; p++)
+    {
+        int shift = p * 8;
+
+        // skip the digit if every key has the same value there
+        if (counts[p][(keys[0] >> shift) & 0xff] == count)
+            continue;
+
+        // start of every bucket
+        int offset = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            int n = counts[p][b];
+            counts[p][b] = offset;
+            offset += n;
+        }
+
+        // scatter in input order, which keeps the sort stable
+        for (int i = 0; i < count; i++)
+        {
+            int dst = counts[p][(keys[i] >> shift) & 0xff]++;
+            keys_tmp[dst] = keys[i];
+            order_tmp[dst] = order[i];
+        }
+
+        uint32_t *swap_keys = keys;
+        keys = keys_tmp;
+        keys_tmp = swap_keys;
+        int *swap_order = order;
+        order = order_tmp;
+        order_tmp = swap_order;
+    }
+
+    // keep the buffers in the sorter pointing at the right blocks
+    sorter->keys = keys;
+    sorter->keys_tmp = keys_tmp;
+    sorter->order = order;
+    sorter->order_tmp = order_tmp;
+    return order;
+}
@@ -0,0 +1,48 @@
+#include "edge_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Make room for count keys
+int edge_set_reserve(edge_set_t *set, size_t count)
+{
+    if (count * 2 <= set->capacity)
+        return 0;
+
+    size_t capacity = 16;
+    while (capacity < count * 2)
+        capacity *= 2;
+    uint64_t *table = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+    if (!table)
+        return -1;
+    memset(table, 0xff, capacity * sizeof(uint64_t));
+
+    int shift = 64;
+    for (size_t c = capacity; c > 1; c >>= 1)
+        shift--;
+
+    // move the keys of the old table
+    for (size_t i = 0; i < set->capacity; i++)
+    {
+        uint64_t key = set->table[i];
+        if (key == UINT64_MAX)
+            continue;
+        size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> shift);
+        while (table[slot] != UINT64_MAX)
+            slot = (slot + 1) & (capacity - 1);
+        table[slot] = key;
+    }
+    free(set->table);
+    set->table = table;
+    set->capacity = capacity;
+    set->shift = shift;
+    return 0;
+}
+
+// Free the table
+void edge_set_free(edge_set_t *set)
+{
+    free(set->table);
+    set->table = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
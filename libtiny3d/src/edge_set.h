@@ -0,0 +1,44 @@
+#ifndef EDGE_SET_H
+#define EDGE_SET_H
+
+// internal to the library: the hash set of undirected edges used by the mesh loaders and the simplifier
+
+#include <stddef.h>
+#include <stdint.h>
+
+// key of an undirected edge, the smaller index is in the high half
+static inline uint64_t edge_key(int a, int b)
+{
+    return a < b ? ((uint64_t)a << 32) | (uint32_t)b : ((uint64_t)b << 32) | (uint32_t)a;
+}
+
+// open addressing hash set of edge keys, zero initialize it before the first edge_set_reserve
+typedef struct
+{
+    uint64_t *table; // UINT64_MAX is an empty slot (a key never has all bits set, the indices are below 2^31)
+    size_t capacity; // a power of two
+    size_t count;
+    int shift;       // 64 - log2(capacity), for the fibonacci hashing
+} edge_set_t;
+
+// Make room for count keys with the table at most half full, returns 0 on success and -1 on failure
+int edge_set_reserve(edge_set_t *set, size_t count);
+
+// Free the table
+void edge_set_free(edge_set_t *set);
+
+// Add a key, returns 1 if it is new and 0 if it was already there (the set must have room for it)
+static inline int edge_set_insert(edge_set_t *set, uint64_t key)
+{
+    // fibonacci hashing, then linear probing
+    size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> set->shift);
+    while (set->table[slot] != UINT64_MAX && set->table[slot] != key)
+        slot = (slot + 1) & (set->capacity - 1);
+    if (set->table[slot] == key)
+        return 0;
+    set->table[slot] = key;
+    set->count++;
+    return 1;
+}
+
+#endif // EDGE_SET_H
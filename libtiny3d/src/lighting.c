@@ -1,28 +1,45 @@
 #include "lighting.h"
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// ambient light of an empty light set
+#define LIGHT_AMBIENT 0.2f
 
 /**
  * @brief Computes the total light intensity on an edge from multiple light sources.
  */
 float compute_lighting(vec3_t edge_dir, light_t *lights, int num_lights)
+{
+    return compute_lighting_f(vec3f_from_vec3(edge_dir), lights, num_lights);
+}
+
+/**
+ * @brief Computes the light intensity on an edge given as a vec3f_t.
+ */
+float compute_lighting_f(vec3f_t edge_dir, const light_t *lights, int num_lights)
 {
     if (num_lights <= 0)
     {
-        return 0.2f; // Default ambient light if no lights are defined
+        return LIGHT_AMBIENT; // Default ambient light if no lights are defined
     }
     // varible to store the lights
     float total_intensity = 0.0f;
     // get the unit vector
-    vec3_t normalized_edge_dir = vec3_normalize_fast(edge_dir);
+    vec3f_t normalized_edge_dir = vec3f_normalize_fast(edge_dir);
 
     // Accumulate intensity from each light source
     for (int i = 0; i < num_lights; i++)
     {
         // unit vector og the light direction
-        vec3_t normalized_light_dir = vec3_normalize_fast(lights[i].direction);
+        vec3f_t normalized_light_dir = vec3f_normalize_fast(vec3f_from_vec3(lights[i].direction));
 
         // Calculate the dot product (Lambert's cosine law) a.b = a.b.cos theta
-        float dot_product = vec3_dot(normalized_edge_dir, normalized_light_dir);
+        float dot_product = vec3f_dot(normalized_edge_dir, normalized_light_dir);
 
         // Add the contribution of the current light, make sure its not negative by getting the ma with 0
         total_intensity += fmaxf(0.0f, dot_product) * lights[i].intensity;
@@ -31,3 +48,176 @@ float compute_lighting(vec3_t edge_dir, light_t *lights, int num_lights)
     // Clamp the final intensity to the [0, 1] range
     return fminf(1.0f, total_intensity);
 }
+
+// Start an empty light set
+void light_set_init(light_set_t *set)
+{
+    set->lights = NULL;
+    set->directions = NULL;
+    set->intensities = NULL;
+    set->count = 0;
+    set->capacity = 0;
+    set->version = 0;
+}
+
+// Free the arrays
+void light_set_free(light_set_t *set)
+{
+    free(set->lights);
+    free(set->directions);
+    free(set->intensities);
+    unsigned version = set->version;
+    light_set_init(set);
+    set->version = version + 1;
+}
+
+// make room for count lights
+static int light_set_reserve(light_set_t *set, int count)
+{
+    if (count <= set->capacity)
+        return 0;
+
+    int capacity = set->capacity ? set->capacity * 2 : 8;
+    if (capacity < count)
+        capacity = count;
+    light_t *lights = (light_t *)realloc(set->lights, capacity * sizeof(light_t));
+    if (lights)
+        set->lights = lights;
+    vec3f_t *directions = (vec3f_t *)realloc(set->directions, capacity * sizeof(vec3f_t));
+    if (directions)
+        set->directions = directions;
+    float *intensities = (float *)realloc(set->intensities, capacity * sizeof(float));
+    if (intensities)
+        set->intensities = intensities;
+
+    if (!lights || !directions || !intensities)
+        return -1;
+    set->capacity = capacity;
+    return 0;
+}
+
+// store a light and its normalized direction
+static void light_set_store(light_set_t *set, int index, light_t light)
+{
+    set->lights[index] = light;
+    set->directions[index] = vec3f_normalize_fast(vec3f_from_vec3(light.direction));
+    set->intensities[index] = light.intensity;
+}
+
+// Replace all the lights
+int light_set_assign(light_set_t *set, const light_t *lights, int num_lights)
+{
+    if (num_lights < 0 || (num_lights > 0 && !lights))
+        return -1;
+
+    // only the direction and intensity matter, the spherical values of vec3_t are not compared
+    int same = num_lights == set->count;
+    for (int i = 0; same && i < num_lights; i++)
+    {
+        const light_t *a = &set->lights[i];
+        const light_t *b = &lights[i];
+        same = a->direction.x == b->direction.x && a->direction.y == b->direction.y &&
+               a->direction.z == b->direction.z && a->intensity == b->intensity;
+    }
+    if (same)
+        return 0;
+
+    if (light_set_reserve(set, num_lights) != 0)
+        return -1;
+    for (int i = 0; i < num_lights; i++)
+    {
+        light_set_store(set, i, lights[i]);
+    }
+    set->count = num_lights;
+    set->version++;
+    return 0;
+}
+
+// Add a light
+int light_set_add(light_set_t *set, light_t light)
+{
+    if (light_set_reserve(set, set->count + 1) != 0)
+        return -1;
+    light_set_store(set, set->count, light);
+    set->version++;
+    return set->count++;
+}
+
+// Replace one light
+int light_set_update(light_set_t *set, int index, light_t light)
+{
+    if (index < 0 || index >= set->count)
+        return -1;
+    light_set_store(set, index, light);
+    set->version++;
+    return 0;
+}
+
+// Light one edge with the set
+float light_set_evaluate(const light_set_t *set, vec3f_t edge_dir)
+{
+    if (set->count <= 0)
+        return LIGHT_AMBIENT;
+
+    // the same steps as compute_lighting_f
+    float total_intensity = 0.0f;
+    vec3f_t normalized_edge_dir = vec3f_normalize_fast(edge_dir);
+    for (int i = 0; i < set->count; i++)
+    {
+        float dot_product = vec3f_dot(normalized_edge_dir, set->directions[i]);
+        total_intensity += fmaxf(0.0f, dot_product) * set->intensities[i];
+    }
+    return fminf(1.0f, total_intensity);
+}
+
+// Light many edges with the set
+void light_set_evaluate_batch(const light_set_t *set, const vec3f_t *edge_dirs, int count, float *out)
+{
+    int i = 0;
+    if (set->count <= 0)
+    {
+        for (; i < count; i++)
+            out[i] = LIGHT_AMBIENT;
+        return;
+    }
+
+#ifdef __SSE2__
+    // four edges at a time, with the same operation order as light_set_evaluate so the results are identical
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 three_halfs = _mm_set1_ps(1.5f);
+    const __m128i magic = _mm_set1_epi32(0x5f3759df);
+    for (; i + 4 <= count; i += 4)
+    {
+        const vec3f_t *d = edge_dirs + i;
+        __m128 x = _mm_setr_ps(d[0].x, d[1].x, d[2].x, d[3].x);
+        __m128 y = _mm_setr_ps(d[0].y, d[1].y, d[2].y, d[3].y);
+        __m128 z = _mm_setr_ps(d[0].z, d[1].z, d[2].z, d[3].z);
+
+        // vec3f_normalize_fast, a zero vector stays zero because it is multiplied by a finite value
+        __m128 len_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 half_len = _mm_mul_ps(half, len_sq);
+        __m128 r = _mm_castsi128_ps(_mm_sub_epi32(magic, _mm_srai_epi32(_mm_castps_si128(len_sq), 1)));
+        r = _mm_mul_ps(r, _mm_sub_ps(three_halfs, _mm_mul_ps(_mm_mul_ps(half_len, r), r)));
+        x = _mm_mul_ps(x, r);
+        y = _mm_mul_ps(y, r);
+        z = _mm_mul_ps(z, r);
+
+        __m128 total = zero;
+        for (int l = 0; l < set->count; l++)
+        {
+            vec3f_t dir = set->directions[l];
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(dir.x)), _mm_mul_ps(y, _mm_set1_ps(dir.y))),
+                                    _mm_mul_ps(z, _mm_set1_ps(dir.z)));
+            // max and min return the second operand for NaN, like fmaxf and fminf
+            total = _mm_add_ps(total, _mm_mul_ps(_mm_max_ps(dot, zero), _mm_set1_ps(set->intensities[l])));
+        }
+        _mm_storeu_ps(out + i, _mm_min_ps(total, one));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        out[i] = light_set_evaluate(set, edge_dirs[i]);
+    }
+}
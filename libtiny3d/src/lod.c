@@ -0,0 +1,118 @@
+#include "lod.h"
+#include "mesh_opt.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// Build the levels of a mesh
+int object3d_lod_build(object3d_lod_t *lod, object3d_t *obj, int max_levels)
+{
+    if (!lod || !obj)
+        return -1;
+    memset(lod, 0, sizeof(*lod));
+    lod->max_error = OBJECT3D_LOD_MAX_ERROR;
+    lod->levels[0] = obj;
+    lod->level_count = 1;
+    if (max_levels > OBJECT3D_LOD_MAX_LEVELS)
+        max_levels = OBJECT3D_LOD_MAX_LEVELS;
+
+    if (!obj->has_bounds)
+        object3d_compute_bounds(obj);
+    vec3f_t size = vec3f_sub(obj->bounds_max, obj->bounds_min);
+    float extent = fmaxf(size.x, fmaxf(size.y, size.z));
+    if (extent <= 0.0f)
+        return 0;
+
+    // first grid: a few cells per vertex along a side, so it already merges the close vertices of dense meshes
+    int grid = 2;
+    while (grid < (1 << 16) && (double)grid * grid * grid < 64.0 * obj->vertex_count)
+        grid *= 2;
+
+    for (; grid >= 2 && lod->level_count < max_levels; grid /= 2)
+    {
+        object3d_t *last = lod->levels[lod->level_count - 1];
+        object3d_t *level = mesh_simplify_clusters(obj, grid);
+        if (!level)
+        {
+            object3d_lod_free(lod);
+            return -1;
+        }
+        if (level->edge_count == 0 || (double)level->edge_count > 0.67 * last->edge_count)
+        {
+            object3d_destroy(level);
+            continue;
+        }
+
+        // the source bounds, so culling a level culls the same as the source
+        level->bounds_min = obj->bounds_min;
+        level->bounds_max = obj->bounds_max;
+        level->bounds_center = obj->bounds_center;
+        level->bounds_radius = obj->bounds_radius;
+        lod->cell_size[lod->level_count] = extent / grid;
+        lod->levels[lod->level_count++] = level;
+    }
+    return 0;
+}
+
+// Free the simplified levels
+void object3d_lod_free(object3d_lod_t *lod)
+{
+    if (!lod)
+        return;
+    for (int i = 1; i < lod->level_count; i++)
+        object3d_destroy(lod->levels[i]);
+    memset(lod, 0, sizeof(*lod));
+}
+
+// Diameter of the bounding sphere on screen
+float object3d_projected_size(const object3d_t *obj, mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection,
+                              int canvas_width, int canvas_height)
+{
+    if (!obj || !obj->has_bounds)
+        return FLT_MAX;
+
+    mat4_t model_view = mat4_multiply(world_to_camera, local_to_world);
+    vec3f_t center = mat4_transform_point(&model_view, obj->bounds_center);
+
+    // radius after the largest scale of the transform
+    float scale_sq = 0.0f;
+    for (int col = 0; col < 3; col++)
+    {
+        float len_sq = model_view.m[0][col] * model_view.m[0][col] + model_view.m[1][col] * model_view.m[1][col] +
+                       model_view.m[2][col] * model_view.m[2][col];
+        scale_sq = fmaxf(scale_sq, len_sq);
+    }
+    float radius = obj->bounds_radius * sqrtf(scale_sq);
+
+    // the camera looks along +z so the depth is minus clip w
+    float depth = -(projection.m[3][0] * center.x + projection.m[3][1] * center.y +
+                    projection.m[3][2] * center.z + projection.m[3][3]);
+    if (depth <= -radius)
+        return 0.0f;
+    if (depth <= radius)
+        return FLT_MAX;
+
+    // pixels per camera space unit at depth 1 (NDC is 2 units across the canvas)
+    float focal = fmaxf(fabsf(projection.m[0][0]) * canvas_width, fabsf(projection.m[1][1]) * canvas_height) * 0.5f;
+    return 2.0f * radius * focal / depth;
+}
+
+// Pick the level for a projected size
+int object3d_lod_select(const object3d_lod_t *lod, float projected_size)
+{
+    if (!lod || lod->level_count <= 1 || !(projected_size < FLT_MAX))
+        return 0;
+    float radius = lod->levels[0]->bounds_radius;
+    if (radius <= 0.0f)
+        return 0;
+
+    float pixels_per_unit = projected_size / (2.0f * radius);
+    int level = 0;
+    for (int i = 1; i < lod->level_count; i++)
+    {
+        if (lod->cell_size[i] * pixels_per_unit > lod->max_error)
+            break;
+        level = i;
+    }
+    return level;
+}
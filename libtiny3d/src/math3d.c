@@ -1,6 +1,10 @@
 #include "math3d.h"
 #include <math.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // Create a 3D vector with Cartesian coordinates
 vec3_t vec3_create(float x, float y, float z)
 {
@@ -121,9 +125,10 @@ vec3_t vec3_normalize_fast(vec3_t v)
 
     // Fast inverse square root (Quake III algorithm)
     float half_len = 0.5f * len_sq;
-    long i = *(long *)&len_sq; // get the bit value at len_sq address to long value by casting value at the address and dereferencing it
-    i = 0x5f3759df - (i >> 1); // as the bits of the number is its own logarith by deviding it it gives the  square root
-    len_sq = *(float *)&i;     // get back the true value
+    int32_t i;
+    memcpy(&i, &len_sq, sizeof(i)); // get the bit value of len_sq as a 32 bit integer
+    i = 0x5f3759df - (i >> 1);      // as the bits of the number is its own logarith by deviding it it gives the  square root
+    memcpy(&len_sq, &i, sizeof(i)); // get back the true value
 
     // after appling the f'x and fx to the eqaution this is what we get
     // y = y(3/2 - (x/2)y^2)
@@ -186,32 +191,260 @@ mat4_t mat4_rotate_xyz(float rx, float ry, float rz)
 // Matrix multiplication
 mat4_t mat4_multiply(mat4_t a, mat4_t b)
 {
+    mat4_t m;
+    mat4_multiply_to(&m, &a, &b);
+    return m;
+}
+
+// multiplies a 4×4 matrix(m) by a 4D vector(v) and returns the transformed vector
+vec4_t mat4_transform_vec4(mat4_t m, vec4_t v)
+{
+    vec4_t result;
+    mat4_transform_vec4_to(&result, &m, &v);
+    return result;
+}
+
+// Matrix multiplication without copies
+void mat4_multiply_to(mat4_t *out, const mat4_t *a, const mat4_t *b)
+{
+#ifdef __SSE2__
+    // row i of the result is the rows of b weighted by row i of a, summed in the order of the scalar loop
+    __m128 b0 = _mm_loadu_ps(b->m[0]);
+    __m128 b1 = _mm_loadu_ps(b->m[1]);
+    __m128 b2 = _mm_loadu_ps(b->m[2]);
+    __m128 b3 = _mm_loadu_ps(b->m[3]);
+    __m128 rows[4];
+    for (int i = 0; i < 4; i++)
+    {
+        __m128 r = _mm_mul_ps(_mm_set1_ps(a->m[i][0]), b0);
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a->m[i][1]), b1));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a->m[i][2]), b2));
+        rows[i] = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a->m[i][3]), b3));
+    }
+    for (int i = 0; i < 4; i++)
+        _mm_storeu_ps(out->m[i], rows[i]);
+#else
     mat4_t m;
     // cij = aik * b kj
     for (int i = 0; i < 4; i++)
     {
         for (int j = 0; j < 4; j++)
         {
-            m.m[i][j] = 0;
-            for (int k = 0; k < 4; k++)
+            m.m[i][j] = a->m[i][0] * b->m[0][j];
+            for (int k = 1; k < 4; k++)
             {
-                m.m[i][j] += a.m[i][k] * b.m[k][j];
+                m.m[i][j] += a->m[i][k] * b->m[k][j];
             }
         }
     }
-    return m;
+    *out = m;
+#endif
 }
 
-// multiplies a 4×4 matrix(m) by a 4D vector(v) and returns the transformed vector
-vec4_t mat4_transform_vec4(mat4_t m, vec4_t v)
+// Inverse of a matrix
+mat4_t mat4_inverse(mat4_t m)
 {
+    mat4_t inverse;
+    if (mat4_inverse_to(&inverse, &m) != 0)
+        return mat4_identity();
+    return inverse;
+}
 
-    vec4_t result;
-    result.x = m.m[0][0] * v.x + m.m[0][1] * v.y + m.m[0][2] * v.z + m.m[0][3] * v.w;
-    result.y = m.m[1][0] * v.x + m.m[1][1] * v.y + m.m[1][2] * v.z + m.m[1][3] * v.w;
-    result.z = m.m[2][0] * v.x + m.m[2][1] * v.y + m.m[2][2] * v.z + m.m[2][3] * v.w;
-    result.w = m.m[3][0] * v.x + m.m[3][1] * v.y + m.m[3][2] * v.z + m.m[3][3] * v.w;
-    return result;
+#ifdef __SSE2__
+#define SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+#define SWIZZLE(a, x, y, z, w) SHUFFLE(a, a, x, y, z, w)
+
+// 2x2 matrices are stored as (m00, m01, m10, m11) in one register
+// a * b
+static inline __m128 mat2_mul(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, SWIZZLE(b, 0, 3, 0, 3)), _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// adjugate(a) * b
+static inline __m128 mat2_adj_mul(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(SWIZZLE(a, 3, 3, 0, 0), b), _mm_mul_ps(SWIZZLE(a, 1, 1, 2, 2), SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+// a * adjugate(b)
+static inline __m128 mat2_mul_adj(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 3, 0, 3, 0)), _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+#endif
+
+// Inverse without copies
+int mat4_inverse_to(mat4_t *out, const mat4_t *m)
+{
+#ifdef __SSE2__
+    // block inverse with the 2x2 sub matrices | A B |
+    //                                         | C D |
+    __m128 r0 = _mm_loadu_ps(m->m[0]);
+    __m128 r1 = _mm_loadu_ps(m->m[1]);
+    __m128 r2 = _mm_loadu_ps(m->m[2]);
+    __m128 r3 = _mm_loadu_ps(m->m[3]);
+    __m128 a = _mm_movelh_ps(r0, r1);
+    __m128 b = _mm_movehl_ps(r1, r0);
+    __m128 c = _mm_movelh_ps(r2, r3);
+    __m128 d = _mm_movehl_ps(r3, r2);
+
+    // determinants of the blocks as (|A|, |B|, |C|, |D|)
+    __m128 det_sub = _mm_sub_ps(_mm_mul_ps(SHUFFLE(r0, r2, 0, 2, 0, 2), SHUFFLE(r1, r3, 1, 3, 1, 3)),
+                                _mm_mul_ps(SHUFFLE(r0, r2, 1, 3, 1, 3), SHUFFLE(r1, r3, 0, 2, 0, 2)));
+    __m128 det_a = SWIZZLE(det_sub, 0, 0, 0, 0);
+    __m128 det_b = SWIZZLE(det_sub, 1, 1, 1, 1);
+    __m128 det_c = SWIZZLE(det_sub, 2, 2, 2, 2);
+    __m128 det_d = SWIZZLE(det_sub, 3, 3, 3, 3);
+
+    // the inverse is 1 / |M| * | X Y |, computed as adjugates
+    //                          | Z W |
+    __m128 d_c = mat2_adj_mul(d, c);
+    __m128 a_b = mat2_adj_mul(a, b);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mul(b, d_c));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mul(c, a_b));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mul_adj(d, a_b));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mul_adj(a, d_c));
+
+    // |M| = |A| |D| + |B| |C| - trace((A# B)(D# C))
+    __m128 det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+    __m128 trace = _mm_mul_ps(a_b, SWIZZLE(d_c, 0, 2, 1, 3));
+    trace = _mm_add_ps(trace, SWIZZLE(trace, 1, 0, 3, 2));
+    trace = _mm_add_ps(trace, SWIZZLE(trace, 2, 3, 0, 1));
+    det = _mm_sub_ps(det, trace);
+    if (_mm_cvtss_f32(det) == 0.0f)
+        return -1;
+
+    __m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    x = _mm_mul_ps(x, inv_det);
+    y = _mm_mul_ps(y, inv_det);
+    z = _mm_mul_ps(z, inv_det);
+    w = _mm_mul_ps(w, inv_det);
+
+    // undo the adjugate layout while storing the rows
+    _mm_storeu_ps(out->m[0], SHUFFLE(x, y, 3, 1, 3, 1));
+    _mm_storeu_ps(out->m[1], SHUFFLE(x, y, 2, 0, 2, 0));
+    _mm_storeu_ps(out->m[2], SHUFFLE(z, w, 3, 1, 3, 1));
+    _mm_storeu_ps(out->m[3], SHUFFLE(z, w, 2, 0, 2, 0));
+    return 0;
+#else
+    // cofactors from the 2x2 determinants of the top two and bottom two rows
+    const float (*a)[4] = m->m;
+    float s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+    float s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+    float s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+    float s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+    float s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+    float s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
+    float c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+    float c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+    float c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+    float c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+    float c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+    float c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
+
+    float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    if (det == 0.0f)
+        return -1;
+    float inv = 1.0f / det;
+
+    mat4_t r = {{{(a[1][1] * c5 - a[1][2] * c4 + a[1][3] * c3) * inv,
+                  (-a[0][1] * c5 + a[0][2] * c4 - a[0][3] * c3) * inv,
+                  (a[3][1] * s5 - a[3][2] * s4 + a[3][3] * s3) * inv,
+                  (-a[2][1] * s5 + a[2][2] * s4 - a[2][3] * s3) * inv},
+                 {(-a[1][0] * c5 + a[1][2] * c2 - a[1][3] * c1) * inv,
+                  (a[0][0] * c5 - a[0][2] * c2 + a[0][3] * c1) * inv,
+                  (-a[3][0] * s5 + a[3][2] * s2 - a[3][3] * s1) * inv,
+                  (a[2][0] * s5 - a[2][2] * s2 + a[2][3] * s1) * inv},
+                 {(a[1][0] * c4 - a[1][1] * c2 + a[1][3] * c0) * inv,
+                  (-a[0][0] * c4 + a[0][1] * c2 - a[0][3] * c0) * inv,
+                  (a[3][0] * s4 - a[3][1] * s2 + a[3][3] * s0) * inv,
+                  (-a[2][0] * s4 + a[2][1] * s2 - a[2][3] * s0) * inv},
+                 {(-a[1][0] * c3 + a[1][1] * c1 - a[1][2] * c0) * inv,
+                  (a[0][0] * c3 - a[0][1] * c1 + a[0][2] * c0) * inv,
+                  (-a[3][0] * s3 + a[3][1] * s1 - a[3][2] * s0) * inv,
+                  (a[2][0] * s3 - a[2][1] * s1 + a[2][2] * s0) * inv}}};
+    *out = r;
+    return 0;
+#endif
+}
+
+// Transform an array of points with the divide by w
+void mat4_transform_points(const mat4_t *m, const vec3f_t *in, vec3f_t *out, int count)
+{
+#ifdef __SSE2__
+    // columns of m, a point is x * column 0 + y * column 1 + z * column 2 + column 3
+    __m128 c0 = _mm_setr_ps(m->m[0][0], m->m[1][0], m->m[2][0], m->m[3][0]);
+    __m128 c1 = _mm_setr_ps(m->m[0][1], m->m[1][1], m->m[2][1], m->m[3][1]);
+    __m128 c2 = _mm_setr_ps(m->m[0][2], m->m[1][2], m->m[2][2], m->m[3][2]);
+    __m128 c3 = _mm_setr_ps(m->m[0][3], m->m[1][3], m->m[2][3], m->m[3][3]);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 divide_min = _mm_set1_ps(0.0001f);
+    __m128 one = _mm_set1_ps(1.0f);
+    for (int i = 0; i < count; i++)
+    {
+        vec3f_t v = in[i];
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.x)), _mm_mul_ps(c1, _mm_set1_ps(v.y))),
+                                         _mm_mul_ps(c2, _mm_set1_ps(v.z))),
+                              c3);
+
+        // divide by w when |w| > 0.0001, otherwise by 1
+        __m128 w = SWIZZLE(r, 3, 3, 3, 3);
+        __m128 use = _mm_cmpgt_ps(_mm_andnot_ps(sign, w), divide_min);
+        r = _mm_div_ps(r, _mm_or_ps(_mm_and_ps(use, w), _mm_andnot_ps(use, one)));
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, r);
+        out[i] = vec3f_create(lanes[0], lanes[1], lanes[2]);
+    }
+#else
+    for (int i = 0; i < count; i++)
+        out[i] = mat4_transform_point(m, in[i]);
+#endif
+}
+
+// Transform an array of points into homogeneous coordinates
+void mat4_transform_points_h(const mat4_t *m, const vec3f_t *in, vec4_t *out, int count)
+{
+#ifdef __SSE2__
+    __m128 c0 = _mm_setr_ps(m->m[0][0], m->m[1][0], m->m[2][0], m->m[3][0]);
+    __m128 c1 = _mm_setr_ps(m->m[0][1], m->m[1][1], m->m[2][1], m->m[3][1]);
+    __m128 c2 = _mm_setr_ps(m->m[0][2], m->m[1][2], m->m[2][2], m->m[3][2]);
+    __m128 c3 = _mm_setr_ps(m->m[0][3], m->m[1][3], m->m[2][3], m->m[3][3]);
+    for (int i = 0; i < count; i++)
+    {
+        vec3f_t v = in[i];
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.x)), _mm_mul_ps(c1, _mm_set1_ps(v.y))),
+                                         _mm_mul_ps(c2, _mm_set1_ps(v.z))),
+                              c3);
+        _mm_storeu_ps(&out[i].x, r);
+    }
+#else
+    for (int i = 0; i < count; i++)
+    {
+        vec3f_t v = in[i];
+        out[i].x = m->m[0][0] * v.x + m->m[0][1] * v.y + m->m[0][2] * v.z + m->m[0][3];
+        out[i].y = m->m[1][0] * v.x + m->m[1][1] * v.y + m->m[1][2] * v.z + m->m[1][3];
+        out[i].z = m->m[2][0] * v.x + m->m[2][1] * v.y + m->m[2][2] * v.z + m->m[2][3];
+        out[i].w = m->m[3][0] * v.x + m->m[3][1] * v.y + m->m[3][2] * v.z + m->m[3][3];
+    }
+#endif
+}
+
+// Compare two matrices with a tolerance
+int mat4_nearly_equal(const mat4_t *a, const mat4_t *b, float tolerance)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            float x = a->m[i][j], y = b->m[i][j];
+            float size = fmaxf(1.0f, fmaxf(fabsf(x), fabsf(y)));
+            if (!(fabsf(x - y) <= tolerance * size))
+                return 0;
+        }
+    }
+    return 1;
 }
 
 // transforms a 3D vector(v) using a 4×4 transformation matrix(m),
@@ -220,7 +453,8 @@ vec3_t mat4_transform_vec3(mat4_t m, vec3_t v)
     // create a vector in for 4x1 matix
     vec4_t input = {v.x, v.y, v.z, 1.0f};
 
-    vec4_t result = mat4_transform_vec4(m, input);
+    vec4_t result;
+    mat4_transform_vec4_to(&result, &m, &input);
 
     // makng sure that w is not zero and normalized it back to 3d
     if (fabsf(result.w) > 0.0001f)
@@ -277,4 +511,229 @@ vec3_t vec3_slerp(vec3_t a, vec3_t b, float t)
     vec3_t relative = vec3_normalize(vec3_sub(b, vec3_scale(a, dot)));
 
     return vec3_add(vec3_scale(a, cosf(theta)), vec3_scale(relative, sinf(theta)));
-}
\ No newline at end of file
+}
+// Convert a vec3f_t to a vec3_t with its spherical values
+vec3_t vec3_from_vec3f(vec3f_t v)
+{
+    return vec3_create(v.x, v.y, v.z);
+}
+
+// Spherical coordinates of a vec3f_t
+void vec3f_to_spherical(vec3f_t v, float *r, float *theta, float *phi)
+{
+    vec3_t full = vec3_create(v.x, v.y, v.z);
+    *r = full.r;
+    *theta = full.theta;
+    *phi = full.phi;
+}
+
+// vec3f_t from spherical coordinates
+vec3f_t vec3f_from_spherical(float r, float theta, float phi)
+{
+    return vec3f_from_vec3(vec3_from_spherical(r, theta, phi));
+}
+
+// Identity rotation
+quat_t quat_identity(void)
+{
+    return (quat_t){0.0f, 0.0f, 0.0f, 1.0f};
+}
+
+// Rotation by angle around a unit axis
+quat_t quat_from_axis_angle(vec3f_t axis, float angle)
+{
+    float s = sinf(angle * 0.5f);
+    return (quat_t){axis.x * s, axis.y * s, axis.z * s, cosf(angle * 0.5f)};
+}
+
+// mat4_rotate_xyz is Rz(-rz) * Ry(-ry) * Rx(-rx)
+quat_t quat_from_euler_xyz(float rx, float ry, float rz)
+{
+    quat_t qx = quat_from_axis_angle(vec3f_create(1.0f, 0.0f, 0.0f), -rx);
+    quat_t qy = quat_from_axis_angle(vec3f_create(0.0f, 1.0f, 0.0f), -ry);
+    quat_t qz = quat_from_axis_angle(vec3f_create(0.0f, 0.0f, 1.0f), -rz);
+    return quat_multiply(qz, quat_multiply(qy, qx));
+}
+
+// Hamilton product
+quat_t quat_multiply(quat_t a, quat_t b)
+{
+    return (quat_t){a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                    a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                    a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+                    a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z};
+}
+
+// Scale to unit length (the identity if q is zero)
+quat_t quat_normalize(quat_t q)
+{
+    float len_sq = q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
+    if (len_sq <= 0.0f)
+        return quat_identity();
+    float inv = 1.0f / sqrtf(len_sq);
+    return (quat_t){q.x * inv, q.y * inv, q.z * inv, q.w * inv};
+}
+
+// Rotate a vector, v + 2w (u x v) + 2 u x (u x v) with u the vector part
+vec3f_t quat_rotate(quat_t q, vec3f_t v)
+{
+    vec3f_t u = vec3f_create(q.x, q.y, q.z);
+    vec3f_t t = vec3f_scale(vec3f_cross(u, v), 2.0f);
+    return vec3f_add(vec3f_add(v, vec3f_scale(t, q.w)), vec3f_cross(u, t));
+}
+
+// the t of an nlerp that follows slerp: a cubic correction whose size depends on the angle (d = |cos| of the half angle)
+static inline float slerp_correction(float d, float t)
+{
+    float a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+    float b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+    float k = a * (t - 0.5f) * (t - 0.5f) + b;
+    return t + t * (t - 0.5f) * (t - 1.0f) * k;
+}
+
+// a + (b - a) * t normalized, with b flipped to the same side as a (the same steps as the array version)
+static inline quat_t quat_blend(quat_t a, quat_t b, float t, int correct)
+{
+    float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    if (dot < 0.0f)
+    {
+        b = (quat_t){-b.x, -b.y, -b.z, -b.w};
+        dot = -dot;
+    }
+    if (correct)
+        t = slerp_correction(dot, t);
+
+    quat_t r = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t};
+    float inv = 1.0f / sqrtf(r.x * r.x + r.y * r.y + r.z * r.z + r.w * r.w);
+    return (quat_t){r.x * inv, r.y * inv, r.z * inv, r.w * inv};
+}
+
+// Normalized linear interpolation
+quat_t quat_nlerp(quat_t a, quat_t b, float t)
+{
+    return quat_blend(a, b, t, 0);
+}
+
+// Spherical linear interpolation
+quat_t quat_slerp(quat_t a, quat_t b, float t)
+{
+    float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    if (dot < 0.0f)
+    {
+        b = (quat_t){-b.x, -b.y, -b.z, -b.w};
+        dot = -dot;
+    }
+
+    // nearly the same rotation, sin(theta) would be close to 0
+    if (dot > 0.9995f)
+        return quat_blend(a, b, t, 0);
+
+    float theta = acosf(dot);
+    float s = 1.0f / sinf(theta);
+    float wa = sinf((1.0f - t) * theta) * s;
+    float wb = sinf(t * theta) * s;
+    return quat_normalize((quat_t){a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb, a.w * wa + b.w * wb});
+}
+
+// Rotation matrix
+mat4_t quat_to_mat4(quat_t q)
+{
+    mat4_t m;
+    quat_to_mat4_array(&q, NULL, &m, 1);
+    return m;
+}
+
+#ifdef __SSE2__
+// 4 quaternions blended at once, the lanes are the quaternions (same steps as quat_blend)
+static void quat_blend4(const quat_t *a, const quat_t *b, const float *t, quat_t *out, int correct)
+{
+    __m128 ax = _mm_loadu_ps(&a[0].x), ay = _mm_loadu_ps(&a[1].x), az = _mm_loadu_ps(&a[2].x), aw = _mm_loadu_ps(&a[3].x);
+    __m128 bx = _mm_loadu_ps(&b[0].x), by = _mm_loadu_ps(&b[1].x), bz = _mm_loadu_ps(&b[2].x), bw = _mm_loadu_ps(&b[3].x);
+    _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+    _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+    __m128 tt = _mm_loadu_ps(t);
+
+    // flip b where the dot product is negative
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz)), _mm_mul_ps(aw, bw));
+    __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+    bx = _mm_xor_ps(bx, flip);
+    by = _mm_xor_ps(by, flip);
+    bz = _mm_xor_ps(bz, flip);
+    bw = _mm_xor_ps(bw, flip);
+    dot = _mm_xor_ps(dot, flip);
+
+    if (correct)
+    {
+        __m128 half = _mm_set1_ps(0.5f);
+        __m128 ca = _mm_add_ps(_mm_set1_ps(1.0904f),
+                               _mm_mul_ps(dot, _mm_add_ps(_mm_set1_ps(-3.2452f),
+                                                          _mm_mul_ps(dot, _mm_sub_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(dot, _mm_set1_ps(1.43519f)))))));
+        __m128 cb = _mm_add_ps(_mm_set1_ps(0.848013f),
+                               _mm_mul_ps(dot, _mm_add_ps(_mm_set1_ps(-1.06021f), _mm_mul_ps(dot, _mm_set1_ps(0.215638f)))));
+        __m128 th = _mm_sub_ps(tt, half);
+        __m128 k = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ca, th), th), cb);
+        tt = _mm_add_ps(tt, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(tt, th), _mm_sub_ps(tt, _mm_set1_ps(1.0f))), k));
+    }
+
+    __m128 rx = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), tt));
+    __m128 ry = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), tt));
+    __m128 rz = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), tt));
+    __m128 rw = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(bw, aw), tt));
+    __m128 len_sq = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_mul_ps(rz, rz)), _mm_mul_ps(rw, rw));
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len_sq));
+    rx = _mm_mul_ps(rx, inv);
+    ry = _mm_mul_ps(ry, inv);
+    rz = _mm_mul_ps(rz, inv);
+    rw = _mm_mul_ps(rw, inv);
+
+    _MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+    _mm_storeu_ps(&out[0].x, rx);
+    _mm_storeu_ps(&out[1].x, ry);
+    _mm_storeu_ps(&out[2].x, rz);
+    _mm_storeu_ps(&out[3].x, rw);
+}
+#endif
+
+// blend arrays 4 at a time and the rest one by one
+static void quat_blend_array(const quat_t *a, const quat_t *b, const float *t, quat_t *out, int count, int correct)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4)
+        quat_blend4(a + i, b + i, t + i, out + i, correct);
+#endif
+    for (; i < count; i++)
+        out[i] = quat_blend(a[i], b[i], t[i], correct);
+}
+
+// Many nlerps
+void quat_nlerp_array(const quat_t *a, const quat_t *b, const float *t, quat_t *out, int count)
+{
+    quat_blend_array(a, b, t, out, count, 0);
+}
+
+// Many approximate slerps
+void quat_slerp_array(const quat_t *a, const quat_t *b, const float *t, quat_t *out, int count)
+{
+    quat_blend_array(a, b, t, out, count, 1);
+}
+
+// Rotation and translation matrices
+void quat_to_mat4_array(const quat_t *rotations, const vec3f_t *translations, mat4_t *out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        quat_t q = rotations[i];
+        float x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+        float xx = q.x * x2, yy = q.y * y2, zz = q.z * z2;
+        float xy = q.x * y2, xz = q.x * z2, yz = q.y * z2;
+        float wx = q.w * x2, wy = q.w * y2, wz = q.w * z2;
+        vec3f_t p = translations ? translations[i] : vec3f_create(0.0f, 0.0f, 0.0f);
+
+        mat4_t m = {{{1.0f - (yy + zz), xy - wz, xz + wy, p.x},
+                     {xy + wz, 1.0f - (xx + zz), yz - wx, p.y},
+                     {xz - wy, yz + wx, 1.0f - (xx + yy), p.z},
+                     {0.0f, 0.0f, 0.0f, 1.0f}}};
+        out[i] = m;
+    }
+}
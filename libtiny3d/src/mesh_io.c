@@ -0,0 +1,1414 @@
+#include "mesh_io.h"
+#include "parallel.h"
+#include "edge_set.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// piece of an OBJ file given to one parse task
+#define OBJ_CHUNK_SIZE (256 * 1024)
+
+// vertices converted by one PLY task
+#define PLY_VERTEX_BLOCK 65536
+
+// faces read by one PLY task
+#define PLY_FACE_BLOCK 16384
+
+// limits of the PLY header
+#define PLY_MAX_ELEMENTS 16
+#define PLY_MAX_PROPERTIES 32
+
+// ---------------------------------------------------------------------------
+// memory mapped files
+
+// a read only view of a whole file
+typedef struct
+{
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} mapped_file_t;
+
+// map the file, returns 0 on success and -1 on failure
+// with copy_on_write the pages can be written, the changes stay private to the process
+static int map_file(const char *filename, mapped_file_t *file, int copy_on_write)
+{
+    file->data = NULL;
+    file->size = 0;
+#ifdef _WIN32
+    file->mapping = NULL;
+    file->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file->file == INVALID_HANDLE_VALUE)
+        return -1;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file->file, &size))
+    {
+        CloseHandle(file->file);
+        return -1;
+    }
+    file->size = (size_t)size.QuadPart;
+    if (file->size == 0)
+        return 0; // an empty file can not be mapped
+
+    file->mapping = CreateFileMappingA(file->file, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    if (file->mapping)
+        file->data = (const char *)MapViewOfFile(file->mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    if (!file->data)
+    {
+        if (file->mapping)
+            CloseHandle(file->mapping);
+        CloseHandle(file->file);
+        return -1;
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    file->size = (size_t)st.st_size;
+    if (file->size > 0)
+    {
+        int protection = copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *data = mmap(NULL, file->size, protection, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return -1;
+        }
+        // the text formats are read front to back
+        if (!copy_on_write)
+            madvise(data, file->size, MADV_SEQUENTIAL);
+        file->data = (const char *)data;
+    }
+    // the mapping stays valid without the descriptor
+    close(fd);
+#endif
+    return 0;
+}
+
+// unmap a file from map_file
+static void unmap_file(mapped_file_t *file)
+{
+#ifdef _WIN32
+    if (file->data)
+        UnmapViewOfFile(file->data);
+    if (file->mapping)
+        CloseHandle(file->mapping);
+    if (file->file != INVALID_HANDLE_VALUE)
+        CloseHandle(file->file);
+#else
+    if (file->data)
+        munmap((void *)file->data, file->size);
+#endif
+    file->data = NULL;
+    file->size = 0;
+}
+
+// ---------------------------------------------------------------------------
+// edge deduplication
+//
+// the faces are read in pieces of bounded size (OBJ_CHUNK_SIZE bytes of text, PLY_FACE_BLOCK faces),
+// each piece drops its own repeated edges with a table of its own size, and the pieces are then merged
+// in file order into the edges of the object, so besides the object only a few pieces and the table
+// of the unique edges are in memory at once
+
+// the face edges of one piece of the file
+typedef struct
+{
+    uint64_t *keys;
+    size_t count;
+    int duplicates; // repeated edges dropped inside the piece
+    int error;
+} edge_piece_t;
+
+// drop the edges from a vertex to itself and the repeated edges of a piece, the first of each is kept in place
+static int edge_piece_dedupe(edge_piece_t *piece)
+{
+    edge_set_t set = {0};
+    if (edge_set_reserve(&set, piece->count) != 0)
+        return -1;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < piece->count; i++)
+    {
+        uint64_t key = piece->keys[i];
+        if ((key >> 32) == (key & 0xffffffffu))
+            continue;
+        if (edge_set_insert(&set, key))
+            piece->keys[kept++] = key;
+        else
+            piece->duplicates++;
+    }
+    piece->count = kept;
+    edge_set_free(&set);
+    return 0;
+}
+
+// the unique edges of the whole file
+typedef struct
+{
+    edge_set_t set;
+    int (*edges)[2];
+    size_t capacity;
+    int duplicates;
+} edge_merge_t;
+
+// make room for count unique edges, returns 0 on success and -1 on failure
+static int edge_merge_reserve(edge_merge_t *merge, size_t count)
+{
+    if (count > INT_MAX || edge_set_reserve(&merge->set, count) != 0)
+        return -1;
+    if (count > merge->capacity)
+    {
+        // exactly count the first time (the estimate of the loaders), then by half, the estimate is usually close
+        size_t capacity = merge->capacity ? merge->capacity : count;
+        while (capacity < count)
+            capacity += capacity / 2 + 1;
+        int (*edges)[2] = (int (*)[2])realloc(merge->edges, capacity * sizeof(int[2]));
+        if (!edges)
+            return -1;
+        merge->edges = edges;
+        merge->capacity = capacity;
+    }
+    return 0;
+}
+
+// add the edges of a deduplicated piece that no earlier piece had, in their order
+static int edge_merge_add(edge_merge_t *merge, edge_piece_t *piece)
+{
+    merge->duplicates += piece->duplicates;
+    if (piece->count == 0)
+        return 0;
+    if (edge_merge_reserve(merge, merge->set.count + piece->count) != 0)
+        return -1;
+
+    for (size_t i = 0; i < piece->count; i++)
+    {
+        uint64_t key = piece->keys[i];
+        size_t index = merge->set.count;
+        if (!edge_set_insert(&merge->set, key))
+        {
+            merge->duplicates++;
+            continue;
+        }
+        merge->edges[index][0] = (int)(key >> 32);
+        merge->edges[index][1] = (int)(key & 0xffffffffu);
+    }
+    return 0;
+}
+
+// give the merged edges to obj, the table is freed
+static void edge_merge_finish(edge_merge_t *merge, object3d_t *obj)
+{
+    int edge_count = (int)merge->set.count;
+    edge_set_free(&merge->set);
+
+    // give back the room of the growth
+    if (edge_count > 0 && (size_t)edge_count < merge->capacity)
+    {
+        int (*shrunk)[2] = (int (*)[2])realloc(merge->edges, edge_count * sizeof(int[2]));
+        if (shrunk)
+            merge->edges = shrunk;
+    }
+    if (edge_count == 0)
+    {
+        free(merge->edges);
+        merge->edges = NULL;
+    }
+    obj->edges = merge->edges;
+    obj->edge_count = edge_count;
+    merge->edges = NULL;
+    merge->capacity = 0;
+}
+
+static void edge_merge_free(edge_merge_t *merge)
+{
+    edge_set_free(&merge->set);
+    free(merge->edges);
+    merge->edges = NULL;
+}
+
+// fill the stats at the end of a load
+static void finish_stats(mesh_load_stats_t *stats, const object3d_t *obj, size_t bytes, int faces,
+                         int duplicates, int threads, double start)
+{
+    if (!stats)
+        return;
+    stats->file_bytes = bytes;
+    stats->vertex_count = obj->vertex_count;
+    stats->face_count = faces;
+    stats->edge_count = obj->edge_count;
+    stats->duplicate_edges = duplicates;
+    stats->threads = threads;
+    stats->seconds = parallel_time_seconds() - start;
+}
+
+// ---------------------------------------------------------------------------
+// text parsing (the mapped file has no terminating zero, so everything takes an end pointer)
+
+static inline int is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline const char *skip_blanks(const char *p, const char *end)
+{
+    while (p < end && is_blank(*p))
+        p++;
+    return p;
+}
+
+static inline const char *skip_token(const char *p, const char *end)
+{
+    while (p < end && !is_blank(*p))
+        p++;
+    return p;
+}
+
+// end of the line that starts at p (the '\n' or end)
+static inline const char *find_line_end(const char *p, const char *end)
+{
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    return eol ? eol : end;
+}
+
+// powers of ten that are exact in a double
+static const double pow10_table[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// parse a decimal float like strtof, returns the position after it or NULL if there is no number
+static const char *parse_float(const char *p, const char *end, float *out)
+{
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    // up to 19 significant digits fit in the mantissa, the rest only move the exponent
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int seen = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, seen++)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, seen++)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!seen)
+        return NULL;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        int exp_negative = 0;
+        if (q < end && (*q == '-' || *q == '+'))
+            exp_negative = *q++ == '-';
+        if (q < end && *q >= '0' && *q <= '9')
+        {
+            int e = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; q++)
+            {
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+            }
+            exponent += exp_negative ? -e : e;
+            p = q;
+        }
+    }
+
+    double value = (double)mantissa;
+    while (exponent > 22 && value != 0.0)
+    {
+        value *= 1e22;
+        exponent -= 22;
+        if (value > 1e300)
+            exponent = 0;
+    }
+    while (exponent < -22 && value != 0.0)
+    {
+        value /= 1e22;
+        exponent += 22;
+    }
+    if (exponent > 0)
+        value *= pow10_table[exponent];
+    else if (exponent < 0)
+        value /= pow10_table[-exponent];
+
+    *out = (float)(negative ? -value : value);
+    return p;
+}
+
+// parse an integer that may be followed by /texture/normal indices, returns NULL if there is no number
+static const char *parse_index(const char *p, const char *end, long long *out)
+{
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p >= end || *p < '0' || *p > '9')
+        return NULL;
+
+    long long value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        if (value < ((long long)1 << 40))
+            value = value * 10 + (*p - '0');
+    }
+    *out = negative ? -value : value;
+    return skip_token(p, end);
+}
+
+// ---------------------------------------------------------------------------
+// OBJ
+
+// a piece of the file that starts at the beginning of a line
+typedef struct
+{
+    const char *begin;
+    const char *end;
+    int vertex_count;  // v lines
+    int face_count;    // f and l lines
+    size_t edge_count; // edges of the faces and lines before deduplication
+    int vertex_first;  // index of the first vertex of the chunk
+    edge_piece_t edges; // the edges of the chunk in pass 2, until they are merged
+    int error;
+} obj_chunk_t;
+
+// shared state of the two passes
+typedef struct
+{
+    obj_chunk_t *chunks;
+    size_t first; // chunk of parse task 0
+    vec3f_t *vertices;
+    int vertex_total;
+} obj_job_t;
+
+// the command of an OBJ line: 'v', 'f', 'l' or 0 for everything else (vn, vt, comments, ...)
+static inline char obj_command(const char *p, const char *eol)
+{
+    if (p < eol && (*p == 'v' || *p == 'f' || *p == 'l') && (p + 1 == eol || is_blank(p[1])))
+        return *p;
+    return 0;
+}
+
+// number of edges of a face or line with count vertices
+static inline size_t obj_edge_count(char command, size_t count)
+{
+    if (command == 'f')
+        return count >= 3 ? count : count == 2 ? 1 : 0;
+    return count >= 2 ? count - 1 : 0;
+}
+
+// pass 1: count the vertices and edges of a chunk
+static void obj_count_task(int index, void *user)
+{
+    obj_chunk_t *chunk = &((obj_job_t *)user)->chunks[index];
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+    while (p < end)
+    {
+        const char *eol = find_line_end(p, end);
+        const char *q = skip_blanks(p, eol);
+        char command = obj_command(q, eol);
+        if (command == 'v')
+        {
+            chunk->vertex_count++;
+        }
+        else if (command)
+        {
+            size_t count = 0;
+            for (q = skip_blanks(q + 1, eol); q < eol; q = skip_blanks(skip_token(q, eol), eol))
+                count++;
+            chunk->face_count++;
+            chunk->edge_count += obj_edge_count(command, count);
+        }
+        p = eol + 1;
+    }
+}
+
+// pass 2: parse the vertices of a chunk into their place in the object and its edges into its own piece
+static void obj_parse_task(int index, void *user)
+{
+    obj_job_t *job = (obj_job_t *)user;
+    obj_chunk_t *chunk = &job->chunks[job->first + index];
+    vec3f_t *vertices = job->vertices + chunk->vertex_first;
+    chunk->edges.keys = (uint64_t *)malloc((chunk->edge_count ? chunk->edge_count : 1) * sizeof(uint64_t));
+    if (!chunk->edges.keys)
+    {
+        chunk->error = 1;
+        return;
+    }
+    uint64_t *edges = chunk->edges.keys;
+    int seen = 0; // vertices of this chunk so far, for the negative (relative) indices
+
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+    while (p < end)
+    {
+        const char *eol = find_line_end(p, end);
+        const char *q = skip_blanks(p, eol);
+        char command = obj_command(q, eol);
+        if (command == 'v')
+        {
+            float xyz[3];
+            q++;
+            for (int k = 0; k < 3 && q; k++)
+                q = parse_float(skip_blanks(q, eol), eol, &xyz[k]);
+            if (!q)
+            {
+                chunk->error = 1;
+                return;
+            }
+            vertices[seen++] = vec3f_create(xyz[0], xyz[1], xyz[2]);
+        }
+        else if (command)
+        {
+            // connect every vertex to the one before it, and close the face
+            int first = -1, prev = -1;
+            size_t count = 0;
+            for (q = skip_blanks(q + 1, eol); q < eol; q = skip_blanks(q, eol))
+            {
+                long long v;
+                q = parse_index(q, eol, &v);
+                if (!q || v == 0)
+                {
+                    chunk->error = 1;
+                    return;
+                }
+                // 1 is the first vertex of the file and -1 the last one before this line
+                long long vertex = v > 0 ? v - 1 : chunk->vertex_first + seen + v;
+                if (vertex < 0 || vertex >= job->vertex_total)
+                {
+                    chunk->error = 1;
+                    return;
+                }
+                if (count > 0)
+                    *edges++ = edge_key(prev, (int)vertex);
+                else
+                    first = (int)vertex;
+                prev = (int)vertex;
+                count++;
+            }
+            if (command == 'f' && count >= 3)
+                *edges++ = edge_key(prev, first);
+        }
+        p = eol + 1;
+    }
+
+    chunk->edges.count = edges - chunk->edges.keys;
+    if (edge_piece_dedupe(&chunk->edges) != 0)
+        chunk->error = 1;
+}
+
+// Load an OBJ file
+object3d_t *mesh_load_obj(const char *filename, int num_threads, mesh_load_stats_t *stats)
+{
+    double start = parallel_time_seconds();
+    mapped_file_t file;
+    if (!filename || map_file(filename, &file, 0) != 0)
+        return NULL;
+
+    if (num_threads <= 0)
+        num_threads = parallel_thread_count();
+
+    // chunks of bounded size, so the edges of only a few of them are in memory at once
+    size_t chunk_count = (file.size + OBJ_CHUNK_SIZE - 1) / OBJ_CHUNK_SIZE;
+    if (chunk_count < 1)
+        chunk_count = 1;
+    if (chunk_count > INT_MAX)
+        chunk_count = INT_MAX;
+    int threads = chunk_count < (size_t)num_threads ? (int)chunk_count : num_threads;
+
+    obj_chunk_t *chunks = (obj_chunk_t *)calloc(chunk_count, sizeof(obj_chunk_t));
+    object3d_t *obj = NULL;
+    edge_merge_t merge = {0};
+    if (!chunks)
+        goto fail;
+
+    // cut the file at line starts
+    const char *end = file.data + file.size;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        const char *begin = file.data + file.size / chunk_count * i;
+        if (i > 0)
+        {
+            while (begin < end && begin[-1] != '\n')
+                begin++;
+        }
+        chunks[i].begin = begin;
+        if (i > 0)
+            chunks[i - 1].end = begin;
+    }
+    chunks[chunk_count - 1].end = end;
+
+    obj_job_t job = {chunks, 0, NULL, 0};
+    parallel_for((int)chunk_count, threads, obj_count_task, &job);
+
+    // where every chunk writes its vertices
+    size_t vertex_total = 0, edge_total = 0;
+    int face_total = 0;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        chunks[i].vertex_first = (int)vertex_total;
+        vertex_total += chunks[i].vertex_count;
+        edge_total += chunks[i].edge_count;
+        face_total += chunks[i].face_count;
+        if (vertex_total > INT_MAX)
+            goto fail;
+    }
+
+    // in a closed mesh every edge is on two faces, sizing for that saves growing the table while merging
+    obj = object3d_create((int)vertex_total, 0);
+    if (!obj || edge_merge_reserve(&merge, edge_total / 2 < INT_MAX ? edge_total / 2 : INT_MAX) != 0)
+        goto fail;
+
+    // parse a chunk per thread at a time, then merge their edges in file order
+    job.vertices = obj->vertices;
+    job.vertex_total = (int)vertex_total;
+    for (job.first = 0; job.first < chunk_count; job.first += threads)
+    {
+        size_t wave = chunk_count - job.first < (size_t)threads ? chunk_count - job.first : (size_t)threads;
+        parallel_for((int)wave, threads, obj_parse_task, &job);
+        for (size_t i = job.first; i < job.first + wave; i++)
+        {
+            if (chunks[i].error || edge_merge_add(&merge, &chunks[i].edges) != 0)
+                goto fail;
+            free(chunks[i].edges.keys);
+            chunks[i].edges.keys = NULL;
+        }
+    }
+    int duplicates = merge.duplicates;
+    edge_merge_finish(&merge, obj);
+    object3d_compute_bounds(obj);
+
+    finish_stats(stats, obj, file.size, face_total, duplicates, threads, start);
+    free(chunks);
+    unmap_file(&file);
+    return obj;
+
+fail:
+    object3d_destroy(obj);
+    edge_merge_free(&merge);
+    for (size_t i = 0; chunks && i < chunk_count; i++)
+        free(chunks[i].edges.keys);
+    free(chunks);
+    unmap_file(&file);
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// PLY
+
+// scalar types of PLY properties
+typedef enum
+{
+    PLY_NONE,
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+} ply_type_t;
+
+static const int ply_type_size[] = {0, 1, 1, 2, 2, 4, 4, 4, 8};
+
+typedef struct
+{
+    char name[32];
+    ply_type_t type;       // the value type (the item type for lists)
+    ply_type_t count_type; // PLY_NONE for scalars
+} ply_property_t;
+
+typedef struct
+{
+    char name[32];
+    long long count;
+    ply_property_t properties[PLY_MAX_PROPERTIES];
+    int property_count;
+} ply_element_t;
+
+// the header of a PLY file
+typedef struct
+{
+    int big_endian;
+    ply_element_t elements[PLY_MAX_ELEMENTS];
+    int element_count;
+    size_t body; // offset of the binary data
+} ply_header_t;
+
+// shared state of the vertex conversion
+typedef struct
+{
+    const unsigned char *data; // first vertex
+    size_t stride;             // bytes per vertex
+    size_t offset[3];          // of x, y and z in a vertex
+    ply_type_t type[3];
+    int swap;                  // the file has the other byte order
+    vec3f_t *vertices;
+    int count;
+} ply_vertex_job_t;
+
+static ply_type_t ply_parse_type(const char *s, size_t n)
+{
+    static const struct
+    {
+        const char *name;
+        ply_type_t type;
+    } names[] = {{"char", PLY_INT8}, {"int8", PLY_INT8}, {"uchar", PLY_UINT8}, {"uint8", PLY_UINT8},
+                 {"short", PLY_INT16}, {"int16", PLY_INT16}, {"ushort", PLY_UINT16}, {"uint16", PLY_UINT16},
+                 {"int", PLY_INT32}, {"int32", PLY_INT32}, {"uint", PLY_UINT32}, {"uint32", PLY_UINT32},
+                 {"float", PLY_FLOAT32}, {"float32", PLY_FLOAT32}, {"double", PLY_FLOAT64}, {"float64", PLY_FLOAT64}};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (strlen(names[i].name) == n && memcmp(names[i].name, s, n) == 0)
+            return names[i].type;
+    }
+    return PLY_NONE;
+}
+
+// true if the token [s, s + n) is word
+static int token_is(const char *s, size_t n, const char *word)
+{
+    return strlen(word) == n && memcmp(s, word, n) == 0;
+}
+
+// copy a token into a name field
+static void copy_name(char *dst, const char *s, size_t n)
+{
+    if (n > 31)
+        n = 31;
+    memcpy(dst, s, n);
+    dst[n] = 0;
+}
+
+// read the header, returns 0 on success and -1 if it is not a binary PLY header
+static int ply_parse_header(const char *data, size_t size, ply_header_t *header)
+{
+    memset(header, 0, sizeof(*header));
+    const char *end = data + size;
+    const char *p = data;
+    int format = 0;
+    int first = 1;
+    while (p < end)
+    {
+        const char *eol = find_line_end(p, end);
+        const char *tokens[6];
+        size_t lengths[6];
+        int count = 0;
+        for (const char *q = skip_blanks(p, eol); q < eol && count < 6; q = skip_blanks(q, eol))
+        {
+            tokens[count] = q;
+            q = skip_token(q, eol);
+            lengths[count] = q - tokens[count];
+            count++;
+        }
+        p = eol + 1;
+
+        if (first)
+        {
+            if (count != 1 || !token_is(tokens[0], lengths[0], "ply"))
+                return -1;
+            first = 0;
+            continue;
+        }
+        if (count == 0)
+            continue;
+
+        if (token_is(tokens[0], lengths[0], "end_header"))
+        {
+            header->body = p - data;
+            return format && p <= end ? 0 : -1;
+        }
+        else if (token_is(tokens[0], lengths[0], "format") && count >= 2)
+        {
+            if (token_is(tokens[1], lengths[1], "binary_little_endian"))
+                header->big_endian = 0;
+            else if (token_is(tokens[1], lengths[1], "binary_big_endian"))
+                header->big_endian = 1;
+            else
+                return -1; // ascii files are not supported
+            format = 1;
+        }
+        else if (token_is(tokens[0], lengths[0], "element") && count >= 3)
+        {
+            if (header->element_count == PLY_MAX_ELEMENTS)
+                return -1;
+            ply_element_t *element = &header->elements[header->element_count++];
+            copy_name(element->name, tokens[1], lengths[1]);
+            element->count = strtoll(tokens[2], NULL, 10);
+            if (element->count < 0)
+                return -1;
+        }
+        else if (token_is(tokens[0], lengths[0], "property") && count >= 3)
+        {
+            if (header->element_count == 0)
+                return -1;
+            ply_element_t *element = &header->elements[header->element_count - 1];
+            if (element->property_count == PLY_MAX_PROPERTIES)
+                return -1;
+            ply_property_t *property = &element->properties[element->property_count++];
+            if (token_is(tokens[1], lengths[1], "list"))
+            {
+                if (count < 5)
+                    return -1;
+                property->count_type = ply_parse_type(tokens[2], lengths[2]);
+                property->type = ply_parse_type(tokens[3], lengths[3]);
+                copy_name(property->name, tokens[4], lengths[4]);
+                if (property->count_type == PLY_NONE || property->count_type == PLY_FLOAT32 ||
+                    property->count_type == PLY_FLOAT64)
+                    return -1;
+            }
+            else
+            {
+                property->count_type = PLY_NONE;
+                property->type = ply_parse_type(tokens[1], lengths[1]);
+                copy_name(property->name, tokens[2], lengths[2]);
+            }
+            if (property->type == PLY_NONE)
+                return -1;
+        }
+        // comment and obj_info lines are skipped
+    }
+    return -1;
+}
+
+// read a value of type at p, swapping the bytes if the file has the other byte order
+static inline double ply_read(const unsigned char *p, ply_type_t type, int swap)
+{
+    unsigned char b[8];
+    int size = ply_type_size[type];
+    for (int i = 0; i < size; i++)
+        b[i] = swap ? p[size - 1 - i] : p[i];
+
+    switch (type)
+    {
+    case PLY_INT8:
+        return (double)(int8_t)b[0];
+    case PLY_UINT8:
+        return (double)b[0];
+    case PLY_INT16:
+    {
+        int16_t v;
+        memcpy(&v, b, 2);
+        return v;
+    }
+    case PLY_UINT16:
+    {
+        uint16_t v;
+        memcpy(&v, b, 2);
+        return v;
+    }
+    case PLY_INT32:
+    {
+        int32_t v;
+        memcpy(&v, b, 4);
+        return v;
+    }
+    case PLY_UINT32:
+    {
+        uint32_t v;
+        memcpy(&v, b, 4);
+        return v;
+    }
+    case PLY_FLOAT32:
+    {
+        float v;
+        memcpy(&v, b, 4);
+        return v;
+    }
+    case PLY_FLOAT64:
+    {
+        double v;
+        memcpy(&v, b, 8);
+        return v;
+    }
+    default:
+        return 0.0;
+    }
+}
+
+// read an integer value (list counts and indices) without going through double
+static inline long long ply_read_int(const unsigned char *p, ply_type_t type, int swap)
+{
+    switch (type)
+    {
+    case PLY_INT8:
+        return (int8_t)p[0];
+    case PLY_UINT8:
+        return p[0];
+    case PLY_INT16:
+    case PLY_UINT16:
+    {
+        uint16_t v;
+        memcpy(&v, p, 2);
+        if (swap)
+            v = __builtin_bswap16(v);
+        return type == PLY_INT16 ? (long long)(int16_t)v : (long long)v;
+    }
+    case PLY_INT32:
+    case PLY_UINT32:
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        if (swap)
+            v = __builtin_bswap32(v);
+        return type == PLY_INT32 ? (long long)(int32_t)v : (long long)v;
+    }
+    default:
+        return (long long)ply_read(p, type, swap);
+    }
+}
+
+// walk over one property at p, returns the position after it or NULL if it runs past end
+static const unsigned char *ply_skip_property(const ply_property_t *property, const unsigned char *p,
+                                              const unsigned char *end, int swap)
+{
+    size_t size = ply_type_size[property->type];
+    if (property->count_type != PLY_NONE)
+    {
+        size_t count_size = ply_type_size[property->count_type];
+        if ((size_t)(end - p) < count_size)
+            return NULL;
+        long long count = ply_read_int(p, property->count_type, swap);
+        p += count_size;
+        if (count < 0 || (size_t)(end - p) / size < (size_t)count)
+            return NULL;
+        size *= (size_t)count;
+    }
+    if ((size_t)(end - p) < size)
+        return NULL;
+    return p + size;
+}
+
+// walk over one item of element at p
+static const unsigned char *ply_skip_item(const ply_element_t *element, const unsigned char *p,
+                                          const unsigned char *end, int swap)
+{
+    for (int i = 0; i < element->property_count && p; i++)
+        p = ply_skip_property(&element->properties[i], p, end, swap);
+    return p;
+}
+
+// convert a block of vertices
+static void ply_vertex_task(int index, void *user)
+{
+    ply_vertex_job_t *job = (ply_vertex_job_t *)user;
+    int begin = index * PLY_VERTEX_BLOCK;
+    int end = begin + PLY_VERTEX_BLOCK < job->count ? begin + PLY_VERTEX_BLOCK : job->count;
+    for (int i = begin; i < end; i++)
+    {
+        const unsigned char *v = job->data + (size_t)i * job->stride;
+        job->vertices[i] = vec3f_create((float)ply_read(v + job->offset[0], job->type[0], job->swap),
+                                        (float)ply_read(v + job->offset[1], job->type[1], job->swap),
+                                        (float)ply_read(v + job->offset[2], job->type[2], job->swap));
+    }
+}
+
+// read the vertices, they have a fixed size so the blocks are converted in parallel
+// returns the size of all the vertices in bytes or 0 if they are not valid
+static size_t ply_read_vertices(const ply_element_t *element, const unsigned char *data, const unsigned char *end,
+                                int swap, int num_threads, object3d_t *obj)
+{
+    ply_vertex_job_t job;
+    job.data = data;
+    job.stride = 0;
+    job.swap = swap;
+    job.vertices = obj->vertices;
+    job.count = obj->vertex_count;
+
+    int found = 0;
+    for (int i = 0; i < element->property_count; i++)
+    {
+        const ply_property_t *property = &element->properties[i];
+        if (property->count_type != PLY_NONE)
+            return 0; // lists in vertices are not supported
+        int axis = token_is(property->name, strlen(property->name), "x")   ? 0
+                   : token_is(property->name, strlen(property->name), "y") ? 1
+                   : token_is(property->name, strlen(property->name), "z") ? 2
+                                                                           : -1;
+        if (axis >= 0)
+        {
+            job.offset[axis] = job.stride;
+            job.type[axis] = property->type;
+            found |= 1 << axis;
+        }
+        job.stride += ply_type_size[property->type];
+    }
+    if (found != 7 || (size_t)(end - data) / job.stride < (size_t)element->count)
+        return 0;
+
+    int blocks = (job.count + PLY_VERTEX_BLOCK - 1) / PLY_VERTEX_BLOCK;
+    parallel_for(blocks, num_threads, ply_vertex_task, &job);
+    return job.stride * (size_t)element->count;
+}
+
+// walk face_count faces, counts the edges if edges is NULL and writes them otherwise
+// returns the position after the faces or NULL if the data is not valid
+static const unsigned char *ply_read_faces(const ply_element_t *element, int list, const unsigned char *p,
+                                           const unsigned char *end, int swap, int vertex_count,
+                                           long long face_count, uint64_t *edges, size_t *edge_count)
+{
+    size_t written = 0;
+    for (long long f = 0; f < face_count; f++)
+    {
+        for (int i = 0; i < element->property_count; i++)
+        {
+            const ply_property_t *property = &element->properties[i];
+            if (i != list)
+            {
+                p = ply_skip_property(property, p, end, swap);
+                if (!p)
+                    return NULL;
+                continue;
+            }
+
+            size_t count_size = ply_type_size[property->count_type];
+            size_t size = ply_type_size[property->type];
+            if ((size_t)(end - p) < count_size)
+                return NULL;
+            long long count_value = ply_read_int(p, property->count_type, swap);
+            p += count_size;
+            if (count_value < 0 || (size_t)(end - p) / size < (size_t)count_value)
+                return NULL;
+            size_t count = (size_t)count_value;
+
+            if (!edges)
+            {
+                written += obj_edge_count('f', count);
+            }
+            else
+            {
+                // connect every vertex to the one before it, and close the face
+                int first = 0, prev = 0;
+                for (size_t k = 0; k < count; k++)
+                {
+                    long long v = ply_read_int(p + k * size, property->type, swap);
+                    if (v < 0 || v >= vertex_count)
+                        return NULL;
+                    if (k > 0)
+                        edges[written++] = edge_key(prev, (int)v);
+                    else
+                        first = (int)v;
+                    prev = (int)v;
+                }
+                if (count >= 3)
+                    edges[written++] = edge_key(prev, first);
+            }
+            p += count * size;
+        }
+    }
+    *edge_count = written;
+    return p;
+}
+
+// PLY_FACE_BLOCK faces (fewer in the last block)
+typedef struct
+{
+    const unsigned char *begin;
+    long long face_count;
+    size_t edge_count; // before deduplication
+    edge_piece_t edges;
+} ply_face_block_t;
+
+// shared state of the face reading
+typedef struct
+{
+    const ply_element_t *element;
+    int list; // the vertex index property
+    const unsigned char *end;
+    int swap;
+    int vertex_count;
+    ply_face_block_t *blocks;
+    size_t first; // block of task 0
+} ply_face_job_t;
+
+// read the edges of a block and drop its repeated edges
+static void ply_face_task(int index, void *user)
+{
+    ply_face_job_t *job = (ply_face_job_t *)user;
+    ply_face_block_t *block = &job->blocks[job->first + index];
+    block->edges.keys = (uint64_t *)malloc((block->edge_count ? block->edge_count : 1) * sizeof(uint64_t));
+    if (!block->edges.keys ||
+        !ply_read_faces(job->element, job->list, block->begin, job->end, job->swap, job->vertex_count,
+                        block->face_count, block->edges.keys, &block->edges.count) ||
+        edge_piece_dedupe(&block->edges) != 0)
+        block->edges.error = 1;
+}
+
+// read the edges of the faces into merge
+// the faces have different sizes, so one walk finds where the blocks start (and checks the sizes),
+// then a block per thread at a time is read and deduplicated and the blocks are merged in file order
+// returns the position after the faces or NULL if they are not valid
+static const unsigned char *ply_read_face_blocks(const ply_element_t *element, int list, const unsigned char *p,
+                                                 const unsigned char *end, int swap, int num_threads,
+                                                 int vertex_count, edge_merge_t *merge)
+{
+    size_t block_count = (size_t)((element->count + PLY_FACE_BLOCK - 1) / PLY_FACE_BLOCK);
+    if (block_count == 0)
+        return p;
+    if (block_count > INT_MAX)
+        return NULL;
+    ply_face_block_t *blocks = (ply_face_block_t *)calloc(block_count, sizeof(ply_face_block_t));
+    if (!blocks)
+        return NULL;
+
+    size_t edge_total = 0;
+    for (size_t b = 0; b < block_count && p; b++)
+    {
+        long long left = element->count - (long long)b * PLY_FACE_BLOCK;
+        blocks[b].begin = p;
+        blocks[b].face_count = left < PLY_FACE_BLOCK ? left : PLY_FACE_BLOCK;
+        p = ply_read_faces(element, list, p, end, swap, vertex_count, blocks[b].face_count, NULL, &blocks[b].edge_count);
+        edge_total += blocks[b].edge_count;
+    }
+    // sized for a closed mesh like the OBJ loader
+    if (p && edge_merge_reserve(merge, edge_total / 2 < INT_MAX ? edge_total / 2 : INT_MAX) != 0)
+        p = NULL;
+
+    int threads = block_count < (size_t)num_threads ? (int)block_count : num_threads;
+    ply_face_job_t job = {element, list, end, swap, vertex_count, blocks, 0};
+    for (; p && job.first < block_count; job.first += threads)
+    {
+        size_t wave = block_count - job.first < (size_t)threads ? block_count - job.first : (size_t)threads;
+        parallel_for((int)wave, threads, ply_face_task, &job);
+        for (size_t b = job.first; b < job.first + wave && p; b++)
+        {
+            if (blocks[b].edges.error || edge_merge_add(merge, &blocks[b].edges) != 0)
+                p = NULL;
+        }
+        for (size_t b = job.first; b < job.first + wave; b++)
+        {
+            free(blocks[b].edges.keys);
+            blocks[b].edges.keys = NULL;
+        }
+    }
+    free(blocks);
+    return p;
+}
+
+// Load a binary PLY file
+object3d_t *mesh_load_ply(const char *filename, int num_threads, mesh_load_stats_t *stats)
+{
+    double start = parallel_time_seconds();
+    mapped_file_t file;
+    if (!filename || map_file(filename, &file, 0) != 0)
+        return NULL;
+
+    if (num_threads <= 0)
+        num_threads = parallel_thread_count();
+
+    object3d_t *obj = NULL;
+    edge_merge_t merge = {0};
+    int faces_read = 0;
+    ply_header_t header;
+    if (ply_parse_header(file.data, file.size, &header) != 0)
+        goto fail;
+
+    // the byte order of this machine
+    const uint16_t one = 1;
+    int little_endian = *(const unsigned char *)&one == 1;
+    int swap = header.big_endian == little_endian;
+
+    const ply_element_t *vertex_element = NULL;
+    for (int e = 0; e < header.element_count; e++)
+    {
+        if (strcmp(header.elements[e].name, "vertex") == 0)
+            vertex_element = &header.elements[e];
+    }
+    if (!vertex_element || vertex_element->count > INT_MAX)
+        goto fail;
+    obj = object3d_create((int)vertex_element->count, 0);
+    if (!obj)
+        goto fail;
+
+    // the elements are stored one after the other
+    const unsigned char *p = (const unsigned char *)file.data + header.body;
+    const unsigned char *end = (const unsigned char *)file.data + file.size;
+    int face_total = 0;
+    for (int e = 0; e < header.element_count; e++)
+    {
+        const ply_element_t *element = &header.elements[e];
+        int list = -1;
+        for (int i = 0; i < element->property_count; i++)
+        {
+            const char *name = element->properties[i].name;
+            if (element->properties[i].count_type != PLY_NONE &&
+                (strcmp(name, "vertex_indices") == 0 || strcmp(name, "vertex_index") == 0))
+                list = i;
+        }
+
+        if (element == vertex_element)
+        {
+            size_t size = ply_read_vertices(element, p, end, swap, num_threads, obj);
+            if (size == 0 && element->count > 0)
+                goto fail;
+            p += size;
+        }
+        else if (strcmp(element->name, "face") == 0 && list >= 0 && !faces_read)
+        {
+            p = ply_read_face_blocks(element, list, p, end, swap, num_threads, obj->vertex_count, &merge);
+            if (!p)
+                goto fail;
+            faces_read = 1;
+            face_total = element->count > INT_MAX ? INT_MAX : (int)element->count;
+        }
+        else
+        {
+            for (long long i = 0; i < element->count && p; i++)
+                p = ply_skip_item(element, p, end, swap);
+            if (!p)
+                goto fail;
+        }
+    }
+
+    int duplicates = merge.duplicates;
+    edge_merge_finish(&merge, obj);
+    object3d_compute_bounds(obj);
+
+    // the threads of the larger of the vertex and face passes
+    int blocks = (obj->vertex_count + PLY_VERTEX_BLOCK - 1) / PLY_VERTEX_BLOCK;
+    int face_blocks = (int)(((long long)face_total + PLY_FACE_BLOCK - 1) / PLY_FACE_BLOCK);
+    if (face_blocks > blocks)
+        blocks = face_blocks;
+    int threads = blocks < 1 ? 1 : blocks < num_threads ? blocks : num_threads;
+    finish_stats(stats, obj, file.size, face_total, duplicates, threads, start);
+    unmap_file(&file);
+    return obj;
+
+fail:
+    object3d_destroy(obj);
+    edge_merge_free(&merge);
+    unmap_file(&file);
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// t3d
+
+// the header layout is part of the format
+typedef char t3d_header_size_check[sizeof(t3d_header_t) == 128 ? 1 : -1];
+
+// round up to the block alignment
+static uint64_t t3d_align(uint64_t offset)
+{
+    return (offset + T3D_ALIGNMENT - 1) & ~(uint64_t)(T3D_ALIGNMENT - 1);
+}
+
+// 1 if this machine stores numbers little endian like the file
+static int t3d_host_little_endian(void)
+{
+    const uint16_t one = 1;
+    return *(const unsigned char *)&one == 1;
+}
+
+// write count zero bytes
+static int write_zeros(FILE *f, size_t count)
+{
+    static const char zeros[T3D_ALIGNMENT] = {0};
+    while (count > 0)
+    {
+        size_t n = count < sizeof(zeros) ? count : sizeof(zeros);
+        if (fwrite(zeros, 1, n, f) != n)
+            return -1;
+        count -= n;
+    }
+    return 0;
+}
+
+// Save a .t3d file
+int mesh_save_t3d(const object3d_t *obj, const char *filename)
+{
+    if (!obj || !filename || obj->vertex_count < 0 || obj->edge_count < 0 || !t3d_host_little_endian())
+        return -1;
+
+    t3d_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, T3D_MAGIC, 4);
+    header.version = T3D_VERSION;
+    header.header_size = sizeof(t3d_header_t);
+    header.vertex_count = (uint32_t)obj->vertex_count;
+    header.edge_count = (uint32_t)obj->edge_count;
+    header.vertex_offset = t3d_align(sizeof(t3d_header_t));
+    header.edge_offset = t3d_align(header.vertex_offset + (uint64_t)obj->vertex_count * sizeof(vec3f_t));
+    size_t edge_size = obj->edges16 ? sizeof(uint16_t[2]) : sizeof(int[2]);
+    const void *edges = obj->edges16 ? (const void *)obj->edges16 : (const void *)obj->edges;
+    if (obj->edges16)
+        header.flags |= T3D_FLAG_INDEX16;
+    else if (obj->edge_count > 0 && !obj->edges)
+        return -1;
+    header.file_size = header.edge_offset + (uint64_t)obj->edge_count * edge_size;
+    if (obj->has_bounds)
+    {
+        header.flags |= T3D_FLAG_BOUNDS;
+        memcpy(header.bounds_min, &obj->bounds_min, sizeof(header.bounds_min));
+        memcpy(header.bounds_max, &obj->bounds_max, sizeof(header.bounds_max));
+        memcpy(header.bounds_center, &obj->bounds_center, sizeof(header.bounds_center));
+        header.bounds_radius = obj->bounds_radius;
+    }
+
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+        return -1;
+
+    size_t vertex_bytes = (size_t)obj->vertex_count * sizeof(vec3f_t);
+    size_t edge_bytes = (size_t)obj->edge_count * edge_size;
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+             write_zeros(f, header.vertex_offset - sizeof(header)) == 0 &&
+             fwrite(obj->vertices, 1, vertex_bytes, f) == vertex_bytes &&
+             write_zeros(f, header.edge_offset - header.vertex_offset - vertex_bytes) == 0 &&
+             fwrite(edges, 1, edge_bytes, f) == edge_bytes;
+    if (fclose(f) != 0)
+        ok = 0;
+    return ok ? 0 : -1;
+}
+
+// unmap the file of a .t3d object
+static void t3d_release(void *owner)
+{
+    mapped_file_t *file = (mapped_file_t *)owner;
+    unmap_file(file);
+    free(file);
+}
+
+// Map a .t3d file
+object3d_t *mesh_load_t3d(const char *filename, int verify, mesh_load_stats_t *stats)
+{
+    double start = parallel_time_seconds();
+    if (!filename || !t3d_host_little_endian())
+        return NULL;
+
+    mapped_file_t *file = (mapped_file_t *)malloc(sizeof(mapped_file_t));
+    if (!file)
+        return NULL;
+    if (map_file(filename, file, 1) != 0)
+    {
+        free(file);
+        return NULL;
+    }
+
+    // the header has to describe blocks that are inside the file and aligned
+    t3d_header_t header;
+    object3d_t *obj = NULL;
+    if (file->size < sizeof(header))
+        goto fail;
+    memcpy(&header, file->data, sizeof(header));
+    if (memcmp(header.magic, T3D_MAGIC, 4) != 0 || header.version != T3D_VERSION ||
+        header.header_size != sizeof(header) || header.file_size != file->size ||
+        header.vertex_count > INT_MAX || header.edge_count > INT_MAX ||
+        header.vertex_offset % T3D_ALIGNMENT != 0 || header.edge_offset % T3D_ALIGNMENT != 0 ||
+        header.vertex_offset < sizeof(header) ||
+        header.vertex_offset + (uint64_t)header.vertex_count * sizeof(vec3f_t) > header.edge_offset)
+        goto fail;
+    int index16 = (header.flags & T3D_FLAG_INDEX16) != 0;
+    size_t edge_size = index16 ? sizeof(uint16_t[2]) : sizeof(int[2]);
+    if (header.edge_offset + (uint64_t)header.edge_count * edge_size > file->size ||
+        (index16 && header.vertex_count > 65536))
+        goto fail;
+
+    obj = (object3d_t *)calloc(1, sizeof(object3d_t));
+    if (!obj)
+        goto fail;
+    char *base = (char *)file->data;
+    obj->vertices = header.vertex_count ? (vec3f_t *)(base + header.vertex_offset) : NULL;
+    if (header.edge_count && index16)
+        obj->edges16 = (uint16_t (*)[2])(base + header.edge_offset);
+    else if (header.edge_count)
+        obj->edges = (int (*)[2])(base + header.edge_offset);
+    obj->vertex_count = (int)header.vertex_count;
+    obj->edge_count = (int)header.edge_count;
+
+    if (verify)
+    {
+        for (int i = 0; i < obj->edge_count; i++)
+        {
+            unsigned a = index16 ? obj->edges16[i][0] : (unsigned)obj->edges[i][0];
+            unsigned b = index16 ? obj->edges16[i][1] : (unsigned)obj->edges[i][1];
+            if (a >= header.vertex_count || b >= header.vertex_count)
+                goto fail;
+        }
+    }
+
+    if (header.flags & T3D_FLAG_BOUNDS)
+    {
+        obj->has_bounds = 1;
+        obj->bounds_min = vec3f_create(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+        obj->bounds_max = vec3f_create(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+        obj->bounds_center = vec3f_create(header.bounds_center[0], header.bounds_center[1], header.bounds_center[2]);
+        obj->bounds_radius = header.bounds_radius;
+    }
+    obj->owner = file;
+    obj->release = t3d_release;
+
+    finish_stats(stats, obj, file->size, 0, 0, 1, start);
+    return obj;
+
+fail:
+    free(obj);
+    t3d_release(file);
+    return NULL;
+}
+
+// Load a mesh by extension
+object3d_t *mesh_load(const char *filename, int num_threads, mesh_load_stats_t *stats)
+{
+    if (!filename)
+        return NULL;
+
+    const char *dot = strrchr(filename, '.');
+    if (!dot)
+        return NULL;
+
+    // compare the extension without case
+    char ext[8] = {0};
+    for (int i = 0; i < 7 && dot[i + 1]; i++)
+        ext[i] = (dot[i + 1] >= 'A' && dot[i + 1] <= 'Z') ? dot[i + 1] - 'A' + 'a' : dot[i + 1];
+
+    if (strcmp(ext, "obj") == 0)
+        return mesh_load_obj(filename, num_threads, stats);
+    if (strcmp(ext, "ply") == 0)
+        return mesh_load_ply(filename, num_threads, stats);
+    if (strcmp(ext, "t3d") == 0)
+        return mesh_load_t3d(filename, 1, stats);
+    return NULL;
+}
@@ -0,0 +1,353 @@
+#include "mesh_opt.h"
+#include "edge_set.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bits of every axis in a Morton key (3 * 21 = 63 bits)
+#define MORTON_BITS 21
+
+// digit size of the key sort
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+// spread the low 21 bits of v so there are two zero bits between them
+static uint64_t morton_spread(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+// position of v in the box quantized to MORTON_BITS per axis
+static uint64_t morton_key(vec3f_t v, vec3f_t lo, vec3f_t scale)
+{
+    const float max = (float)((1 << MORTON_BITS) - 1);
+    float q[3] = {(v.x - lo.x) * scale.x, (v.y - lo.y) * scale.y, (v.z - lo.z) * scale.z};
+    uint64_t c[3];
+    for (int i = 0; i < 3; i++)
+    {
+        // NaN and values outside the box go to the ends
+        float f = q[i] > 0.0f ? (q[i] < max ? q[i] : max) : 0.0f;
+        c[i] = (uint64_t)f;
+    }
+    return morton_spread(c[0]) | morton_spread(c[1]) << 1 | morton_spread(c[2]) << 2;
+}
+
+// stable LSD radix sort of order by keys, passes where every key has the same digit are skipped
+static int sort_by_key(uint64_t *keys, int *order, int count, int key_bits)
+{
+    uint64_t *keys_tmp = (uint64_t *)malloc((size_t)count * sizeof(uint64_t));
+    int *order_tmp = (int *)malloc((size_t)count * sizeof(int));
+    size_t *histogram = (size_t *)malloc(RADIX_SIZE * sizeof(size_t));
+    if (!keys_tmp || !order_tmp || !histogram)
+    {
+        free(keys_tmp);
+        free(order_tmp);
+        free(histogram);
+        return -1;
+    }
+
+    for (int shift = 0; shift < key_bits; shift += RADIX_BITS)
+    {
+        memset(histogram, 0, RADIX_SIZE * sizeof(size_t));
+        for (int i = 0; i < count; i++)
+            histogram[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+        if (histogram[(keys[0] >> shift) & (RADIX_SIZE - 1)] == (size_t)count)
+            continue;
+
+        size_t sum = 0;
+        for (int d = 0; d < RADIX_SIZE; d++)
+        {
+            size_t n = histogram[d];
+            histogram[d] = sum;
+            sum += n;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            size_t slot = histogram[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+            keys_tmp[slot] = keys[i];
+            order_tmp[slot] = order[i];
+        }
+        memcpy(keys, keys_tmp, (size_t)count * sizeof(uint64_t));
+        memcpy(order, order_tmp, (size_t)count * sizeof(int));
+    }
+
+    free(keys_tmp);
+    free(order_tmp);
+    free(histogram);
+    return 0;
+}
+
+// Renumber the vertices and sort the edges
+int mesh_optimize_locality(object3d_t *obj)
+{
+    if (!obj)
+        return -1;
+    int n = obj->vertex_count;
+    int m = obj->edge_count;
+    if (m > 0 && !obj->edges && !obj->edges16)
+        return -1;
+    if (n <= 1)
+        return 0;
+    if (!obj->has_bounds)
+        object3d_compute_bounds(obj);
+
+    uint64_t *keys = (uint64_t *)malloc((size_t)(n > m ? n : m) * sizeof(uint64_t));
+    int *order = (int *)malloc((size_t)(n > m ? n : m) * sizeof(int));
+    int *remap = (int *)malloc((size_t)n * sizeof(int));
+
+    // scratch for the old vertices and then the old edges
+    size_t scratch_size = (size_t)n * sizeof(vec3f_t);
+    if (scratch_size < (size_t)m * sizeof(int[2]))
+        scratch_size = (size_t)m * sizeof(int[2]);
+    void *scratch = malloc(scratch_size);
+    if (!keys || !order || !remap || !scratch)
+        goto fail;
+
+    // vertices in Morton order of their place in the bounding box
+    vec3f_t lo = obj->bounds_min;
+    vec3f_t size = vec3f_sub(obj->bounds_max, obj->bounds_min);
+    const float cells = (float)(1 << MORTON_BITS);
+    vec3f_t scale = vec3f_create(size.x > 0.0f ? cells / size.x : 0.0f,
+                                 size.y > 0.0f ? cells / size.y : 0.0f,
+                                 size.z > 0.0f ? cells / size.z : 0.0f);
+    for (int i = 0; i < n; i++)
+    {
+        keys[i] = morton_key(obj->vertices[i], lo, scale);
+        order[i] = i;
+    }
+    if (sort_by_key(keys, order, n, 3 * MORTON_BITS) != 0)
+        goto fail;
+
+    // order[new] = old, so remap[old] = new
+    vec3f_t *vertices = (vec3f_t *)scratch;
+    memcpy(vertices, obj->vertices, (size_t)n * sizeof(vec3f_t));
+    for (int i = 0; i < n; i++)
+    {
+        obj->vertices[i] = vertices[order[i]];
+        remap[order[i]] = i;
+    }
+
+    // renumber the edges and sort them by (lower vertex, higher vertex), the direction stays the same
+    for (int j = 0; j < m; j++)
+    {
+        uint64_t a = 0, b = 0;
+        if (obj->edges16)
+        {
+            obj->edges16[j][0] = (uint16_t)remap[obj->edges16[j][0]];
+            obj->edges16[j][1] = (uint16_t)remap[obj->edges16[j][1]];
+            a = obj->edges16[j][0];
+            b = obj->edges16[j][1];
+        }
+        if (obj->edges)
+        {
+            obj->edges[j][0] = remap[obj->edges[j][0]];
+            obj->edges[j][1] = remap[obj->edges[j][1]];
+            a = (uint64_t)obj->edges[j][0];
+            b = (uint64_t)obj->edges[j][1];
+        }
+        keys[j] = a < b ? a << 32 | b : b << 32 | a;
+        order[j] = j;
+    }
+    int vertex_bits = 1;
+    while (vertex_bits < 32 && (1u << vertex_bits) < (unsigned)n)
+        vertex_bits++;
+    for (int j = 0; j < m; j++)
+    {
+        // pack the two indices next to each other so the sort only looks at the bits that are used
+        keys[j] = (keys[j] >> 32) << vertex_bits | (keys[j] & 0xffffffffu);
+    }
+    if (m > 0 && sort_by_key(keys, order, m, 2 * vertex_bits) != 0)
+        goto fail;
+
+    // apply the edge order
+    if (obj->edges)
+    {
+        int (*tmp)[2] = (int (*)[2])scratch;
+        memcpy(tmp, obj->edges, (size_t)m * sizeof(int[2]));
+        for (int j = 0; j < m; j++)
+        {
+            obj->edges[j][0] = tmp[order[j]][0];
+            obj->edges[j][1] = tmp[order[j]][1];
+        }
+    }
+    if (obj->edges16)
+    {
+        uint16_t (*tmp16)[2] = (uint16_t (*)[2])scratch;
+        memcpy(tmp16, obj->edges16, (size_t)m * sizeof(uint16_t[2]));
+        for (int j = 0; j < m; j++)
+        {
+            obj->edges16[j][0] = tmp16[order[j]][0];
+            obj->edges16[j][1] = tmp16[order[j]][1];
+        }
+    }
+
+    free(keys);
+    free(order);
+    free(remap);
+    free(scratch);
+    return 0;
+
+fail:
+    free(keys);
+    free(order);
+    free(remap);
+    free(scratch);
+    return -1;
+}
+
+// Build the 16 bit edges
+int mesh_build_index16(object3d_t *obj, int drop_wide)
+{
+    if (!obj || obj->vertex_count > 65536)
+        return -1;
+
+    if (!obj->edges16 && obj->edge_count > 0)
+    {
+        if (!obj->edges)
+            return -1;
+        uint16_t (*edges16)[2] = (uint16_t (*)[2])malloc((size_t)obj->edge_count * sizeof(uint16_t[2]));
+        if (!edges16)
+            return -1;
+        for (int j = 0; j < obj->edge_count; j++)
+        {
+            edges16[j][0] = (uint16_t)obj->edges[j][0];
+            edges16[j][1] = (uint16_t)obj->edges[j][1];
+        }
+        obj->edges16 = edges16;
+        obj->edges16_owned = 1;
+    }
+
+    if (drop_wide && obj->edges16)
+    {
+        if (!obj->release)
+            free(obj->edges);
+        obj->edges = NULL;
+    }
+    return 0;
+}
+
+// get edge j of obj from the int or the 16 bit edges
+static inline void edge_get(const object3d_t *obj, int j, int *a, int *b)
+{
+    if (obj->edges16)
+    {
+        *a = obj->edges16[j][0];
+        *b = obj->edges16[j][1];
+    }
+    else
+    {
+        *a = obj->edges[j][0];
+        *b = obj->edges[j][1];
+    }
+}
+
+// Simplify by vertex clustering
+object3d_t *mesh_simplify_clusters(const object3d_t *obj, int grid)
+{
+    if (!obj || grid < 1 || grid > (1 << MORTON_BITS) || (obj->edge_count > 0 && !obj->edges && !obj->edges16))
+        return NULL;
+    int n = obj->vertex_count;
+    int m = obj->edge_count;
+
+    // the bounds of the source, without changing a const object
+    object3d_t bounds = *obj;
+    if (!bounds.has_bounds)
+        object3d_compute_bounds(&bounds);
+
+    object3d_t *result = NULL;
+    uint64_t *keys = (uint64_t *)malloc((size_t)(n > m ? n : m) * sizeof(uint64_t) + 1);
+    int *order = (int *)malloc((size_t)n * sizeof(int) + 1);
+    int *remap = (int *)malloc((size_t)n * sizeof(int) + 1);
+    int (*edges)[2] = (int (*)[2])malloc((size_t)m * sizeof(int[2]) + 1);
+    edge_set_t set = {0};
+    if (!keys || !order || !remap || !edges)
+        goto done;
+
+    // cell of every vertex, in Morton order so the new vertices are also cache friendly
+    vec3f_t lo = bounds.bounds_min;
+    vec3f_t size = vec3f_sub(bounds.bounds_max, bounds.bounds_min);
+    vec3f_t scale = vec3f_create(size.x > 0.0f ? grid / size.x : 0.0f,
+                                 size.y > 0.0f ? grid / size.y : 0.0f,
+                                 size.z > 0.0f ? grid / size.z : 0.0f);
+    for (int i = 0; i < n; i++)
+    {
+        vec3f_t v = obj->vertices[i];
+        float q[3] = {(v.x - lo.x) * scale.x, (v.y - lo.y) * scale.y, (v.z - lo.z) * scale.z};
+        uint64_t c[3];
+        for (int k = 0; k < 3; k++)
+        {
+            float f = q[k] > 0.0f ? (q[k] < grid - 1 ? q[k] : grid - 1) : 0.0f;
+            c[k] = (uint64_t)f;
+        }
+        keys[i] = morton_spread(c[0]) | morton_spread(c[1]) << 1 | morton_spread(c[2]) << 2;
+        order[i] = i;
+    }
+    int grid_bits = 1;
+    while ((1 << grid_bits) < grid)
+        grid_bits++;
+    if (n > 0 && sort_by_key(keys, order, n, 3 * grid_bits) != 0)
+        goto done;
+
+    // one new vertex per run of equal cells
+    int cluster_count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (i == 0 || keys[i] != keys[i - 1])
+            cluster_count++;
+        remap[order[i]] = cluster_count - 1;
+    }
+
+    // renumber the edges and drop the ones inside a cell and the repeated ones (hash set of the undirected keys)
+    if (edge_set_reserve(&set, (size_t)m) != 0)
+        goto done;
+
+    int edge_count = 0;
+    for (int j = 0; j < m; j++)
+    {
+        int a, b;
+        edge_get(obj, j, &a, &b);
+        a = remap[a];
+        b = remap[b];
+        if (a == b || !edge_set_insert(&set, edge_key(a, b)))
+            continue;
+        edges[edge_count][0] = a;
+        edges[edge_count][1] = b;
+        edge_count++;
+    }
+
+    result = object3d_create(cluster_count, edge_count);
+    if (!result)
+        goto done;
+
+    // average of the vertices of every cell
+    for (int i = 0, c = -1, count = 0; i < n; i++)
+    {
+        vec3f_t v = obj->vertices[order[i]];
+        if (remap[order[i]] != c)
+        {
+            c = remap[order[i]];
+            count = 0;
+            result->vertices[c] = vec3f_create(0.0f, 0.0f, 0.0f);
+        }
+        // running mean so a large cell does not lose precision
+        count++;
+        result->vertices[c] = vec3f_add(result->vertices[c], vec3f_scale(vec3f_sub(v, result->vertices[c]), 1.0f / count));
+    }
+    if (edge_count > 0)
+        memcpy(result->edges, edges, (size_t)edge_count * sizeof(int[2]));
+    object3d_compute_bounds(result);
+
+done:
+    free(keys);
+    free(order);
+    free(remap);
+    free(edges);
+    edge_set_free(&set);
+    return result;
+}
@@ -0,0 +1,165 @@
+#include "parallel.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <time.h>
+#endif
+
+// shared state of a parallel_for call
+typedef struct
+{
+    int count;
+    int next; // next index to run (taken with an atomic add)
+    parallel_task_fn task;
+    void *user;
+} parallel_job_t;
+
+// get the number of cores that are online
+int parallel_thread_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    // at least one thread
+    return count > 0 ? count : 1;
+}
+
+// keep taking indices until there are none left
+static void parallel_run(parallel_job_t *job)
+{
+    for (;;)
+    {
+        int index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->count)
+            break;
+        job->task(index, job->user);
+    }
+}
+
+// worker threads that are started once and wait for jobs, so parallel_for does not create threads per call
+// (the canvas_draw_lines of every frame goes through it)
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t wake;   // signaled when a job is posted
+    pthread_cond_t done;   // signaled when the last worker leaves the job
+    parallel_job_t *job;   // job being run (NULL when there is none)
+    unsigned generation;   // incremented for every job so a worker joins each job once
+    int wanted;            // workers the job still wants
+    int active;            // workers running the job
+    int size;              // worker threads started
+    int busy;              // a parallel_for call owns the pool
+} parallel_pool_t;
+
+static parallel_pool_t pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+
+static void *parallel_worker(void *arg)
+{
+    (void)arg;
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool.lock);
+    for (;;)
+    {
+        while (!pool.job || pool.wanted == 0 || pool.generation == seen)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        seen = pool.generation;
+        pool.wanted--;
+        pool.active++;
+        parallel_job_t *job = pool.job;
+        pthread_mutex_unlock(&pool.lock);
+
+        parallel_run(job);
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.active == 0)
+            pthread_cond_signal(&pool.done);
+    }
+    return NULL;
+}
+
+// start workers until the pool has count of them (called with the lock held), returns the pool size
+static int parallel_pool_grow(int count)
+{
+    if (count > PARALLEL_POOL_MAX)
+        count = PARALLEL_POOL_MAX;
+    while (pool.size < count)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, parallel_worker, NULL) != 0)
+            break;
+        pthread_detach(thread);
+        pool.size++;
+    }
+    return pool.size;
+}
+
+// Run the tasks on a group of threads
+void parallel_for(int count, int num_threads, parallel_task_fn task, void *user)
+{
+    if (count <= 0 || !task)
+        return;
+
+    if (num_threads <= 0)
+        num_threads = parallel_thread_count();
+    if (num_threads > count)
+        num_threads = count;
+
+    parallel_job_t job = {count, 0, task, user};
+
+    // the calling thread is the first worker, so one thread (or one task) needs no workers
+    if (num_threads <= 1)
+    {
+        parallel_run(&job);
+        return;
+    }
+
+    // the pool runs one job at a time, a nested or concurrent call runs its tasks on its own thread
+    pthread_mutex_lock(&pool.lock);
+    if (pool.busy)
+    {
+        pthread_mutex_unlock(&pool.lock);
+        parallel_run(&job);
+        return;
+    }
+    pool.busy = 1;
+    int helpers = parallel_pool_grow(num_threads - 1);
+    pool.wanted = helpers < num_threads - 1 ? helpers : num_threads - 1;
+    pool.job = &job;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    parallel_run(&job);
+
+    // job is on this stack, wait until no worker can still use it
+    pthread_mutex_lock(&pool.lock);
+    pool.job = NULL;
+    pool.wanted = 0;
+    while (pool.active > 0)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pool.busy = 0;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// read the monotonic clock
+double parallel_time_seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
@@ -0,0 +1,980 @@
+#include "canvas.h"
+#include "parallel.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Grayscale PNG writer with its own deflate: each band of rows is filtered and compressed on its own,
+// ends on a byte boundary with an empty stored block (a sync flush) and becomes one IDAT chunk,
+// the adler32 of the bands is combined at the end, so the bands can be encoded on different threads
+
+#define PNG_BAND_BYTES (256 * 1024) // filtered bytes per band (at least one row)
+
+#define WINDOW_SIZE 32768
+#define WINDOW_MASK (WINDOW_SIZE - 1)
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define BLOCK_TOKENS (1 << 15) // tokens per deflate block
+
+// how hard each level looks for matches
+typedef struct
+{
+    int max_chain;  // candidates tried per position
+    int nice;       // stop looking when a match is this long
+    int lazy;       // try the next position before taking a match
+    int max_insert; // longer matches do not add their positions to the hash (0 = always add them)
+} level_config_t;
+
+static const level_config_t level_configs[10] = {
+    {0, 0, 0, 0}, // stored
+    {1, 16, 0, 8},
+    {4, 32, 0, 16},
+    {8, 64, 0, 32},
+    {16, 64, 1, 0},
+    {32, 128, 1, 0},
+    {64, 128, 1, 0},
+    {128, 258, 1, 0},
+    {512, 258, 1, 0},
+    {2048, 258, 1, 0},
+};
+
+// deflate tables
+
+static const uint16_t length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                         35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                         3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                       257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                       7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t code_length_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static uint8_t length_code[MAX_MATCH + 1]; // length -> index into length_base
+static uint8_t dist_code_low[512];         // distance - 1 < 512 -> dist code
+static uint8_t dist_code_high[256];        // (distance - 1) >> 7 -> dist code
+static uint32_t crc_table[8][256]; // slicing by 8
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+// fill the lookup tables (once, the encoder threads share them)
+static void init_tables(void)
+{
+    for (int c = 0; c < 29; c++)
+    {
+        int end = c == 28 ? MAX_MATCH + 1 : length_base[c + 1];
+        for (int len = length_base[c]; len < end; len++)
+            length_code[len] = (uint8_t)c;
+    }
+    for (int c = 0; c < 30; c++)
+    {
+        int end = c == 29 ? 32769 : dist_base[c + 1];
+        for (int d = dist_base[c]; d < end; d++)
+        {
+            if (d - 1 < 512)
+                dist_code_low[d - 1] = (uint8_t)c;
+            else
+                dist_code_high[(d - 1) >> 7] = (uint8_t)c;
+        }
+    }
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[0][n] = c;
+    }
+    for (int n = 0; n < 256; n++)
+        for (int k = 1; k < 8; k++)
+            crc_table[k][n] = (crc_table[k - 1][n] >> 8) ^ crc_table[0][crc_table[k - 1][n] & 0xFF];
+}
+
+static inline int dist_code(int dist)
+{
+    return dist <= 512 ? dist_code_low[dist - 1] : dist_code_high[(dist - 1) >> 7];
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t size)
+{
+    crc = ~crc;
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        uint32_t lo = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^ crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][data[4]] ^ crc_table[2][data[5]] ^ crc_table[1][data[6]] ^ crc_table[0][data[7]];
+    }
+    while (size--)
+        crc = crc_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+#define ADLER_BASE 65521u
+
+static uint32_t adler32_update(uint32_t adler, const unsigned char *data, size_t size)
+{
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (size > 0)
+    {
+        // 5552 bytes is the most that can be summed before b can overflow
+        size_t n = size < 5552 ? size : 5552;
+        size -= n;
+        while (n--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+    return a | (b << 16);
+}
+
+// adler32 of the data of adler1 followed by size2 bytes with adler2
+static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+    uint32_t rem = (uint32_t)(size2 % ADLER_BASE);
+    uint32_t a = adler1 & 0xFFFF;
+    uint32_t b = (uint32_t)(((uint64_t)rem * a) % ADLER_BASE);
+    a += (adler2 & 0xFFFF) + ADLER_BASE - 1;
+    b += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - rem;
+    if (a >= ADLER_BASE)
+        a -= ADLER_BASE;
+    if (a >= ADLER_BASE)
+        a -= ADLER_BASE;
+    if (b >= ADLER_BASE * 2)
+        b -= ADLER_BASE * 2;
+    if (b >= ADLER_BASE)
+        b -= ADLER_BASE;
+    return a | (b << 16);
+}
+
+// growing output buffer with an LSB first bit writer
+
+typedef struct
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    uint64_t bits; // bits not written yet
+    int count;     // number of them
+    int failed;    // an allocation failed
+} bit_writer_t;
+
+static int writer_reserve(bit_writer_t *w, size_t extra)
+{
+    if (w->failed)
+        return -1;
+    if (w->size + extra <= w->capacity)
+        return 0;
+    size_t capacity = w->capacity ? w->capacity * 2 : 65536;
+    while (capacity < w->size + extra)
+        capacity *= 2;
+    unsigned char *data = (unsigned char *)realloc(w->data, capacity);
+    if (!data)
+    {
+        w->failed = 1;
+        return -1;
+    }
+    w->data = data;
+    w->capacity = capacity;
+    return 0;
+}
+
+// n <= 32
+static inline void put_bits(bit_writer_t *w, uint32_t value, int n)
+{
+    w->bits |= (uint64_t)value << w->count;
+    w->count += n;
+    if (w->count >= 32)
+    {
+        if (w->capacity - w->size >= 4 || writer_reserve(w, 4) == 0)
+        {
+            for (int k = 0; k < 4; k++)
+                w->data[w->size++] = (unsigned char)(w->bits >> (8 * k));
+        }
+        w->bits >>= 32;
+        w->count -= 32;
+    }
+}
+
+// write the bits left and pad to a byte boundary
+static void align_bits(bit_writer_t *w)
+{
+    while (w->count > 0)
+    {
+        if (writer_reserve(w, 1) == 0)
+            w->data[w->size++] = (unsigned char)w->bits;
+        w->bits >>= 8;
+        w->count = w->count > 8 ? w->count - 8 : 0;
+    }
+    w->bits = 0;
+}
+
+static void put_bytes(bit_writer_t *w, const void *data, size_t size)
+{
+    if (size == 0) // data can be NULL then (the IEND chunk)
+        return;
+    if (writer_reserve(w, size) == 0)
+    {
+        memcpy(w->data + w->size, data, size);
+        w->size += size;
+    }
+}
+
+static void put_u32be(bit_writer_t *w, uint32_t v)
+{
+    unsigned char b[4] = {(unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v};
+    put_bytes(w, b, 4);
+}
+
+// Huffman codes
+
+// code lengths of at most limit bits for the symbols with non zero freq, at least two symbols get a code
+// (a code with one symbol is allowed by deflate but some decoders reject it)
+static void huffman_lengths(const uint32_t *freq, int n, int limit, uint8_t *lengths)
+{
+    uint32_t scaled[288];
+    int symbols[288], parent[2 * 288];
+    uint32_t weight[2 * 288];
+    memcpy(scaled, freq, n * sizeof(uint32_t));
+
+    int used = 0;
+    for (int i = 0; i < n; i++)
+        used += scaled[i] != 0;
+    for (int i = 0; used < 2 && i < n; i++)
+    {
+        if (!scaled[i])
+        {
+            scaled[i] = 1;
+            used++;
+        }
+    }
+
+    for (;;)
+    {
+        // the leaves sorted by weight (insertion sort, there are at most 288)
+        int count = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (!scaled[i])
+                continue;
+            int j = count++;
+            while (j > 0 && scaled[symbols[j - 1]] > scaled[i])
+            {
+                symbols[j] = symbols[j - 1];
+                j--;
+            }
+            symbols[j] = i;
+        }
+        if (count < 2) // only when n < 2
+        {
+            memset(lengths, 0, n);
+            if (count)
+                lengths[symbols[0]] = 1;
+            return;
+        }
+        for (int i = 0; i < count; i++)
+            weight[i] = scaled[symbols[i]];
+
+        // merge the two lightest of the leaves and the internal nodes, which are made in increasing weight order
+        int leaf = 0, node = count;
+        for (int next = count; next < 2 * count - 1; next++)
+        {
+            int pick[2];
+            for (int k = 0; k < 2; k++)
+            {
+                if (leaf < count && (node >= next || weight[leaf] <= weight[node]))
+                    pick[k] = leaf++;
+                else
+                    pick[k] = node++;
+            }
+            weight[next] = weight[pick[0]] + weight[pick[1]];
+            parent[pick[0]] = parent[pick[1]] = next;
+        }
+
+        // depths from the root down
+        uint8_t depth[2 * 288];
+        int root = 2 * count - 2, max_depth = 0;
+        depth[root] = 0;
+        for (int i = root - 1; i >= 0; i--)
+        {
+            depth[i] = depth[parent[i]] + 1;
+            if (depth[i] > max_depth)
+                max_depth = depth[i];
+        }
+        if (max_depth <= limit)
+        {
+            memset(lengths, 0, n);
+            for (int i = 0; i < count; i++)
+                lengths[symbols[i]] = depth[i];
+            return;
+        }
+
+        // too deep: flatten the weights and try again
+        for (int i = 0; i < n; i++)
+            if (scaled[i])
+                scaled[i] = (scaled[i] + 1) / 2;
+    }
+}
+
+// canonical codes for the lengths, bit reversed for the LSB first writer
+static void huffman_codes(const uint8_t *lengths, int n, uint16_t *codes)
+{
+    int bl_count[16] = {0};
+    int next_code[16];
+    for (int i = 0; i < n; i++)
+        bl_count[lengths[i]]++;
+    bl_count[0] = 0;
+    int code = 0;
+    for (int bits = 1; bits < 16; bits++)
+    {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        int len = lengths[i];
+        if (!len)
+        {
+            codes[i] = 0;
+            continue;
+        }
+        int c = next_code[len]++, reversed = 0;
+        for (int k = 0; k < len; k++)
+            reversed |= ((c >> k) & 1) << (len - 1 - k);
+        codes[i] = (uint16_t)reversed;
+    }
+}
+
+// LZ77 and blocks
+
+// one literal (dist 0) or match
+typedef struct
+{
+    uint16_t value; // the byte or the match length
+    uint16_t dist;  // 0 for a literal
+} token_t;
+
+typedef struct
+{
+    const unsigned char *in; // the filtered rows of the band
+    int size;
+    const level_config_t *config;
+    int32_t *head; // most recent position of each hash
+    int32_t *prev; // previous position with the same hash, by position & WINDOW_MASK
+    int next_insert;
+    token_t *tokens;
+    int token_count;
+    int block_start; // first input byte of the tokens
+    bit_writer_t out;
+} deflate_t;
+
+static inline uint32_t hash3(const unsigned char *p)
+{
+    uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// add the positions before end to the hash chains
+static inline void insert_until(deflate_t *d, int end)
+{
+    int last = d->size - MIN_MATCH;
+    if (end > last + 1)
+        end = last + 1;
+    for (int p = d->next_insert; p < end; p++)
+    {
+        uint32_t h = hash3(d->in + p);
+        d->prev[p & WINDOW_MASK] = d->head[h];
+        d->head[h] = p;
+    }
+    if (end > d->next_insert)
+        d->next_insert = end;
+}
+
+// longest earlier match for pos (the positions before pos must be in the chains), returns its length or 0
+static int longest_match(deflate_t *d, int pos, int *dist)
+{
+    int max_len = d->size - pos;
+    if (max_len < MIN_MATCH)
+        return 0;
+    if (max_len > MAX_MATCH)
+        max_len = MAX_MATCH;
+
+    const unsigned char *in = d->in;
+    const unsigned char *cur = in + pos;
+    int best = MIN_MATCH - 1;
+    int limit = pos - WINDOW_SIZE;
+    int chain = d->config->max_chain;
+    int candidate = d->head[hash3(cur)];
+    while (candidate >= 0 && candidate > limit && chain-- > 0)
+    {
+        const unsigned char *m = in + candidate;
+        if (m[best] == cur[best] && m[0] == cur[0] && m[1] == cur[1])
+        {
+            int len = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            // compare 8 bytes at a time, the first different byte is the lowest different bit
+            while (len + 8 <= max_len)
+            {
+                uint64_t a, b;
+                memcpy(&a, m + len, 8);
+                memcpy(&b, cur + len, 8);
+                if (a != b)
+                {
+                    len += __builtin_ctzll(a ^ b) >> 3;
+                    break;
+                }
+                len += 8;
+            }
+#endif
+            while (len < max_len && m[len] == cur[len]) // the tail (and the different byte, which stops it)
+                len++;
+            if (len > best)
+            {
+                best = len;
+                *dist = pos - candidate;
+                if (len >= d->config->nice || len >= max_len)
+                    break;
+            }
+        }
+        int older = d->prev[candidate & WINDOW_MASK];
+        if (older >= candidate)
+            break;
+        candidate = older;
+    }
+    return best >= MIN_MATCH ? best : 0;
+}
+
+// stored blocks for in[start, end), the last one gets final
+static void write_stored(bit_writer_t *w, const unsigned char *in, int start, int end, int final)
+{
+    do
+    {
+        int len = end - start < 65535 ? end - start : 65535;
+        put_bits(w, final && start + len == end, 1);
+        put_bits(w, 0, 2);
+        align_bits(w);
+        unsigned char header[4] = {(unsigned char)len, (unsigned char)(len >> 8), (unsigned char)~len, (unsigned char)(~len >> 8)};
+        put_bytes(w, header, 4);
+        put_bytes(w, in + start, len);
+        start += len;
+    } while (start < end);
+}
+
+// the tokens with the given codes
+static void write_tokens(bit_writer_t *w, const token_t *tokens, int count,
+                         const uint8_t *lit_len, const uint16_t *lit_code, const uint8_t *dist_len, const uint16_t *dist_code_bits)
+{
+    for (int i = 0; i < count; i++)
+    {
+        token_t t = tokens[i];
+        if (!t.dist)
+        {
+            put_bits(w, lit_code[t.value], lit_len[t.value]);
+            continue;
+        }
+        int lc = length_code[t.value];
+        put_bits(w, lit_code[257 + lc], lit_len[257 + lc]);
+        put_bits(w, t.value - length_base[lc], length_extra[lc]);
+        int dc = dist_code(t.dist);
+        put_bits(w, dist_code_bits[dc], dist_len[dc]);
+        put_bits(w, t.dist - dist_base[dc], dist_extra[dc]);
+    }
+    put_bits(w, lit_code[256], lit_len[256]);
+}
+
+// write the pending tokens as the cheapest of a dynamic, fixed or stored block
+static void flush_block(deflate_t *d, int block_end, int final)
+{
+    uint32_t lit_freq[286] = {0}, dist_freq[30] = {0};
+    for (int i = 0; i < d->token_count; i++)
+    {
+        token_t t = d->tokens[i];
+        if (!t.dist)
+            lit_freq[t.value]++;
+        else
+        {
+            lit_freq[257 + length_code[t.value]]++;
+            dist_freq[dist_code(t.dist)]++;
+        }
+    }
+    lit_freq[256] = 1;
+
+    // dynamic codes
+    uint8_t lit_len[288], dist_len[30];
+    huffman_lengths(lit_freq, 286, 15, lit_len);
+    huffman_lengths(dist_freq, 30, 15, dist_len);
+    int hlit = 286, hdist = 30;
+    while (hlit > 257 && !lit_len[hlit - 1])
+        hlit--;
+    while (hdist > 1 && !dist_len[hdist - 1])
+        hdist--;
+
+    // run length code of both code lengths: 16 repeats the previous length 3-6 times, 17 and 18 are 3-10 and 11-138 zeros
+    uint8_t all[286 + 30], rle_symbol[286 + 30], rle_extra[286 + 30];
+    memcpy(all, lit_len, hlit);
+    memcpy(all + hlit, dist_len, hdist);
+    int total = hlit + hdist, rle_count = 0;
+    uint32_t cl_freq[19] = {0};
+    for (int i = 0; i < total;)
+    {
+        int run = 1;
+        while (i + run < total && all[i + run] == all[i])
+            run++;
+        if (all[i] == 0 && run >= 3)
+        {
+            int n = run > 138 ? 138 : run;
+            rle_symbol[rle_count] = n >= 11 ? 18 : 17;
+            rle_extra[rle_count++] = (uint8_t)(n >= 11 ? n - 11 : n - 3);
+            cl_freq[n >= 11 ? 18 : 17]++;
+            i += n;
+        }
+        else if (all[i] != 0 && run >= 4)
+        {
+            int n = run - 1 > 6 ? 6 : run - 1;
+            rle_symbol[rle_count] = all[i];
+            rle_extra[rle_count++] = 0;
+            rle_symbol[rle_count] = 16;
+            rle_extra[rle_count++] = (uint8_t)(n - 3);
+            cl_freq[all[i]]++;
+            cl_freq[16]++;
+            i += n + 1;
+        }
+        else
+        {
+            rle_symbol[rle_count] = all[i];
+            rle_extra[rle_count++] = 0;
+            cl_freq[all[i]]++;
+            i++;
+        }
+    }
+    uint8_t cl_len[19];
+    uint16_t cl_code[19];
+    huffman_lengths(cl_freq, 19, 7, cl_len);
+    huffman_codes(cl_len, 19, cl_code);
+    int hclen = 19;
+    while (hclen > 4 && !cl_len[code_length_order[hclen - 1]])
+        hclen--;
+
+    // size of each kind of block in bits
+    uint64_t extra_bits = 0;
+    for (int c = 0; c < 29; c++)
+        extra_bits += (uint64_t)lit_freq[257 + c] * length_extra[c];
+    for (int c = 0; c < 30; c++)
+        extra_bits += (uint64_t)dist_freq[c] * dist_extra[c];
+
+    uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * hclen + extra_bits;
+    for (int i = 0; i < rle_count; i++)
+        dynamic_bits += cl_len[rle_symbol[i]] + (rle_symbol[i] == 16 ? 2 : rle_symbol[i] == 17 ? 3 : rle_symbol[i] == 18 ? 7 : 0);
+    uint64_t fixed_bits = 3 + extra_bits;
+    for (int i = 0; i < 286; i++)
+    {
+        dynamic_bits += (uint64_t)lit_freq[i] * lit_len[i];
+        fixed_bits += (uint64_t)lit_freq[i] * (i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+    }
+    for (int i = 0; i < 30; i++)
+    {
+        dynamic_bits += (uint64_t)dist_freq[i] * dist_len[i];
+        fixed_bits += (uint64_t)dist_freq[i] * 5;
+    }
+    int raw = block_end - d->block_start;
+    uint64_t stored_bits = ((uint64_t)raw + 5 * (raw / 65535 + 1)) * 8 + 7;
+
+    bit_writer_t *w = &d->out;
+    if (stored_bits <= dynamic_bits && stored_bits <= fixed_bits)
+        write_stored(w, d->in, d->block_start, block_end, final);
+    else if (fixed_bits <= dynamic_bits)
+    {
+        uint8_t fixed_lit[288], fixed_dist[30];
+        uint16_t lit_code[288], dist_code_bits[30];
+        for (int i = 0; i < 288; i++)
+            fixed_lit[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        memset(fixed_dist, 5, sizeof(fixed_dist));
+        huffman_codes(fixed_lit, 288, lit_code);
+        huffman_codes(fixed_dist, 30, dist_code_bits);
+        put_bits(w, final, 1);
+        put_bits(w, 1, 2);
+        write_tokens(w, d->tokens, d->token_count, fixed_lit, lit_code, fixed_dist, dist_code_bits);
+    }
+    else
+    {
+        uint16_t lit_code[286], dist_code_bits[30];
+        huffman_codes(lit_len, 286, lit_code);
+        huffman_codes(dist_len, 30, dist_code_bits);
+        put_bits(w, final, 1);
+        put_bits(w, 2, 2);
+        put_bits(w, hlit - 257, 5);
+        put_bits(w, hdist - 1, 5);
+        put_bits(w, hclen - 4, 4);
+        for (int i = 0; i < hclen; i++)
+            put_bits(w, cl_len[code_length_order[i]], 3);
+        for (int i = 0; i < rle_count; i++)
+        {
+            int s = rle_symbol[i];
+            put_bits(w, cl_code[s], cl_len[s]);
+            if (s >= 16)
+                put_bits(w, rle_extra[i], s == 16 ? 2 : s == 17 ? 3 : 7);
+        }
+        write_tokens(w, d->tokens, d->token_count, lit_len, lit_code, dist_len, dist_code_bits);
+    }
+    d->token_count = 0;
+    d->block_start = block_end;
+}
+
+// compress in[0, size) as deflate blocks into d->out, the last block gets final,
+// without final the stream ends with an empty stored block so the next band starts on a byte boundary
+static void deflate_band(deflate_t *d, int final)
+{
+    if (d->config->max_chain == 0)
+    {
+        write_stored(&d->out, d->in, 0, d->size, final);
+        return;
+    }
+
+    int pos = 0;
+    while (pos < d->size)
+    {
+        insert_until(d, pos);
+        int dist = 0;
+        int len = longest_match(d, pos, &dist);
+
+        // lazy matching: a longer match at the next byte wins over this one
+        if (len && d->config->lazy && len < d->config->nice)
+        {
+            insert_until(d, pos + 1);
+            int next_dist = 0;
+            int next_len = longest_match(d, pos + 1, &next_dist);
+            if (next_len > len)
+            {
+                d->tokens[d->token_count++] = (token_t){d->in[pos], 0};
+                pos++;
+                len = next_len;
+                dist = next_dist;
+                if (d->token_count == BLOCK_TOKENS)
+                    flush_block(d, pos, 0);
+            }
+        }
+
+        if (len)
+        {
+            d->tokens[d->token_count++] = (token_t){(uint16_t)len, (uint16_t)dist};
+            if (d->config->max_insert && len > d->config->max_insert)
+                d->next_insert = pos + len; // skip the positions inside long matches
+            pos += len;
+        }
+        else
+            d->tokens[d->token_count++] = (token_t){d->in[pos++], 0};
+
+        if (d->token_count == BLOCK_TOKENS)
+            flush_block(d, pos, 0);
+    }
+    if (d->token_count > 0)
+        flush_block(d, d->size, final);
+    else if (final)
+    {
+        // the last block was already written without final, end with an empty one
+        put_bits(&d->out, 1, 1);
+        put_bits(&d->out, 1, 2);
+        put_bits(&d->out, 0, 7); // end of block in the fixed code
+    }
+    if (!final)
+        write_stored(&d->out, d->in, d->size, d->size, 0);
+    align_bits(&d->out);
+}
+
+// row filters
+
+// sum of the bytes taken as signed values without their sign, the usual filter heuristic
+static uint32_t sum_abs(const unsigned char *p, int size)
+{
+    uint32_t sum = 0;
+    int i = 0;
+#ifdef __SSE2__
+    // |(signed char)v| is the smaller of v and -v as unsigned bytes
+    __m128i zero = _mm_setzero_si128(), acc = zero;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_min_epu8(v, _mm_sub_epi8(zero, v)), zero));
+    }
+    sum = (uint32_t)(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc)));
+#endif
+    for (; i < size; i++)
+        sum += p[i] < 128 ? p[i] : 256 - p[i];
+    return sum;
+}
+
+// row minus the Paeth predictor of a (left), b (above) and c (above left) for i >= bpp
+static void paeth_residuals(const unsigned char *row, const unsigned char *above, int size, int bpp, unsigned char *dst)
+{
+    int i = bpp;
+#ifdef __SSE2__
+    // 8 bytes at a time in 16 bit lanes
+    __m128i zero = _mm_setzero_si128(), low = _mm_set1_epi16(0xFF);
+    for (; i + 8 <= size; i += 8)
+    {
+        __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row + i)), zero);
+        __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row + i - bpp)), zero);
+        __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(above + i)), zero);
+        __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(above + i - bpp)), zero);
+        __m128i pa = _mm_sub_epi16(b, c);
+        __m128i pb = _mm_sub_epi16(a, c);
+        __m128i pc = _mm_add_epi16(pa, pb);
+        pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+        pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+        pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+        // a if pa <= pb and pa <= pc, otherwise b if pb <= pc, otherwise c
+        __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+        __m128i not_b = _mm_cmpgt_epi16(pb, pc);
+        __m128i bc = _mm_or_si128(_mm_and_si128(not_b, c), _mm_andnot_si128(not_b, b));
+        __m128i p = _mm_or_si128(_mm_and_si128(not_a, bc), _mm_andnot_si128(not_a, a));
+        __m128i r = _mm_and_si128(_mm_sub_epi16(x, p), low);
+        _mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(r, r));
+    }
+#endif
+    for (; i < size; i++)
+    {
+        int a = row[i - bpp], b = above[i], c = above[i - bpp];
+        int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+        int p = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+        dst[i] = (unsigned char)(row[i] - p);
+    }
+}
+
+// filter one row into dst (the filter type byte then the bytes) with the filter whose bytes have the smallest sum_abs,
+// above is the previous row (zeros for the first row) and scratch has room for 4 rows
+static void filter_row(const unsigned char *row, const unsigned char *above, int size, int bpp, int only_none,
+                       unsigned char *scratch, unsigned char *dst)
+{
+    if (only_none)
+    {
+        dst[0] = 0;
+        memcpy(dst + 1, row, size);
+        return;
+    }
+
+    // every filter into its own row, the first bpp bytes have no left neighbour
+    unsigned char *sub = scratch, *up = scratch + size, *avg = scratch + 2 * size, *pth = scratch + 3 * size;
+    for (int i = 0; i < bpp; i++)
+    {
+        sub[i] = row[i];
+        up[i] = pth[i] = (unsigned char)(row[i] - above[i]);
+        avg[i] = (unsigned char)(row[i] - (above[i] >> 1));
+    }
+    for (int i = bpp; i < size; i++)
+    {
+        sub[i] = (unsigned char)(row[i] - row[i - bpp]);
+        up[i] = (unsigned char)(row[i] - above[i]);
+        avg[i] = (unsigned char)(row[i] - ((row[i - bpp] + above[i]) >> 1));
+    }
+    paeth_residuals(row, above, size, bpp, pth);
+
+    const unsigned char *candidates[5] = {row, sub, up, avg, pth};
+    int best = 0;
+    uint32_t best_sum = sum_abs(row, size);
+    for (int f = 1; f < 5; f++)
+    {
+        uint32_t sum = sum_abs(candidates[f], size);
+        if (sum < best_sum)
+        {
+            best = f;
+            best_sum = sum;
+        }
+    }
+    dst[0] = (unsigned char)best;
+    memcpy(dst + 1, candidates[best], size);
+}
+
+// encoding a canvas in bands
+
+typedef struct
+{
+    const canvas_t *canvas;
+    int bit_depth;
+    int level;
+    int band_rows;
+    bit_writer_t *chunks; // one IDAT chunk per band
+    uint32_t *adler;      // adler32 of the filtered rows of each band
+    size_t *filtered_size;
+    int band_count;
+} png_job_t;
+
+static void quantize_row(const canvas_t *canvas, int y, int bit_depth, unsigned char *dst)
+{
+    if (bit_depth == 16)
+        span_quantize_u16be(canvas_row(canvas, y), dst, canvas->width);
+    else
+        span_quantize_u8(canvas_row(canvas, y), dst, canvas->width);
+}
+
+// filter and compress one band of rows into its IDAT chunk
+static void png_encode_band(int band, void *user)
+{
+    png_job_t *job = (png_job_t *)user;
+    const canvas_t *canvas = job->canvas;
+    int y0 = band * job->band_rows;
+    int y1 = y0 + job->band_rows < canvas->height ? y0 + job->band_rows : canvas->height;
+    int bpp = job->bit_depth / 8;
+    size_t row_bytes = (size_t)canvas->width * bpp;
+    size_t size = (row_bytes + 1) * (y1 - y0);
+
+    deflate_t d;
+    memset(&d, 0, sizeof(d));
+    d.config = &level_configs[job->level];
+    unsigned char *rows = (unsigned char *)calloc(7, row_bytes); // this row, the one above and 4 filtered rows + zeros
+    unsigned char *filtered = (unsigned char *)malloc(size);
+    d.head = (int32_t *)malloc(HASH_SIZE * sizeof(int32_t));
+    d.prev = (int32_t *)malloc(WINDOW_SIZE * sizeof(int32_t));
+    d.tokens = (token_t *)malloc(BLOCK_TOKENS * sizeof(token_t));
+    bit_writer_t *chunk = &job->chunks[band];
+    if (!rows || !filtered || !d.head || !d.prev || !d.tokens)
+    {
+        chunk->failed = 1;
+        goto done;
+    }
+
+    // the rows are filtered against the row above even across bands, only the deflate window starts over
+    unsigned char *row = rows, *above = rows + row_bytes, *scratch = rows + 2 * row_bytes, *zeros = rows + 6 * row_bytes;
+    if (y0 > 0)
+        quantize_row(canvas, y0 - 1, job->bit_depth, above);
+    for (int y = y0; y < y1; y++)
+    {
+        quantize_row(canvas, y, job->bit_depth, row);
+        filter_row(row, y > 0 ? above : zeros, (int)row_bytes, bpp, job->level == 0, scratch, filtered + (row_bytes + 1) * (y - y0));
+        unsigned char *swap = row;
+        row = above;
+        above = swap;
+    }
+    job->adler[band] = adler32_update(1, filtered, size);
+    job->filtered_size[band] = size;
+
+    // the chunk: length, "IDAT", the zlib header in the first band, the deflate blocks and the crc
+    d.out = *chunk;
+    put_bytes(&d.out, "\0\0\0\0IDAT", 8);
+    if (band == 0)
+    {
+        static const unsigned char zlib_level[10] = {0x01, 0x01, 0x5E, 0x5E, 0x5E, 0x5E, 0x9C, 0xDA, 0xDA, 0xDA};
+        unsigned char zlib_header[2] = {0x78, zlib_level[job->level]};
+        put_bytes(&d.out, zlib_header, 2);
+    }
+    memset(d.head, 0xFF, HASH_SIZE * sizeof(int32_t));
+    d.in = filtered;
+    d.size = (int)size;
+    deflate_band(&d, band == job->band_count - 1);
+    *chunk = d.out;
+    if (!chunk->failed)
+    {
+        uint32_t length = (uint32_t)(chunk->size - 8);
+        chunk->data[0] = (unsigned char)(length >> 24);
+        chunk->data[1] = (unsigned char)(length >> 16);
+        chunk->data[2] = (unsigned char)(length >> 8);
+        chunk->data[3] = (unsigned char)length;
+        put_u32be(chunk, crc32_update(0, chunk->data + 4, chunk->size - 4));
+    }
+
+done:
+    free(rows);
+    free(filtered);
+    free(d.head);
+    free(d.prev);
+    free(d.tokens);
+}
+
+// a whole chunk with its length and crc
+static void put_chunk(bit_writer_t *w, const char *type, const unsigned char *data, uint32_t size)
+{
+    put_u32be(w, size);
+    size_t start = w->size;
+    put_bytes(w, type, 4);
+    put_bytes(w, data, size);
+    if (!w->failed)
+        put_u32be(w, crc32_update(0, w->data + start, size + 4));
+}
+
+// Encode the canvas as a grayscale PNG
+unsigned char *canvas_encode_png(const canvas_t *canvas, int bit_depth, int level, int num_threads, size_t *size)
+{
+    if (!canvas || !size || (bit_depth != 8 && bit_depth != 16) || level < 0 || level > 9)
+        return NULL;
+    pthread_once(&tables_once, init_tables);
+
+    // bands of whole rows, their size does not depend on the thread count so neither does the file
+    size_t row_bytes = (size_t)canvas->width * (bit_depth / 8) + 1;
+    png_job_t job = {.canvas = canvas, .bit_depth = bit_depth, .level = level};
+    job.band_rows = row_bytes >= PNG_BAND_BYTES ? 1 : (int)(PNG_BAND_BYTES / row_bytes);
+    job.band_count = (canvas->height + job.band_rows - 1) / job.band_rows;
+    job.chunks = (bit_writer_t *)calloc(job.band_count, sizeof(bit_writer_t));
+    job.adler = (uint32_t *)malloc(job.band_count * sizeof(uint32_t));
+    job.filtered_size = (size_t *)malloc(job.band_count * sizeof(size_t));
+    bit_writer_t png = {0};
+    int ok = job.chunks && job.adler && job.filtered_size;
+
+    STATS_BEGIN(RENDER_STAGE_OUTPUT);
+    if (ok)
+        parallel_for(job.band_count, num_threads, png_encode_band, &job);
+
+    // signature, header, the band chunks and a last IDAT with the adler32 of all the bands
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    put_bytes(&png, signature, 8);
+    unsigned char header[13] = {
+        (unsigned char)(canvas->width >> 24), (unsigned char)(canvas->width >> 16), (unsigned char)(canvas->width >> 8), (unsigned char)canvas->width,
+        (unsigned char)(canvas->height >> 24), (unsigned char)(canvas->height >> 16), (unsigned char)(canvas->height >> 8), (unsigned char)canvas->height,
+        (unsigned char)bit_depth, 0, 0, 0, 0}; // gray, deflate, adaptive filters, not interlaced
+    put_chunk(&png, "IHDR", header, 13);
+    uint32_t adler = 1;
+    for (int i = 0; ok && i < job.band_count; i++)
+    {
+        if (job.chunks[i].failed)
+            ok = 0;
+        else
+        {
+            put_bytes(&png, job.chunks[i].data, job.chunks[i].size);
+            adler = adler32_combine(adler, job.adler[i], job.filtered_size[i]);
+        }
+    }
+    unsigned char adler_bytes[4] = {(unsigned char)(adler >> 24), (unsigned char)(adler >> 16), (unsigned char)(adler >> 8), (unsigned char)adler};
+    put_chunk(&png, "IDAT", adler_bytes, 4);
+    put_chunk(&png, "IEND", NULL, 0);
+    STATS_END(RENDER_STAGE_OUTPUT);
+
+    for (int i = 0; job.chunks && i < job.band_count; i++)
+        free(job.chunks[i].data);
+    free(job.chunks);
+    free(job.adler);
+    free(job.filtered_size);
+    if (!ok || png.failed)
+    {
+        free(png.data);
+        return NULL;
+    }
+    *size = png.size;
+    return png.data;
+}
+
+// Save canvas as a PNG file
+int canvas_save_png(const canvas_t *canvas, const char *filename, int bit_depth, int level, int num_threads)
+{
+    if (!filename)
+        return -1;
+    size_t size;
+    unsigned char *png = canvas_encode_png(canvas, bit_depth, level, num_threads, &size);
+    if (!png)
+        return -1;
+
+    FILE *fp = fopen(filename, "wb");
+    int ok = fp && fwrite(png, 1, size, fp) == size;
+    if (fp && fclose(fp) != 0)
+        ok = 0;
+    free(png);
+    if (ok)
+        STATS_ADD(RENDER_COUNTER_BYTES_WRITTEN, size);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,213 @@
+#include "raster.h"
+#include "parallel.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <math.h>
+
+// data the tile workers share
+typedef struct
+{
+    canvas_t *canvas;
+    const line_t *lines;
+    const int *tile_start; // first entry of each tile in tile_lines (tile count + 1 entries)
+    const int *tile_lines; // line indices of every tile, in line order
+    int tiles_x;
+    int tile_size;
+} tile_job_t;
+
+// how far a line can change pixels away from its center line (brush radius + bilinear splat)
+static float line_margin(const line_t *line)
+{
+    return line->thickness * 0.5f + 2.0f;
+}
+
+// columns of tile row ty that the line can touch, returns 0 if it does not touch the row
+static int line_tile_columns(const line_t *line, int ty, int tile_size, int tiles_x, int *tx0, int *tx1)
+{
+    float margin = line_margin(line);
+    float row_top = (float)(ty * tile_size) - margin;
+    float row_bottom = (float)((ty + 1) * tile_size) + margin;
+
+    // part of the line (s in [0, 1]) inside the tile row
+    float dy = line->y1 - line->y0;
+    float s0 = 0.0f, s1 = 1.0f;
+    if (dy == 0.0f)
+    {
+        if (line->y0 < row_top || line->y0 > row_bottom)
+            return 0;
+    }
+    else
+    {
+        float a = (row_top - line->y0) / dy;
+        float b = (row_bottom - line->y0) / dy;
+        s0 = fmaxf(s0, fminf(a, b));
+        s1 = fminf(s1, fmaxf(a, b));
+        if (s0 > s1)
+            return 0;
+    }
+
+    // x range of that part
+    float dx = line->x1 - line->x0;
+    float xa = line->x0 + s0 * dx;
+    float xb = line->x0 + s1 * dx;
+    float x_min = fminf(xa, xb) - margin;
+    float x_max = fmaxf(xa, xb) + margin;
+
+    int first = (int)floorf(x_min / tile_size);
+    int last = (int)floorf(x_max / tile_size);
+    if (first < 0)
+        first = 0;
+    if (last > tiles_x - 1)
+        last = tiles_x - 1;
+    *tx0 = first;
+    *tx1 = last;
+    return first <= last;
+}
+
+// tile rows the line can touch, returns 0 if it is outside the canvas
+static int line_tile_rows(const line_t *line, int tile_size, int tiles_y, int *ty0, int *ty1)
+{
+    float margin = line_margin(line);
+    int first = (int)floorf((fminf(line->y0, line->y1) - margin) / tile_size);
+    int last = (int)floorf((fmaxf(line->y0, line->y1) + margin) / tile_size);
+    if (first < 0)
+        first = 0;
+    if (last > tiles_y - 1)
+        last = tiles_y - 1;
+    *ty0 = first;
+    *ty1 = last;
+    return first <= last;
+}
+
+// draw one line with the line mode of the canvas
+static void draw_line_mode(canvas_t *canvas, const line_t *line, const canvas_rect_t *clip)
+{
+    if (canvas->line_mode == LINE_MODE_COVERAGE)
+        draw_line_coverage_f_clipped(canvas, line, clip);
+    else
+        draw_line_f_clipped(canvas, line, clip);
+}
+
+// draw every line of one tile
+static void draw_tile(int tile, void *user)
+{
+    tile_job_t *job = (tile_job_t *)user;
+    canvas_t *canvas = job->canvas;
+
+    int tx = tile % job->tiles_x;
+    int ty = tile / job->tiles_x;
+    canvas_rect_t clip = {tx * job->tile_size, ty * job->tile_size,
+                          (tx + 1) * job->tile_size, (ty + 1) * job->tile_size};
+    if (clip.x1 > canvas->width)
+        clip.x1 = canvas->width;
+    if (clip.y1 > canvas->height)
+        clip.y1 = canvas->height;
+
+    for (int i = job->tile_start[tile]; i < job->tile_start[tile + 1]; i++)
+    {
+        draw_line_mode(canvas, &job->lines[job->tile_lines[i]], &clip);
+    }
+}
+
+// Set the tiling settings of the canvas
+void canvas_set_tiling(canvas_t *canvas, int tile_size, int num_threads)
+{
+    if (!canvas)
+        return;
+
+    canvas->tile_size = tile_size > 0 ? tile_size : 0;
+    canvas->raster_threads = num_threads > 0 ? num_threads : 0;
+}
+
+// draw the lines, with or without tiles
+static void draw_lines(canvas_t *canvas, const line_t *lines, int count)
+{
+    if (!canvas || !lines || count <= 0)
+        return;
+
+    // without tiling just draw them in order
+    if (canvas->tile_size <= 0)
+    {
+        canvas_rect_t clip = {0, 0, canvas->width, canvas->height};
+        for (int i = 0; i < count; i++)
+        {
+            draw_line_mode(canvas, &lines[i], &clip);
+        }
+        return;
+    }
+
+    int tile_size = canvas->tile_size;
+    int tiles_x = (canvas->width + tile_size - 1) / tile_size;
+    int tiles_y = (canvas->height + tile_size - 1) / tile_size;
+    int tile_count = tiles_x * tiles_y;
+
+    // first pass: count the lines of every tile
+    int *tile_start = (int *)calloc(tile_count + 1, sizeof(int));
+    if (!tile_start)
+        return;
+
+    for (int i = 0; i < count; i++)
+    {
+        int ty0, ty1, tx0, tx1;
+        if (!line_tile_rows(&lines[i], tile_size, tiles_y, &ty0, &ty1))
+            continue;
+        for (int ty = ty0; ty <= ty1; ty++)
+        {
+            if (!line_tile_columns(&lines[i], ty, tile_size, tiles_x, &tx0, &tx1))
+                continue;
+            for (int tx = tx0; tx <= tx1; tx++)
+                tile_start[ty * tiles_x + tx + 1]++;
+        }
+    }
+
+    // prefix sum gives where every tile starts
+    for (int t = 0; t < tile_count; t++)
+    {
+        tile_start[t + 1] += tile_start[t];
+    }
+
+    // second pass: store the line indices, in line order so the blend order is kept
+    int *tile_lines = (int *)malloc((tile_start[tile_count] + 1) * sizeof(int));
+    int *cursor = (int *)malloc(tile_count * sizeof(int));
+    if (!tile_lines || !cursor)
+    {
+        free(tile_start);
+        free(tile_lines);
+        free(cursor);
+        return;
+    }
+    for (int t = 0; t < tile_count; t++)
+    {
+        cursor[t] = tile_start[t];
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        int ty0, ty1, tx0, tx1;
+        if (!line_tile_rows(&lines[i], tile_size, tiles_y, &ty0, &ty1))
+            continue;
+        for (int ty = ty0; ty <= ty1; ty++)
+        {
+            if (!line_tile_columns(&lines[i], ty, tile_size, tiles_x, &tx0, &tx1))
+                continue;
+            for (int tx = tx0; tx <= tx1; tx++)
+                tile_lines[cursor[ty * tiles_x + tx]++] = i;
+        }
+    }
+
+    // every tile only writes its own pixels, so no locks are needed
+    tile_job_t job = {canvas, lines, tile_start, tile_lines, tiles_x, tile_size};
+    parallel_for(tile_count, canvas->raster_threads, draw_tile, &job);
+
+    free(tile_start);
+    free(tile_lines);
+    free(cursor);
+}
+
+// Draw a list of lines
+void canvas_draw_lines(canvas_t *canvas, const line_t *lines, int count)
+{
+    STATS_BEGIN(RENDER_STAGE_RASTER);
+    draw_lines(canvas, lines, count);
+    STATS_END(RENDER_STAGE_RASTER);
+}
@@ -1,15 +1,24 @@
 #include "renderer.h"
+#include "scene.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // project a 3d vertex with full transformation
 vec3_t project_vertex(vec3_t vertex, mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection, int canvas_width, int canvas_height)
 {
     // Local to World -> World to Camera -> Camera to Projection
-    mat4_t mvp = mat4_multiply(projection, mat4_multiply(world_to_camera, local_to_world));
+    mat4_t mvp;
+    mat4_multiply_to(&mvp, &world_to_camera, &local_to_world);
+    mat4_multiply_to(&mvp, &projection, &mvp);
     // apply the tarnsformation to the vertex
-    vec4_t clip_pos = mat4_transform_vec4(mvp, (vec4_t){vertex.x, vertex.y, vertex.z, 1.0f});
+    vec4_t clip_pos = {vertex.x, vertex.y, vertex.z, 1.0f};
+    mat4_transform_vec4_to(&clip_pos, &mvp, &clip_pos);
 
     // // makng sure that w is not zero and convert back to standard coordinates
     if (fabsf(clip_pos.w) > 0.0000001)
@@ -28,139 +37,496 @@ vec3_t project_vertex(vec3_t vertex, mat4_t local_to_world, mat4_t world_to_came
     return vec3_create(screen_x, screen_y, clip_pos.z);
 }
 
-// Checks if a pixel (x, y) is inside a circular drawing area defined by the canvas
-int clip_to_circular_viewport(canvas_t *canvas, float x, float y)
+// Start with empty arrays
+void vertex_stage_init(vertex_stage_t *stage)
 {
-    if (!canvas)
+    stage->world = NULL;
+    stage->camera = NULL;
+    stage->screen = NULL;
+    stage->clip = NULL;
+    stage->count = 0;
+    stage->capacity = 0;
+    stage->soa = NULL;
+    stage->soa_capacity = 0;
+}
+
+// Free the arrays
+void vertex_stage_free(vertex_stage_t *stage)
+{
+    free(stage->world);
+    free(stage->camera);
+    free(stage->screen);
+    free(stage->clip);
+    free(stage->soa);
+    vertex_stage_init(stage);
+}
+
+// Transform all the vertices of an object
+int vertex_stage_run(vertex_stage_t *stage, const object3d_t *obj,
+                     mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection,
+                     int canvas_width, int canvas_height)
+{
+    if (!stage)
+        return -1;
+
+    stage->count = 0;
+    return vertex_stage_append(stage, obj, local_to_world, world_to_camera, projection, canvas_width, canvas_height);
+}
+
+// make room for count vertices, keeping the ones already in the stage
+static int vertex_stage_reserve(vertex_stage_t *stage, int count)
+{
+    if (count <= stage->capacity)
         return 0;
 
-    // Calculate the center of the canvas
-    float center_x = canvas->width * 0.5f;
-    float center_y = canvas->height * 0.5f;
+    // grow by half so many small appends stay cheap
+    int capacity = stage->capacity + stage->capacity / 2;
+    if (capacity < count)
+        capacity = count;
+
+    vec3f_t *world = (vec3f_t *)realloc(stage->world, capacity * sizeof(vec3f_t));
+    if (world)
+        stage->world = world;
+    vec3f_t *camera = (vec3f_t *)realloc(stage->camera, capacity * sizeof(vec3f_t));
+    if (camera)
+        stage->camera = camera;
+    vec3f_t *screen = (vec3f_t *)realloc(stage->screen, capacity * sizeof(vec3f_t));
+    if (screen)
+        stage->screen = screen;
+    vec4_t *clip = (vec4_t *)realloc(stage->clip, capacity * sizeof(vec4_t));
+    if (clip)
+        stage->clip = clip;
+
+    if (!world || !camera || !screen || !clip)
+        return -1;
+    stage->capacity = capacity;
+    return 0;
+}
 
-    // check whether the radius is the minimum of half of the width or half of the height to make sure that the circle is fit to the canvas
-    float radius = fminf(canvas->width * 0.5f, canvas->height * 0.5f);
+// Transform the vertices of an object after the ones already in the stage
+int vertex_stage_append(vertex_stage_t *stage, const object3d_t *obj,
+                        mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection,
+                        int canvas_width, int canvas_height)
+{
+    if (!stage || !obj)
+        return -1;
+    if (vertex_stage_reserve(stage, stage->count + obj->vertex_count) != 0)
+        return -1;
+
+    vec3f_t *world = stage->world + stage->count;
+    vec3f_t *camera = stage->camera + stage->count;
+    vec3f_t *screen = stage->screen + stage->count;
+    vec4_t *clip = stage->clip + stage->count;
+    stage->count += obj->vertex_count;
+    STATS_BEGIN(RENDER_STAGE_PROJECT);
+
+    // Local to World -> World to Camera -> Camera to Projection, once for all the vertices
+    mat4_t mvp;
+    mat4_multiply_to(&mvp, &world_to_camera, &local_to_world);
+    mat4_multiply_to(&mvp, &projection, &mvp);
+
+    // whole arrays at a time, clip space is the same steps as project_vertex
+    mat4_transform_points(&local_to_world, obj->vertices, world, obj->vertex_count);
+    mat4_transform_points(&world_to_camera, world, camera, obj->vertex_count);
+    mat4_transform_points_h(&mvp, obj->vertices, clip, obj->vertex_count);
+    for (int i = 0; i < obj->vertex_count; i++)
+    {
+        screen[i] = clip_to_screen(clip[i], canvas_width, canvas_height);
+    }
+    STATS_END(RENDER_STAGE_PROJECT);
+    STATS_ADD(RENDER_COUNTER_VERTICES, obj->vertex_count);
+    return 0;
+}
 
-    // Calculate the distance from the pixel (x, y) to the center
-    float dx = x - center_x;
-    float dy = y - center_y;
-    // calculate the distances
-    float distance = sqrtf(dx * dx + dy * dy);
+// Divide by w and map to the screen
+vec3f_t clip_to_screen(vec4_t clip, int canvas_width, int canvas_height)
+{
+    // makng sure that w is not zero
+    if (fabsf(clip.w) > 0.0000001)
+    {
+        clip.x /= clip.w;
+        clip.y /= clip.w;
+        clip.z /= clip.w;
+    }
 
-    // Return 1 if the pixel is inside the circular viewport, 0 otherwise
-    return distance <= radius;
+    // Map to screen coordinates (Viewport transform)
+    return vec3f_create((clip.x * 0.5f + 0.5f) * canvas_width,
+                        (1.0f - (clip.y * 0.5f + 0.5f)) * canvas_height,
+                        clip.z);
 }
 
-// Draw wireframe with depth sorting and lighting
-// Draw wireframe using logarithmic z-buffer
-void wireframe(canvas_t *canvas, object3d_t *obj,
-               mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection,
-               light_t *lights, int num_lights,
-               float z_near, float z_far)
+// Clip a segment against the near plane
+int clip_segment_near(float z0, float z1, float z_near, float *t0, float *t1)
 {
-    if (!canvas || !obj)
+    // signed distance to the plane, inside is >= 0
+    float d0 = z0 - z_near;
+    float d1 = z1 - z_near;
+
+    *t0 = 0.0f;
+    *t1 = 1.0f;
+    if (d0 < 0.0f && d1 < 0.0f)
+        return 0;
+
+    // the point where the distance is 0, the distances are linear in t
+    if (d0 < 0.0f)
+        *t0 = d0 / (d0 - d1);
+    else if (d1 < 0.0f)
+        *t1 = d0 / (d0 - d1);
+    return 1;
+}
+
+// Allocate an object
+object3d_t *object3d_create(int vertex_count, int edge_count)
+{
+    if (vertex_count < 0 || edge_count < 0)
+        return NULL;
+
+    object3d_t *obj = (object3d_t *)calloc(1, sizeof(object3d_t));
+    if (!obj)
+        return NULL;
+    obj->vertex_count = vertex_count;
+    obj->edge_count = edge_count;
+    if (vertex_count > 0)
+        obj->vertices = (vec3f_t *)malloc(vertex_count * sizeof(vec3f_t));
+    if (edge_count > 0)
+        obj->edges = (int (*)[2])malloc(edge_count * sizeof(int[2]));
+
+    if ((vertex_count > 0 && !obj->vertices) || (edge_count > 0 && !obj->edges))
+    {
+        object3d_destroy(obj);
+        return NULL;
+    }
+    return obj;
+}
+
+// Free an object
+void object3d_destroy(object3d_t *obj)
+{
+    if (!obj)
+        return;
+    if (obj->release)
+    {
+        obj->release(obj->owner);
+        if (obj->edges16_owned)
+            free(obj->edges16);
+    }
+    else
+    {
+        free(obj->vertices);
+        free(obj->edges);
+        free(obj->edges16);
+    }
+    free(obj);
+}
+
+// Compute the bounding box and sphere of an object
+void object3d_compute_bounds(object3d_t *obj)
+{
+    if (!obj)
         return;
 
-    // a array for store 2D projected vertices
-    vec3_t *projected_vertices = (vec3_t *)malloc(obj->vertex_count * sizeof(vec3_t));
+    obj->has_bounds = 0;
+    if (obj->vertex_count <= 0 || !obj->vertices)
+        return;
 
-    float *edge_depths = (float *)malloc(obj->edge_count * sizeof(float));
-    int *sorted_edge_indices = (int *)malloc(obj->edge_count * sizeof(int));
+    vec3f_t lo = obj->vertices[0];
+    vec3f_t hi = obj->vertices[0];
+    for (int i = 1; i < obj->vertex_count; i++)
+    {
+        vec3f_t v = obj->vertices[i];
+        lo = vec3f_create(fminf(lo.x, v.x), fminf(lo.y, v.y), fminf(lo.z, v.z));
+        hi = vec3f_create(fmaxf(hi.x, v.x), fmaxf(hi.y, v.y), fmaxf(hi.z, v.z));
+    }
 
+    // sphere around the center of the box that holds every vertex
+    vec3f_t center = vec3f_scale(vec3f_add(lo, hi), 0.5f);
+    float radius_sq = 0.0f;
     for (int i = 0; i < obj->vertex_count; i++)
     {
-        projected_vertices[i] = project_vertex(obj->vertices[i], local_to_world, world_to_camera, projection, canvas->width, canvas->height);
+        vec3f_t d = vec3f_sub(obj->vertices[i], center);
+        radius_sq = fmaxf(radius_sq, vec3f_dot(d, d));
     }
 
-    // get the log values
-    float log_z_near = logf(z_near + 1.0f); // 1 to avoid log 0
-    float log_z_far = logf(z_far + 1.0f);
+    obj->bounds_min = lo;
+    obj->bounds_max = hi;
+    obj->bounds_center = center;
+    obj->bounds_radius = sqrtf(radius_sq);
+    obj->has_bounds = 1;
+}
 
-    for (int i = 0; i < obj->edge_count; i++)
+// Test the bounding sphere against the six planes of the frustum
+int object3d_in_frustum(const object3d_t *obj, mat4_t mvp, float z_near, float z_far)
+{
+    if (!obj || !obj->has_bounds)
+        return 1;
+
+    // the planes come from the rows of the mvp in object space, the depth is -w
+    // so a point is inside if |x| <= -w, |y| <= -w and z_near <= -w <= z_far
+    const float(*m)[4] = mvp.m;
+    float planes[6][4];
+    for (int j = 0; j < 4; j++)
+    {
+        planes[0][j] = -m[3][j] + m[0][j]; // left
+        planes[1][j] = -m[3][j] - m[0][j]; // right
+        planes[2][j] = -m[3][j] + m[1][j]; // bottom
+        planes[3][j] = -m[3][j] - m[1][j]; // top
+        planes[4][j] = -m[3][j];           // near
+        planes[5][j] = m[3][j];            // far
+    }
+    planes[4][3] -= z_near;
+    planes[5][3] += z_far;
+
+    vec3f_t c = obj->bounds_center;
+    for (int i = 0; i < 6; i++)
     {
-        int v0_idx = obj->edges[i][0];
-        int v1_idx = obj->edges[i][1];
+        // the length of the normal turns the plane value into a distance
+        float len = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+        float dist = planes[i][0] * c.x + planes[i][1] * c.y + planes[i][2] * c.z + planes[i][3];
+        if (dist < -obj->bounds_radius * len)
+            return 0;
+    }
+    return 1;
+}
 
-        // Local to World -> World to Camera  transformation
-        vec3_t v0_world = mat4_transform_vec3(local_to_world, obj->vertices[v0_idx]);
-        vec3_t v1_world = mat4_transform_vec3(local_to_world, obj->vertices[v1_idx]);
+#ifdef __SSE2__
+// rows of a matrix broadcast into SSE registers
+typedef struct
+{
+    __m128 m[4][4];
+} mat4_sse_t;
 
-        vec3_t v0_camera = mat4_transform_vec3(world_to_camera, v0_world);
-        vec3_t v1_camera = mat4_transform_vec3(world_to_camera, v1_world);
+static mat4_sse_t mat4_broadcast(const mat4_t *m)
+{
+    mat4_sse_t r;
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            r.m[i][j] = _mm_set1_ps(m->m[i][j]);
+    }
+    return r;
+}
 
-        float z0 = fabsf(v0_camera.z);
-        float z1 = fabsf(v1_camera.z);
-        float avg_z = (z0 + z1) * 0.5f;
+// transform 4 points given as x, y, z lanes, with the same operation order as mat4_transform_point
+// if divide_min is positive the lanes with |w| > divide_min are divided by w
+static void transform4(const mat4_sse_t *m, __m128 x, __m128 y, __m128 z, float divide_min,
+                       __m128 *ox, __m128 *oy, __m128 *oz)
+{
+    __m128 rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m->m[0][0], x), _mm_mul_ps(m->m[0][1], y)), _mm_mul_ps(m->m[0][2], z)), m->m[0][3]);
+    __m128 ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m->m[1][0], x), _mm_mul_ps(m->m[1][1], y)), _mm_mul_ps(m->m[1][2], z)), m->m[1][3]);
+    __m128 rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m->m[2][0], x), _mm_mul_ps(m->m[2][1], y)), _mm_mul_ps(m->m[2][2], z)), m->m[2][3]);
 
-        // from the formula
-        edge_depths[i] = (logf(avg_z + 1.0f) - log_z_near) / (log_z_far - log_z_near);
-        sorted_edge_indices[i] = i;
+    if (divide_min > 0.0f)
+    {
+        __m128 rw = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m->m[3][0], x), _mm_mul_ps(m->m[3][1], y)), _mm_mul_ps(m->m[3][2], z)), m->m[3][3]);
+        // |w| > divide_min, the other lanes are divided by 1
+        __m128 abs_w = _mm_andnot_ps(_mm_set1_ps(-0.0f), rw);
+        __m128 use = _mm_cmpgt_ps(abs_w, _mm_set1_ps(divide_min));
+        __m128 w = _mm_or_ps(_mm_and_ps(use, rw), _mm_andnot_ps(use, _mm_set1_ps(1.0f)));
+        rx = _mm_div_ps(rx, w);
+        ry = _mm_div_ps(ry, w);
+        rz = _mm_div_ps(rz, w);
     }
+    *ox = rx;
+    *oy = ry;
+    *oz = rz;
+}
+
+// 1 if the bottom row of m is (0, 0, 0, 1) so w is always 1
+static int mat4_is_affine(const mat4_t *m)
+{
+    return m->m[3][0] == 0.0f && m->m[3][1] == 0.0f && m->m[3][2] == 0.0f && m->m[3][3] == 1.0f;
+}
+#endif
+
+// Append many instances of one object
+int vertex_stage_append_instances(vertex_stage_t *stage, const object3d_t *obj,
+                                  const mat4_t *local_to_world, int instance_count,
+                                  mat4_t world_to_camera, mat4_t projection,
+                                  int canvas_width, int canvas_height)
+{
+    if (!stage || !obj || (instance_count > 0 && !local_to_world))
+        return -1;
+
+#ifdef __SSE2__
+    int n = obj->vertex_count;
+    if (vertex_stage_reserve(stage, stage->count + n * instance_count) != 0)
+        return -1;
+    if (n == 0)
+        return 0;
 
-    // Bubble sort edges back to front
-    for (int i = 0; i < obj->edge_count - 1; i++)
+    // the vertices as x, y and z arrays, padded to a multiple of 4 (read once for all the instances),
+    // the arrays stay in the stage for the next call
+    int padded = (n + 3) & ~3;
+    if (padded * 3 > stage->soa_capacity)
     {
-        for (int j = 0; j < obj->edge_count - i - 1; j++)
+        float *soa = (float *)realloc(stage->soa, (size_t)padded * 3 * sizeof(float));
+        if (!soa)
+            return -1;
+        stage->soa = soa;
+        stage->soa_capacity = padded * 3;
+    }
+    STATS_BEGIN(RENDER_STAGE_PROJECT);
+    float *soa = stage->soa;
+    float *xs = soa, *ys = soa + padded, *zs = soa + padded * 2;
+    for (int i = 0; i < padded; i++)
+    {
+        vec3f_t v = i < n ? obj->vertices[i] : vec3f_create(0.0f, 0.0f, 0.0f);
+        xs[i] = v.x;
+        ys[i] = v.y;
+        zs[i] = v.z;
+    }
+
+    mat4_sse_t view = mat4_broadcast(&world_to_camera);
+    float view_divide = mat4_is_affine(&world_to_camera) ? 0.0f : 0.0001f;
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 width = _mm_set1_ps((float)canvas_width);
+    __m128 height = _mm_set1_ps((float)canvas_height);
+
+    for (int k = 0; k < instance_count; k++)
+    {
+        mat4_t mvp = mat4_multiply(projection, mat4_multiply(world_to_camera, local_to_world[k]));
+        mat4_sse_t model = mat4_broadcast(&local_to_world[k]);
+        mat4_sse_t clip = mat4_broadcast(&mvp);
+        float model_divide = mat4_is_affine(&local_to_world[k]) ? 0.0f : 0.0001f;
+
+        vec3f_t *world = stage->world + stage->count;
+        vec3f_t *camera = stage->camera + stage->count;
+        vec3f_t *screen = stage->screen + stage->count;
+        vec4_t *clip_out = stage->clip + stage->count;
+
+        for (int i = 0; i < padded; i += 4)
         {
-            if (edge_depths[j] < edge_depths[j + 1])
+            __m128 x = _mm_loadu_ps(xs + i);
+            __m128 y = _mm_loadu_ps(ys + i);
+            __m128 z = _mm_loadu_ps(zs + i);
+
+            float out[13][4];
+            __m128 wx, wy, wz, cx, cy, cz, sx, sy, sz, sw;
+            transform4(&model, x, y, z, model_divide, &wx, &wy, &wz);
+            transform4(&view, wx, wy, wz, view_divide, &cx, &cy, &cz);
+
+            // clip space, kept for the near plane clipping, then divided by w
+            transform4(&clip, x, y, z, 0.0f, &sx, &sy, &sz);
+            sw = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(clip.m[3][0], x), _mm_mul_ps(clip.m[3][1], y)), _mm_mul_ps(clip.m[3][2], z)), clip.m[3][3]);
+            _mm_storeu_ps(out[9], sx);
+            _mm_storeu_ps(out[10], sy);
+            _mm_storeu_ps(out[11], sz);
+            _mm_storeu_ps(out[12], sw);
+            __m128 use = _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), sw), _mm_set1_ps(0.0000001f));
+            __m128 w = _mm_or_ps(_mm_and_ps(use, sw), _mm_andnot_ps(use, one));
+            sx = _mm_div_ps(sx, w);
+            sy = _mm_div_ps(sy, w);
+            sz = _mm_div_ps(sz, w);
+
+            // Map to screen coordinates (Viewport transform)
+            sx = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(sx, half), half), width);
+            sy = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(_mm_mul_ps(sy, half), half)), height);
+
+            _mm_storeu_ps(out[0], wx);
+            _mm_storeu_ps(out[1], wy);
+            _mm_storeu_ps(out[2], wz);
+            _mm_storeu_ps(out[3], cx);
+            _mm_storeu_ps(out[4], cy);
+            _mm_storeu_ps(out[5], cz);
+            _mm_storeu_ps(out[6], sx);
+            _mm_storeu_ps(out[7], sy);
+            _mm_storeu_ps(out[8], sz);
+
+            int lanes = n - i < 4 ? n - i : 4;
+            for (int l = 0; l < lanes; l++)
             {
-                float tmp_depth = edge_depths[j];
-                edge_depths[j] = edge_depths[j + 1];
-                edge_depths[j + 1] = tmp_depth;
-
-                int tmp_idx = sorted_edge_indices[j];
-                sorted_edge_indices[j] = sorted_edge_indices[j + 1];
-                sorted_edge_indices[j + 1] = tmp_idx;
+                world[i + l] = vec3f_create(out[0][l], out[1][l], out[2][l]);
+                camera[i + l] = vec3f_create(out[3][l], out[4][l], out[5][l]);
+                screen[i + l] = vec3f_create(out[6][l], out[7][l], out[8][l]);
+                clip_out[i + l] = (vec4_t){out[9][l], out[10][l], out[11][l], out[12][l]};
             }
         }
+        stage->count += n;
     }
 
-    // Draw sorted edges
-    for (int i = 0; i < obj->edge_count; i++)
+    STATS_END(RENDER_STAGE_PROJECT);
+    STATS_ADD(RENDER_COUNTER_VERTICES, (long long)n * instance_count);
+    return 0;
+#else
+    for (int k = 0; k < instance_count; k++)
     {
-        int edge_idx = sorted_edge_indices[i];
-        int v0_idx = obj->edges[edge_idx][0];
-        int v1_idx = obj->edges[edge_idx][1];
+        if (vertex_stage_append(stage, obj, local_to_world[k], world_to_camera, projection, canvas_width, canvas_height) != 0)
+            return -1;
+    }
+    return 0;
+#endif
+}
+
+// Checks if a pixel (x, y) is inside a circular drawing area defined by the canvas
+int clip_to_circular_viewport(canvas_t *canvas, float x, float y)
+{
+    if (!canvas)
+        return 0;
 
-        // transformation local to wolrd
-        vec3_t v0_world = mat4_transform_vec3(local_to_world, obj->vertices[v0_idx]);
-        vec3_t v1_world = mat4_transform_vec3(local_to_world, obj->vertices[v1_idx]);
-        // vector of the edge
-        vec3_t edge_dir = vec3_sub(v1_world, v0_world);
+    // Calculate the center of the canvas
+    float center_x = canvas->width * 0.5f;
+    float center_y = canvas->height * 0.5f;
 
-        // calculate the light
-        float intensity = compute_lighting(edge_dir, lights, num_lights);
+    // check whether the radius is the minimum of half of the width or half of the height to make sure that the circle is fit to the canvas
+    float radius = fminf(canvas->width * 0.5f, canvas->height * 0.5f);
 
-        //
-        vec3_t p0 = projected_vertices[v0_idx];
-        vec3_t p1 = projected_vertices[v1_idx];
+    // Calculate the distance from the pixel (x, y) to the center
+    float dx = x - center_x;
+    float dy = y - center_y;
 
-        // cliping and draw
-        if (clip_to_circular_viewport(canvas, p0.x, p0.y) &&
-            clip_to_circular_viewport(canvas, p1.x, p1.y))
-        {
-            draw_line_f(canvas, p0.x, p0.y, p1.x, p1.y, 1.5f, intensity);
-        }
+    // Return 1 if the pixel is inside the circular viewport, 0 otherwise (squared, so no sqrt)
+    return dx * dx + dy * dy <= radius * radius;
+}
+
+// Draw wireframe with depth sorting and lighting
+// Draw wireframe using logarithmic z-buffer
+void wireframe(canvas_t *canvas, object3d_t *obj,
+               mat4_t local_to_world, mat4_t world_to_camera, mat4_t projection,
+               light_t *lights, int num_lights,
+               float z_near, float z_far)
+{
+    if (!canvas || !obj)
+        return;
+
+    // a scene with one object
+    scene_t scene;
+    scene_init(&scene);
+    scene_begin(&scene, world_to_camera, projection, lights, num_lights, z_near, z_far);
+    if (scene_add(&scene, obj, local_to_world) == 0)
+    {
+        scene_render(&scene, canvas);
     }
+    scene_free(&scene);
+}
+
+// Draw many copies of one object
+void wireframe_instanced(canvas_t *canvas, const object3d_t *obj,
+                         const mat4_t *local_to_world, const float *intensities, int instance_count,
+                         mat4_t world_to_camera, mat4_t projection,
+                         const light_t *lights, int num_lights,
+                         float z_near, float z_far)
+{
+    if (!canvas || !obj)
+        return;
 
-    // free the memory
-    free(projected_vertices);
-    free(edge_depths);
-    free(sorted_edge_indices);
+    scene_t scene;
+    scene_init(&scene);
+    scene_begin(&scene, world_to_camera, projection, lights, num_lights, z_near, z_far);
+    if (scene_add_instances(&scene, obj, local_to_world, intensities, instance_count) == 0)
+    {
+        scene_render(&scene, canvas);
+    }
+    scene_free(&scene);
 }
 
 // Generate soccer ball (truncated icosahedron)
 object3d_t *generate_soccer_ball()
 {
     // allocate the memory for the object
-    object3d_t *obj = (object3d_t *)malloc(sizeof(object3d_t));
-    // set the object values
-    obj->vertex_count = 60;
-    obj->edge_count = 90;
-
-    // set the object structure values
-    obj->vertices = (vec3_t *)malloc(obj->vertex_count * sizeof(vec3_t));
-    obj->edges = (int (*)[2])malloc(obj->edge_count * sizeof(int[2]));
+    object3d_t *obj = object3d_create(60, 90);
+    if (!obj)
+        return NULL;
 
     // Vertex coordinates from data file
     float vertices_data[] = {
@@ -188,8 +554,9 @@ object3d_t *generate_soccer_ball()
     // create vectors for each vertex in the object file
     for (int i = 0; i < obj->vertex_count; i++)
     {
-        obj->vertices[i] = vec3_create(vertices_data[i * 3], vertices_data[i * 3 + 1], vertices_data[i * 3 + 2]);
+        obj->vertices[i] = vec3f_create(vertices_data[i * 3], vertices_data[i * 3 + 1], vertices_data[i * 3 + 2]);
     }
+    object3d_compute_bounds(obj);
 
     // Edge list from data file
     int edges_data[] = {
@@ -0,0 +1,497 @@
+#include "scene.h"
+#include "raster.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <math.h>
+
+// Start an empty scene
+void scene_init(scene_t *scene)
+{
+    scene->world_to_camera = mat4_identity();
+    scene->projection = mat4_identity();
+    light_set_init(&scene->lights);
+    scene->z_near = 0.1f;
+    scene->z_far = 100.0f;
+
+    scene->items = NULL;
+    scene->item_count = 0;
+    scene->item_capacity = 0;
+
+    vertex_stage_init(&scene->stage);
+    scene->visible = NULL;
+    scene->visible_count = 0;
+    scene->vertex_base = NULL;
+    scene->edges = NULL;
+    scene->edge_depths = NULL;
+    scene->edge_light = NULL;
+    scene->lines = NULL;
+    scene->edge_dirs = NULL;
+    scene->dir_capacity = 0;
+    scene->light_cache = NULL;
+    scene->cache_capacity = 0;
+    scene->vertex_inside = NULL;
+    scene->inside_capacity = 0;
+    scene->transforms = NULL;
+    scene->transform_capacity = 0;
+    scene->edge_capacity = 0;
+    scene->base_capacity = 0;
+    depth_sorter_init(&scene->sorter, 32);
+}
+
+// Free the buffers
+void scene_free(scene_t *scene)
+{
+    free(scene->items);
+    vertex_stage_free(&scene->stage);
+    free(scene->visible);
+    free(scene->vertex_base);
+    free(scene->edges);
+    free(scene->edge_depths);
+    free(scene->edge_light);
+    free(scene->lines);
+    free(scene->edge_dirs);
+    for (int i = 0; i < scene->cache_capacity; i++)
+    {
+        free(scene->light_cache[i].edge_light);
+    }
+    free(scene->light_cache);
+    light_set_free(&scene->lights);
+    free(scene->vertex_inside);
+    free(scene->transforms);
+    depth_sorter_free(&scene->sorter);
+    scene_init(scene);
+}
+
+// Start a new frame
+void scene_begin(scene_t *scene, mat4_t world_to_camera, mat4_t projection,
+                 const light_t *lights, int num_lights, float z_near, float z_far)
+{
+    scene->world_to_camera = world_to_camera;
+    scene->projection = projection;
+    light_set_assign(&scene->lights, lights, num_lights);
+    scene->z_near = z_near;
+    scene->z_far = z_far;
+    scene->item_count = 0;
+}
+
+// make room for count more items
+static int scene_reserve_items(scene_t *scene, int count)
+{
+    if (scene->item_count + count <= scene->item_capacity)
+        return 0;
+
+    int capacity = scene->item_capacity ? scene->item_capacity * 2 : 16;
+    if (capacity < scene->item_count + count)
+        capacity = scene->item_count + count;
+    scene_item_t *items = (scene_item_t *)realloc(scene->items, capacity * sizeof(scene_item_t));
+    if (!items)
+        return -1;
+    scene->items = items;
+    scene->item_capacity = capacity;
+    return 0;
+}
+
+// Add an object
+int scene_add(scene_t *scene, const object3d_t *obj, mat4_t local_to_world)
+{
+    if (!scene || !obj || scene_reserve_items(scene, 1) != 0)
+        return -1;
+
+    scene_item_t *item = &scene->items[scene->item_count++];
+    item->obj = obj;
+    item->local_to_world = local_to_world;
+    item->intensity = 1.0f;
+    item->lod = NULL;
+    return 0;
+}
+
+// Add an object with levels of detail
+int scene_add_lod(scene_t *scene, const object3d_lod_t *lod, mat4_t local_to_world)
+{
+    if (!lod || lod->level_count < 1 || scene_add(scene, lod->levels[0], local_to_world) != 0)
+        return -1;
+    scene->items[scene->item_count - 1].lod = lod;
+    return 0;
+}
+
+// Add many instances of one mesh
+int scene_add_instances(scene_t *scene, const object3d_t *obj,
+                        const mat4_t *transforms, const float *intensities, int count)
+{
+    if (!scene || !obj || (count > 0 && !transforms) || count < 0)
+        return -1;
+    if (scene_reserve_items(scene, count) != 0)
+        return -1;
+
+    for (int i = 0; i < count; i++)
+    {
+        scene_item_t *item = &scene->items[scene->item_count++];
+        item->obj = obj;
+        item->local_to_world = transforms[i];
+        item->intensity = intensities ? intensities[i] : 1.0f;
+        item->lod = NULL;
+    }
+    return 0;
+}
+
+// make room for the edges and the item bases
+static int scene_reserve(scene_t *scene, int edge_count)
+{
+    if (scene->item_count > scene->base_capacity)
+    {
+        int *base = (int *)realloc(scene->vertex_base, scene->item_count * sizeof(int));
+        if (base)
+            scene->vertex_base = base;
+        int *visible = (int *)realloc(scene->visible, scene->item_count * sizeof(int));
+        if (visible)
+            scene->visible = visible;
+        if (!base || !visible)
+            return -1;
+        scene->base_capacity = scene->item_count;
+    }
+
+    if (edge_count > scene->edge_capacity)
+    {
+        free(scene->edges);
+        free(scene->edge_depths);
+        free(scene->edge_light);
+        free(scene->lines);
+        scene->edges = (int (*)[2])malloc(edge_count * sizeof(int[2]));
+        scene->edge_depths = (float *)malloc(edge_count * sizeof(float));
+        scene->edge_light = (float *)malloc(edge_count * sizeof(float));
+        scene->lines = (line_t *)malloc(edge_count * sizeof(line_t));
+        scene->edge_capacity = edge_count;
+        if (!scene->edges || !scene->edge_depths || !scene->edge_light || !scene->lines)
+        {
+            scene->edge_capacity = 0;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// make room for count items in the light cache, new entries are empty
+static int scene_reserve_cache(scene_t *scene, int count)
+{
+    if (count <= scene->cache_capacity)
+        return 0;
+
+    scene_light_cache_t *cache = (scene_light_cache_t *)realloc(scene->light_cache, count * sizeof(scene_light_cache_t));
+    if (!cache)
+        return -1;
+    for (int i = scene->cache_capacity; i < count; i++)
+    {
+        cache[i].obj = NULL;
+        cache[i].edge_light = NULL;
+        cache[i].capacity = 0;
+    }
+    scene->light_cache = cache;
+    scene->cache_capacity = count;
+    return 0;
+}
+
+// get the lighting of the edges of item index, computed again only if its mesh, rotation/scale or the lights changed
+// base is the first vertex of the item in the stage
+static const float *scene_item_lighting(scene_t *scene, int index, int base)
+{
+    const scene_item_t *item = &scene->items[index];
+    const object3d_t *obj = item->obj;
+    scene_light_cache_t *entry = &scene->light_cache[index];
+
+    int hit = entry->obj == obj && entry->light_version == scene->lights.version;
+    for (int r = 0; hit && r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            if (entry->linear[r][c] != item->local_to_world.m[r][c])
+                hit = 0;
+        }
+    }
+    if (hit)
+        return entry->edge_light;
+
+    if (obj->edge_count > entry->capacity)
+    {
+        float *edge_light = (float *)realloc(entry->edge_light, obj->edge_count * sizeof(float));
+        if (!edge_light)
+            return NULL;
+        entry->edge_light = edge_light;
+        entry->capacity = obj->edge_count;
+    }
+    if (obj->edge_count > scene->dir_capacity)
+    {
+        vec3f_t *dirs = (vec3f_t *)realloc(scene->edge_dirs, obj->edge_count * sizeof(vec3f_t));
+        if (!dirs)
+            return NULL;
+        scene->edge_dirs = dirs;
+        scene->dir_capacity = obj->edge_count;
+    }
+
+    // calculate the light from the world space vector of every edge
+    const vec3f_t *world = scene->stage.world + base;
+    if (obj->edges16)
+    {
+        for (int j = 0; j < obj->edge_count; j++)
+            scene->edge_dirs[j] = vec3f_sub(world[obj->edges16[j][1]], world[obj->edges16[j][0]]);
+    }
+    else
+    {
+        for (int j = 0; j < obj->edge_count; j++)
+            scene->edge_dirs[j] = vec3f_sub(world[obj->edges[j][1]], world[obj->edges[j][0]]);
+    }
+    light_set_evaluate_batch(&scene->lights, scene->edge_dirs, obj->edge_count, entry->edge_light);
+
+    entry->obj = obj;
+    entry->light_version = scene->lights.version;
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+            entry->linear[r][c] = item->local_to_world.m[r][c];
+    }
+    return entry->edge_light;
+}
+
+// draw the objects, the stages are timed when the stats are compiled in
+static void scene_draw(scene_t *scene, canvas_t *canvas)
+{
+
+    if (scene_reserve(scene, 0) != 0 || scene_reserve_cache(scene, scene->item_count) != 0)
+        return;
+
+    // frustum culling with the bounding spheres
+    STATS_BEGIN(RENDER_STAGE_CULL);
+    mat4_t view_projection = mat4_multiply(scene->projection, scene->world_to_camera);
+    int edge_count = 0;
+    scene->visible_count = 0;
+    for (int i = 0; i < scene->item_count; i++)
+    {
+        scene_item_t *item = &scene->items[i];
+        if (item->lod)
+        {
+            // the level for the size of the object on this canvas (all the levels have the source bounds)
+            float size = object3d_projected_size(item->lod->levels[0], item->local_to_world, scene->world_to_camera,
+                                                 scene->projection, canvas->width, canvas->height);
+            item->obj = item->lod->levels[object3d_lod_select(item->lod, size)];
+        }
+        if (item->obj->has_bounds &&
+            !object3d_in_frustum(item->obj, mat4_multiply(view_projection, item->local_to_world),
+                                 scene->z_near, scene->z_far))
+        {
+            STATS_ADD(RENDER_COUNTER_EDGES_CULLED, item->obj->edge_count);
+            continue;
+        }
+        scene->visible[scene->visible_count++] = i;
+        edge_count += item->obj->edge_count;
+    }
+    STATS_END(RENDER_STAGE_CULL);
+    if (edge_count == 0 || scene_reserve(scene, edge_count) != 0)
+        return;
+
+    // project the vertices of every visible object into one stage
+    const int *visible = scene->visible;
+    int visible_count = scene->visible_count;
+    vertex_stage_t *stage = &scene->stage;
+    stage->count = 0;
+    for (int i = 0; i < visible_count;)
+    {
+        // a run of items that use the same mesh
+        const object3d_t *obj = scene->items[visible[i]].obj;
+        int run = 1;
+        while (i + run < visible_count && scene->items[visible[i + run]].obj == obj)
+            run++;
+
+        for (int k = 0; k < run; k++)
+        {
+            scene->vertex_base[i + k] = stage->count + k * obj->vertex_count;
+        }
+
+        if (run == 1)
+        {
+            if (vertex_stage_append(stage, obj, scene->items[visible[i]].local_to_world,
+                                    scene->world_to_camera, scene->projection,
+                                    canvas->width, canvas->height) != 0)
+                return;
+        }
+        else
+        {
+            // the instances are transformed together, so gather their matrices
+            if (run > scene->transform_capacity)
+            {
+                mat4_t *transforms = (mat4_t *)realloc(scene->transforms, run * sizeof(mat4_t));
+                if (!transforms)
+                    return;
+                scene->transforms = transforms;
+                scene->transform_capacity = run;
+            }
+            for (int k = 0; k < run; k++)
+            {
+                scene->transforms[k] = scene->items[visible[i + k]].local_to_world;
+            }
+            if (vertex_stage_append_instances(stage, obj, scene->transforms, run,
+                                              scene->world_to_camera, scene->projection,
+                                              canvas->width, canvas->height) != 0)
+                return;
+        }
+        i += run;
+    }
+
+    // one edge list with stage vertex indices
+    STATS_BEGIN(RENDER_STAGE_LIGHT);
+    int (*edges)[2] = scene->edges;
+    int e = 0;
+    for (int i = 0; i < visible_count; i++)
+    {
+        const scene_item_t *item = &scene->items[visible[i]];
+        const object3d_t *obj = item->obj;
+        int base = scene->vertex_base[i];
+        const float *light = scene_item_lighting(scene, visible[i], base);
+        if (!light)
+            return;
+        float scale = item->intensity;
+        for (int j = 0; j < obj->edge_count; j++)
+        {
+            edges[e][0] = (obj->edges16 ? obj->edges16[j][0] : obj->edges[j][0]) + base;
+            edges[e][1] = (obj->edges16 ? obj->edges16[j][1] : obj->edges[j][1]) + base;
+            scene->edge_light[e] = light[j] * scale;
+            e++;
+        }
+    }
+    STATS_END(RENDER_STAGE_LIGHT);
+
+    // which vertices are inside the viewport, so most edges need no clipping
+    STATS_BEGIN(RENDER_STAGE_DEPTH);
+    if (stage->count > scene->inside_capacity)
+    {
+        unsigned char *inside = (unsigned char *)realloc(scene->vertex_inside, stage->capacity);
+        if (!inside)
+            return;
+        scene->vertex_inside = inside;
+        scene->inside_capacity = stage->capacity;
+    }
+    viewport_circle_t circle = viewport_circle_for_canvas(canvas);
+    viewport_classify_circle(&circle, stage->screen, stage->count, scene->vertex_inside);
+
+    // get the log values
+    float log_z_near = logf(scene->z_near + 1.0f); // 1 to avoid log 0
+    float log_z_far = logf(scene->z_far + 1.0f);
+
+    // with a depth plane every pixel is depth tested, so the edges need no sorting
+    const int *sorted_edge_indices = NULL;
+    if (!canvas->depth)
+    {
+        for (int i = 0; i < edge_count; i++)
+        {
+            // camera space depth of the two vertices
+            float z0 = fabsf(stage->camera[edges[i][0]].z);
+            float z1 = fabsf(stage->camera[edges[i][1]].z);
+            float avg_z = (z0 + z1) * 0.5f;
+
+            // from the formula
+            scene->edge_depths[i] = (logf(avg_z + 1.0f) - log_z_near) / (log_z_far - log_z_near);
+        }
+    }
+    STATS_END(RENDER_STAGE_DEPTH);
+
+    if (!canvas->depth)
+    {
+        // sort edges back to front (stable, so equal depths keep the submission order)
+        STATS_BEGIN(RENDER_STAGE_SORT);
+        sorted_edge_indices = depth_sort_back_to_front(&scene->sorter, scene->edge_depths, edge_count);
+        STATS_END(RENDER_STAGE_SORT);
+        if (!sorted_edge_indices)
+            return;
+    }
+
+    STATS_BEGIN(RENDER_STAGE_CLIP);
+    int line_count = 0;
+    for (int i = 0; i < edge_count; i++)
+    {
+        int edge_idx = sorted_edge_indices ? sorted_edge_indices[i] : i;
+        int v0_idx = edges[edge_idx][0];
+        int v1_idx = edges[edge_idx][1];
+
+        vec3f_t p0 = stage->screen[v0_idx];
+        vec3f_t p1 = stage->screen[v1_idx];
+        float cz0 = stage->camera[v0_idx].z;
+        float cz1 = stage->camera[v1_idx].z;
+
+        // near plane, the part behind the camera would be projected through w = 0 to the wrong side
+        int inside = scene->vertex_inside[v0_idx] && scene->vertex_inside[v1_idx];
+        if (cz0 < scene->z_near || cz1 < scene->z_near)
+        {
+            inside = 0;
+            float t0, t1;
+            if (!clip_segment_near(cz0, cz1, scene->z_near, &t0, &t1))
+                continue;
+
+            // move the clipped ends to the plane, clip space is linear in the camera space position
+            vec4_t c0 = stage->clip[v0_idx];
+            vec4_t c1 = stage->clip[v1_idx];
+            vec4_t d = {c1.x - c0.x, c1.y - c0.y, c1.z - c0.z, c1.w - c0.w};
+            float dz = cz1 - cz0;
+            if (t0 > 0.0f)
+            {
+                p0 = clip_to_screen((vec4_t){c0.x + d.x * t0, c0.y + d.y * t0, c0.z + d.z * t0, c0.w + d.w * t0},
+                                    canvas->width, canvas->height);
+                cz0 = stage->camera[v0_idx].z + dz * t0;
+            }
+            if (t1 < 1.0f)
+            {
+                p1 = clip_to_screen((vec4_t){c0.x + d.x * t1, c0.y + d.y * t1, c0.z + d.z * t1, c0.w + d.w * t1},
+                                    canvas->width, canvas->height);
+                cz1 = stage->camera[v0_idx].z + dz * t1;
+            }
+        }
+
+        // trim the edge to the circular viewport
+        if (!inside)
+        {
+            float t0, t1;
+            if (!clip_segment_circle(&circle, p0.x, p0.y, p1.x, p1.y, &t0, &t1))
+                continue;
+
+            // the depth is not linear on the screen but its inverse is
+            float dx = p1.x - p0.x, dy = p1.y - p0.y;
+            float w0 = 1.0f / cz0, w1 = 1.0f / cz1;
+            if (t1 < 1.0f)
+            {
+                p1 = vec3f_create(p0.x + dx * t1, p0.y + dy * t1, p1.z);
+                cz1 = 1.0f / (w0 + (w1 - w0) * t1);
+            }
+            if (t0 > 0.0f)
+            {
+                p0 = vec3f_create(p0.x + dx * t0, p0.y + dy * t0, p0.z);
+                cz0 = 1.0f / (w0 + (w1 - w0) * t0);
+            }
+        }
+
+        float intensity = scene->edge_light[edge_idx];
+
+        // normalized log depth of the two ends for the depth plane
+        float d0 = 0.0f, d1 = 0.0f;
+        if (canvas->depth)
+        {
+            d0 = (logf(fabsf(cz0) + 1.0f) - log_z_near) / (log_z_far - log_z_near);
+            d1 = (logf(fabsf(cz1) + 1.0f) - log_z_near) / (log_z_far - log_z_near);
+        }
+        scene->lines[line_count++] = (line_t){p0.x, p0.y, p1.x, p1.y, 1.5f, intensity, d0, d1};
+    }
+
+    STATS_END(RENDER_STAGE_CLIP);
+    STATS_ADD(RENDER_COUNTER_EDGES_CULLED, edge_count - line_count);
+    STATS_ADD(RENDER_COUNTER_EDGES_DRAWN, line_count);
+
+    // draw all the lines (tiled and in parallel if the canvas is set up for it)
+    canvas_draw_lines(canvas, scene->lines, line_count);
+}
+
+// Draw all the objects of the scene
+void scene_render(scene_t *scene, canvas_t *canvas)
+{
+    if (!scene || !canvas || scene->item_count == 0)
+        return;
+
+    STATS_BEGIN(RENDER_STAGE_SCENE);
+    scene_draw(scene, canvas);
+    STATS_END(RENDER_STAGE_SCENE);
+}
@@ -0,0 +1,163 @@
+#include "sequence.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+// state of a frame slot
+enum
+{
+    SLOT_FREE,      // waiting for a worker to render slot->frame
+    SLOT_RENDERING, // a worker is drawing into the canvas
+    SLOT_READY      // waiting for the output stage
+};
+
+// one canvas in the ring between the workers and the output
+typedef struct
+{
+    canvas_t *canvas;
+    int frame; // the frame this slot holds next
+    int state;
+} frame_slot_t;
+
+// shared state of one render_sequence call
+typedef struct
+{
+    const sequence_desc_t *desc;
+    frame_slot_t *slots;
+    int slot_count;
+    int next_frame; // next frame a worker will take
+    int stop;       // set when the output asks to stop
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} sequence_state_t;
+
+// worker: take the next frame, wait for its slot and render it
+static void *sequence_worker(void *arg)
+{
+    sequence_state_t *state = (sequence_state_t *)arg;
+    const sequence_desc_t *desc = state->desc;
+    int end = desc->first_frame + desc->frame_count;
+
+    pthread_mutex_lock(&state->lock);
+    while (!state->stop && state->next_frame < end)
+    {
+        int frame = state->next_frame++;
+        frame_slot_t *slot = &state->slots[(frame - desc->first_frame) % state->slot_count];
+
+        // the slot is free once the output stage is done with the frame slot_count before this one
+        while (!state->stop && (slot->state != SLOT_FREE || slot->frame != frame))
+            pthread_cond_wait(&state->changed, &state->lock);
+        if (state->stop)
+            break;
+
+        slot->state = SLOT_RENDERING;
+        pthread_mutex_unlock(&state->lock);
+
+        float t = (float)(frame - desc->first_frame) / desc->frame_count;
+        desc->render(slot->canvas, frame, t, desc->user);
+
+        pthread_mutex_lock(&state->lock);
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&state->changed);
+    }
+    pthread_mutex_unlock(&state->lock);
+    return NULL;
+}
+
+// Render a range of frames on a thread pool
+int render_sequence(const sequence_desc_t *desc)
+{
+    if (!desc || !desc->render || desc->frame_count <= 0)
+        return -1;
+
+    int num_threads = desc->num_threads > 0 ? desc->num_threads : parallel_thread_count();
+    if (num_threads > desc->frame_count)
+        num_threads = desc->frame_count;
+
+    // two canvases per thread so a worker can start the next frame while the output is busy
+    sequence_state_t state;
+    state.desc = desc;
+    state.slot_count = num_threads * 2;
+    state.next_frame = desc->first_frame;
+    state.stop = 0;
+    state.slots = (frame_slot_t *)calloc(state.slot_count, sizeof(frame_slot_t));
+    pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    if (!state.slots || !threads)
+    {
+        free(state.slots);
+        free(threads);
+        return -1;
+    }
+
+    int ok = 1;
+    for (int i = 0; i < state.slot_count; i++)
+    {
+        state.slots[i].canvas = canvas_create(desc->width, desc->height);
+        state.slots[i].frame = desc->first_frame + i;
+        state.slots[i].state = SLOT_FREE;
+        if (!state.slots[i].canvas)
+            ok = 0;
+    }
+
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.changed, NULL);
+
+    // start the workers
+    int started = 0;
+    for (; ok && started < num_threads; started++)
+    {
+        if (pthread_create(&threads[started], NULL, sequence_worker, &state) != 0)
+            break;
+    }
+
+    // output stage: take the frames in order on this thread
+    int output_count = 0;
+    if (started > 0)
+    {
+        int end = desc->first_frame + desc->frame_count;
+        for (int frame = desc->first_frame; frame < end; frame++)
+        {
+            frame_slot_t *slot = &state.slots[(frame - desc->first_frame) % state.slot_count];
+
+            pthread_mutex_lock(&state.lock);
+            while (slot->state != SLOT_READY || slot->frame != frame)
+                pthread_cond_wait(&state.changed, &state.lock);
+            pthread_mutex_unlock(&state.lock);
+
+            int stop = desc->output ? desc->output(slot->canvas, frame, desc->user) : 0;
+            output_count++;
+
+            // give the slot to the frame slot_count after this one
+            pthread_mutex_lock(&state.lock);
+            slot->frame = frame + state.slot_count;
+            slot->state = SLOT_FREE;
+            state.stop = stop;
+            pthread_cond_broadcast(&state.changed);
+            pthread_mutex_unlock(&state.lock);
+
+            if (stop)
+                break;
+        }
+    }
+    else
+    {
+        ok = 0;
+    }
+
+    // wait for the workers
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&state.changed);
+    pthread_mutex_destroy(&state.lock);
+    for (int i = 0; i < state.slot_count; i++)
+    {
+        canvas_destroy(state.slots[i].canvas);
+    }
+    free(state.slots);
+    free(threads);
+
+    return ok ? output_count : -1;
+}
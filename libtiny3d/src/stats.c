@@ -0,0 +1,220 @@
+#include "stats.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *stage_names[RENDER_STAGE_COUNT] = {
+    "scene", "cull", "project", "light", "depth", "sort", "clip", "raster", "output"};
+static const char *counter_names[RENDER_COUNTER_COUNT] = {
+    "vertices", "edges_culled", "edges_drawn", "pixels", "bytes_written"};
+
+// Name of a stage
+const char *render_stats_stage_name(int stage)
+{
+    return stage >= 0 && stage < RENDER_STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+// Name of a counter
+const char *render_stats_counter_name(int counter)
+{
+    return counter >= 0 && counter < RENDER_COUNTER_COUNT ? counter_names[counter] : "unknown";
+}
+
+#ifdef TINY3D_STATS
+#include <pthread.h>
+
+#define TRACE_MAX_EVENTS (1 << 20)
+
+// one run of a stage
+typedef struct
+{
+    double start;
+    double seconds;
+    int stage;
+    int thread;
+} trace_event_t;
+
+// the totals are updated with atomic adds so the render and raster threads can all record
+static long long stage_ns[RENDER_STAGE_COUNT];
+static long long stage_calls[RENDER_STAGE_COUNT];
+static long long counters[RENDER_COUNTER_COUNT];
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int trace_enabled = 0;
+static trace_event_t *trace_events = NULL;
+static int trace_count = 0;
+static int trace_capacity = 0;
+static double trace_origin = 0.0; // time of the first event, the trace starts at 0
+
+static int next_thread_id = 0;
+static __thread int thread_id = -1;
+
+int render_stats_enabled(void)
+{
+    return 1;
+}
+
+// Time for STATS_BEGIN
+double render_stats_now(void)
+{
+    return parallel_time_seconds();
+}
+
+// Add a finished stage run
+void render_stats_record(int stage, double start)
+{
+    double seconds = parallel_time_seconds() - start;
+    __atomic_fetch_add(&stage_ns[stage], (long long)(seconds * 1e9), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stage_calls[stage], 1, __ATOMIC_RELAXED);
+
+    if (!__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED))
+        return;
+    if (thread_id < 0)
+        thread_id = __atomic_fetch_add(&next_thread_id, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&trace_lock);
+    if (trace_count == trace_capacity && trace_capacity < TRACE_MAX_EVENTS)
+    {
+        int capacity = trace_capacity ? trace_capacity * 2 : 4096;
+        trace_event_t *events = (trace_event_t *)realloc(trace_events, capacity * sizeof(trace_event_t));
+        if (events)
+        {
+            trace_events = events;
+            trace_capacity = capacity;
+        }
+    }
+    if (trace_count < trace_capacity)
+    {
+        if (trace_count == 0)
+            trace_origin = start;
+        trace_events[trace_count++] = (trace_event_t){start, seconds, stage, thread_id};
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+// Add to a counter
+void render_stats_add(int counter, long long count)
+{
+    __atomic_fetch_add(&counters[counter], count, __ATOMIC_RELAXED);
+}
+
+// Copy the totals
+void render_stats_get(render_stats_t *stats)
+{
+    if (!stats)
+        return;
+    for (int i = 0; i < RENDER_STAGE_COUNT; i++)
+    {
+        stats->seconds[i] = __atomic_load_n(&stage_ns[i], __ATOMIC_RELAXED) * 1e-9;
+        stats->calls[i] = __atomic_load_n(&stage_calls[i], __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < RENDER_COUNTER_COUNT; i++)
+        stats->counters[i] = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+}
+
+// Clear everything
+void render_stats_reset(void)
+{
+    for (int i = 0; i < RENDER_STAGE_COUNT; i++)
+    {
+        __atomic_store_n(&stage_ns[i], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stage_calls[i], 0, __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < RENDER_COUNTER_COUNT; i++)
+        __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&trace_lock);
+    trace_count = 0;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+// Turn the trace on or off
+void render_stats_trace(int enable)
+{
+    __atomic_store_n(&trace_enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+// Write the Chrome trace
+int render_stats_write_trace(const char *filename)
+{
+    if (!filename)
+        return -1;
+    FILE *fp = fopen(filename, "w");
+    if (!fp)
+        return -1;
+
+    // complete ("X") events in microseconds, one track per thread
+    pthread_mutex_lock(&trace_lock);
+    fprintf(fp, "{\"traceEvents\": [\n");
+    double end = 0.0;
+    for (int i = 0; i < trace_count; i++)
+    {
+        const trace_event_t *event = &trace_events[i];
+        double ts = (event->start - trace_origin) * 1e6;
+        fprintf(fp, "  {\"name\": \"%s\", \"cat\": \"tiny3d\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d},\n",
+                stage_names[event->stage], ts, event->seconds * 1e6, event->thread);
+        if (ts + event->seconds * 1e6 > end)
+            end = ts + event->seconds * 1e6;
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    // the counter totals as one counter event at the end of the trace
+    render_stats_t stats;
+    render_stats_get(&stats);
+    fprintf(fp, "  {\"name\": \"counters\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"args\": {", end);
+    for (int i = 0; i < RENDER_COUNTER_COUNT; i++)
+        fprintf(fp, "%s\"%s\": %lld", i ? ", " : "", counter_names[i], stats.counters[i]);
+    fprintf(fp, "}}\n], \"displayTimeUnit\": \"ms\"}\n");
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+#else
+
+// without TINY3D_STATS nothing is recorded
+
+int render_stats_enabled(void)
+{
+    return 0;
+}
+
+double render_stats_now(void)
+{
+    return 0.0;
+}
+
+void render_stats_record(int stage, double start)
+{
+    (void)stage;
+    (void)start;
+}
+
+void render_stats_add(int counter, long long count)
+{
+    (void)counter;
+    (void)count;
+}
+
+void render_stats_get(render_stats_t *stats)
+{
+    if (stats)
+        memset(stats, 0, sizeof(*stats));
+}
+
+void render_stats_reset(void)
+{
+}
+
+void render_stats_trace(int enable)
+{
+    (void)enable;
+}
+
+int render_stats_write_trace(const char *filename)
+{
+    (void)filename;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,172 @@
+#include "stream.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+#include <io.h> // _setmode
+#endif
+
+// write all of buffer, pipes can take less than asked for
+static int write_all(int fd, const unsigned char *buffer, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, buffer, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buffer += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+// Start a stream on a file descriptor
+int frame_stream_open_fd(frame_stream_t *stream, int fd, frame_stream_format_t format,
+                         int width, int height, int bit_depth, int fps_num, int fps_den)
+{
+    if (!stream)
+        return -1;
+    memset(stream, 0, sizeof(*stream));
+    stream->fd = -1;
+    if (fd < 0 || width <= 0 || height <= 0)
+        return -1;
+    if (format == FRAME_STREAM_Y4M ? (bit_depth != 8 || fps_num <= 0 || fps_den <= 0)
+                                   : (format != FRAME_STREAM_PGM || (bit_depth != 8 && bit_depth != 16)))
+        return -1;
+
+    // the header of every frame and the size of the planes after it
+    char header[64];
+    size_t pixels = (size_t)width * height;
+    size_t chroma = 0;
+    int header_len;
+    if (format == FRAME_STREAM_Y4M)
+    {
+        header_len = snprintf(header, sizeof(header), "FRAME\n");
+        chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    }
+    else
+    {
+        header_len = snprintf(header, sizeof(header), "P5\n%d %d\n%d\n", width, height, bit_depth == 16 ? 65535 : 255);
+        pixels *= bit_depth / 8;
+    }
+
+    stream->frame_size = header_len + pixels + 2 * chroma;
+    stream->frame = (unsigned char *)malloc(stream->frame_size);
+    if (!stream->frame)
+        return -1;
+
+    // only the pixels change from frame to frame, the header and the gray chroma planes are written once here
+    memcpy(stream->frame, header, header_len);
+    memset(stream->frame + header_len + pixels, 128, 2 * chroma);
+    stream->pixel_offset = header_len;
+    stream->fd = fd;
+    stream->format = format;
+    stream->width = width;
+    stream->height = height;
+    stream->bit_depth = bit_depth;
+
+    // the stream header, canvases are 0 to 1 so the luma is full range instead of 16 to 235
+    if (format == FRAME_STREAM_Y4M)
+    {
+        char stream_header[128];
+        int len = snprintf(stream_header, sizeof(stream_header), "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+                           width, height, fps_num, fps_den);
+        if (write_all(fd, (const unsigned char *)stream_header, len) != 0)
+        {
+            free(stream->frame);
+            stream->frame = NULL;
+            return -1;
+        }
+        stream->bytes_written = len;
+    }
+    return 0;
+}
+
+// Start a stream on a new file or stdout
+int frame_stream_open(frame_stream_t *stream, const char *filename, frame_stream_format_t format,
+                      int width, int height, int bit_depth, int fps_num, int fps_den)
+{
+    if (!stream || !filename)
+        return -1;
+    int to_stdout = strcmp(filename, "-") == 0;
+#ifdef _WIN32
+    // the descriptors are in text mode by default, which would turn every 0x0A of the pixels into 0x0D 0x0A
+    int fd = to_stdout ? STDOUT_FILENO : open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (fd >= 0 && to_stdout && _setmode(fd, _O_BINARY) == -1)
+        return -1;
+#else
+    int fd = to_stdout ? STDOUT_FILENO : open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (fd < 0)
+        return -1;
+    if (frame_stream_open_fd(stream, fd, format, width, height, bit_depth, fps_num, fps_den) != 0)
+    {
+        if (!to_stdout)
+            close(fd);
+        return -1;
+    }
+    stream->owns_fd = !to_stdout;
+    return 0;
+}
+
+// Append a frame
+int frame_stream_write(frame_stream_t *stream, const canvas_t *canvas)
+{
+    if (!stream || !stream->frame || stream->failed || !canvas ||
+        canvas->width != stream->width || canvas->height != stream->height)
+        return -1;
+
+    // convert into the reused buffer, then one write for the whole frame
+    STATS_BEGIN(RENDER_STAGE_OUTPUT);
+    unsigned char *dst = stream->frame + stream->pixel_offset;
+    size_t row_bytes = (size_t)canvas->width * (stream->bit_depth / 8);
+    for (int y = 0; y < canvas->height; y++)
+    {
+        if (stream->bit_depth == 16)
+            span_quantize_u16be(canvas_row(canvas, y), dst, canvas->width);
+        else
+            span_quantize_u8(canvas_row(canvas, y), dst, canvas->width);
+        dst += row_bytes;
+    }
+    if (write_all(stream->fd, stream->frame, stream->frame_size) != 0)
+        stream->failed = 1;
+    STATS_END(RENDER_STAGE_OUTPUT);
+    if (stream->failed)
+        return -1;
+
+    STATS_ADD(RENDER_COUNTER_BYTES_WRITTEN, stream->frame_size);
+    stream->bytes_written += stream->frame_size;
+    stream->frame_count++;
+    return 0;
+}
+
+// Output callback for render_sequence
+int frame_stream_output(const canvas_t *canvas, int frame, void *user)
+{
+    (void)frame;
+    return frame_stream_write((frame_stream_t *)user, canvas) != 0;
+}
+
+// Finish the stream
+int frame_stream_close(frame_stream_t *stream)
+{
+    if (!stream)
+        return -1;
+    int ok = !stream->failed;
+    if (stream->owns_fd && close(stream->fd) != 0)
+        ok = 0;
+    free(stream->frame);
+    stream->frame = NULL;
+    stream->fd = -1;
+    stream->owns_fd = 0;
+    return ok ? 0 : -1;
+}
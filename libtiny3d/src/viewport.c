@@ -0,0 +1,120 @@
+#include "viewport.h"
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Get the circle that fits the canvas
+viewport_circle_t viewport_circle_for_canvas(const canvas_t *canvas)
+{
+    viewport_circle_t circle;
+    circle.cx = canvas->width * 0.5f;
+    circle.cy = canvas->height * 0.5f;
+    circle.radius = fminf(canvas->width * 0.5f, canvas->height * 0.5f);
+    circle.radius_sq = circle.radius * circle.radius;
+    return circle;
+}
+
+// Classify all the points against the circle
+void viewport_classify_circle(const viewport_circle_t *circle, const vec3f_t *points, int count, unsigned char *inside)
+{
+    int i = 0;
+#ifdef __SSE2__
+    // four points at a time, the points are x y z triples so gather x and y first
+    __m128 cx = _mm_set1_ps(circle->cx);
+    __m128 cy = _mm_set1_ps(circle->cy);
+    __m128 r2 = _mm_set1_ps(circle->radius_sq);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_setr_ps(points[i].x, points[i + 1].x, points[i + 2].x, points[i + 3].x);
+        __m128 y = _mm_setr_ps(points[i].y, points[i + 1].y, points[i + 2].y, points[i + 3].y);
+        __m128 dx = _mm_sub_ps(x, cx);
+        __m128 dy = _mm_sub_ps(y, cy);
+        int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), r2));
+        inside[i] = mask & 1;
+        inside[i + 1] = (mask >> 1) & 1;
+        inside[i + 2] = (mask >> 2) & 1;
+        inside[i + 3] = (mask >> 3) & 1;
+    }
+#endif
+    for (; i < count; i++)
+    {
+        inside[i] = (unsigned char)viewport_circle_contains(circle, points[i].x, points[i].y);
+    }
+}
+
+// Clip a segment against the circle
+int clip_segment_circle(const viewport_circle_t *circle, float x0, float y0, float x1, float y1, float *t0, float *t1)
+{
+    *t0 = 0.0f;
+    *t1 = 1.0f;
+
+    // p(t) = f + d * t relative to the center
+    float fx = x0 - circle->cx;
+    float fy = y0 - circle->cy;
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float f2 = fx * fx + fy * fy - circle->radius_sq;
+    float ex = x1 - circle->cx;
+    float ey = y1 - circle->cy;
+    float e2 = ex * ex + ey * ey - circle->radius_sq;
+
+    // the disc is convex so both ends inside means the whole segment is
+    if (f2 <= 0.0f && e2 <= 0.0f)
+        return 1;
+
+    // |f + d t|^2 = r^2 is a * t^2 + 2 b t + c = 0
+    float a = dx * dx + dy * dy;
+    float b = fx * dx + fy * dy;
+    if (a <= 0.0f)
+        return 0; // a point outside the circle
+
+    float disc = b * b - a * f2;
+    if (disc < 0.0f)
+        return 0; // the line misses the circle
+
+    float s = sqrtf(disc);
+    float enter = (-b - s) / a;
+    float leave = (-b + s) / a;
+    if (f2 > 0.0f)
+        *t0 = enter;
+    if (e2 > 0.0f)
+        *t1 = leave;
+    return *t0 <= *t1 && *t1 >= 0.0f && *t0 <= 1.0f;
+}
+
+// Clip a segment against a rectangle (Liang-Barsky)
+int clip_segment_rect(float x_min, float y_min, float x_max, float y_max,
+                      float x0, float y0, float x1, float y1, float *t0, float *t1)
+{
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+
+    // for each edge of the rectangle: the inside is p * t <= q
+    float p[4] = {-dx, dx, -dy, dy};
+    float q[4] = {x0 - x_min, x_max - x0, y0 - y_min, y_max - y0};
+
+    float enter = 0.0f;
+    float leave = 1.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        if (p[i] == 0.0f)
+        {
+            // parallel to this edge
+            if (q[i] < 0.0f)
+                return 0;
+            continue;
+        }
+
+        float t = q[i] / p[i];
+        if (p[i] < 0.0f)
+            enter = fmaxf(enter, t);
+        else
+            leave = fminf(leave, t);
+    }
+
+    *t0 = enter;
+    *t1 = leave;
+    return enter <= leave;
+}
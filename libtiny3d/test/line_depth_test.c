@@ -0,0 +1,56 @@
+#include "canvas.h"
+#include <stdio.h>
+#include <math.h>
+
+// A line drawn with the depth test on must be as bright in both directions as with the depth test off:
+// the overlapping stamps of a line going away from the camera must not reject each other
+
+#define WIDTH 400
+#define HEIGHT 100
+
+// sum of all the pixels after drawing one line from depth z0 to z1 (depth off when z0 < 0)
+static double line_total(int coverage, float thickness, float z0, float z1)
+{
+    canvas_t *canvas = canvas_create(WIDTH, HEIGHT);
+    if (!canvas)
+        return -1.0;
+    if (z0 >= 0.0f && canvas_enable_depth(canvas) != 0)
+    {
+        canvas_destroy(canvas);
+        return -1.0;
+    }
+
+    line_t line = {.x0 = 20.0f, .y0 = 50.0f, .x1 = 380.0f, .y1 = 50.0f, .thickness = thickness, .intensity = 0.3f, .z0 = z0, .z1 = z1};
+    canvas_rect_t clip = {0, 0, WIDTH, HEIGHT};
+    if (coverage)
+        draw_line_coverage_f_clipped(canvas, &line, &clip);
+    else
+        draw_line_f_clipped(canvas, &line, &clip);
+
+    double total = 0.0;
+    for (int y = 0; y < HEIGHT; y++)
+        for (int x = 0; x < WIDTH; x++)
+            total += canvas_row(canvas, y)[x];
+    canvas_destroy(canvas);
+    return total;
+}
+
+int main(void)
+{
+    int failed = 0;
+    float thicknesses[] = {1.0f, 3.0f, 8.0f};
+    for (int coverage = 0; coverage < 2; coverage++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            double flat = line_total(coverage, thicknesses[i], -1.0f, -1.0f);
+            double away = line_total(coverage, thicknesses[i], 0.3f, 0.5f);
+            double toward = line_total(coverage, thicknesses[i], 0.5f, 0.3f);
+            int ok = flat > 0.0 && fabs(away - flat) <= 1e-4 * flat && fabs(toward - flat) <= 1e-4 * flat;
+            printf("%s thickness %.0f: no depth %.1f, away %.1f, toward %.1f %s\n", coverage ? "coverage" : "brush",
+                   thicknesses[i], flat, away, toward, ok ? "ok" : "FAILED");
+            failed |= !ok;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,525 @@
+#include "canvas.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+// The PNG writer has its own deflate, crc and adler32, so this test reads the files back with code of its own:
+// the chunks and their crcs are checked, the zlib stream is inflated (stored, fixed and dynamic blocks),
+// the rows are unfiltered and the pixels must be the ones of the binary PGM writer, for every level, both bit
+// depths, sizes that cross the band and stored block boundaries, and the bytes must not depend on the threads
+
+// ---------------------------------------------------------------------------
+// crc32 and adler32 the slow way
+
+static uint32_t crc32_bytes(const unsigned char *data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++)
+            crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+    }
+    return ~crc;
+}
+
+static uint32_t adler32_bytes(const unsigned char *data, size_t size)
+{
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        a = (a + data[i]) % 65521u;
+        b = (b + a) % 65521u;
+    }
+    return a | (b << 16);
+}
+
+static uint32_t read_u32be(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// ---------------------------------------------------------------------------
+// inflate
+
+typedef struct
+{
+    const unsigned char *in;
+    size_t size;
+    size_t pos;
+    uint32_t bits;
+    int count;
+    unsigned char *out;
+    size_t out_size;
+    size_t out_pos;
+    int error;
+} inflate_t;
+
+// canonical huffman code: the number of codes of each length and the symbols in code order
+typedef struct
+{
+    short counts[16];
+    short symbols[288];
+} huffman_t;
+
+static int get_bits(inflate_t *s, int n)
+{
+    while (s->count < n)
+    {
+        if (s->pos >= s->size)
+        {
+            s->error = 1;
+            return 0;
+        }
+        s->bits |= (uint32_t)s->in[s->pos++] << s->count;
+        s->count += 8;
+    }
+    int value = (int)(s->bits & ((1u << n) - 1));
+    s->bits >>= n;
+    s->count -= n;
+    return value;
+}
+
+// returns 0 if the lengths make a valid (possibly incomplete) code
+static int huffman_build(huffman_t *h, const unsigned char *lengths, int n)
+{
+    short offsets[16];
+    memset(h->counts, 0, sizeof(h->counts));
+    for (int i = 0; i < n; i++)
+        h->counts[lengths[i]]++;
+    h->counts[0] = 0;
+    int left = 1;
+    for (int len = 1; len < 16; len++)
+    {
+        left = left * 2 - h->counts[len];
+        if (left < 0)
+            return -1;
+    }
+    offsets[1] = 0;
+    for (int len = 1; len < 15; len++)
+        offsets[len + 1] = offsets[len] + h->counts[len];
+    for (int i = 0; i < n; i++)
+    {
+        if (lengths[i])
+            h->symbols[offsets[lengths[i]]++] = (short)i;
+    }
+    return 0;
+}
+
+static int huffman_decode(inflate_t *s, const huffman_t *h)
+{
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++)
+    {
+        code |= get_bits(s, 1);
+        int count = h->counts[len];
+        if (code - first < count)
+            return h->symbols[index + code - first];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    s->error = 1;
+    return 0;
+}
+
+static const short length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const short length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                       3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const short dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const short dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                     7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// the symbols of one fixed or dynamic block
+static void inflate_codes(inflate_t *s, const huffman_t *lengths, const huffman_t *dists)
+{
+    while (!s->error)
+    {
+        int symbol = huffman_decode(s, lengths);
+        if (symbol < 256)
+        {
+            if (s->out_pos >= s->out_size)
+            {
+                s->error = 1;
+                return;
+            }
+            s->out[s->out_pos++] = (unsigned char)symbol;
+        }
+        else if (symbol == 256)
+        {
+            return;
+        }
+        else
+        {
+            symbol -= 257;
+            if (symbol >= 29)
+            {
+                s->error = 1;
+                return;
+            }
+            int len = length_base[symbol] + get_bits(s, length_extra[symbol]);
+            int d = huffman_decode(s, dists);
+            if (d >= 30)
+            {
+                s->error = 1;
+                return;
+            }
+            size_t dist = (size_t)dist_base[d] + get_bits(s, dist_extra[d]);
+            if (dist > s->out_pos || s->out_pos + len > s->out_size)
+            {
+                s->error = 1;
+                return;
+            }
+            for (int i = 0; i < len; i++, s->out_pos++)
+                s->out[s->out_pos] = s->out[s->out_pos - dist];
+        }
+    }
+}
+
+static void inflate_stored(inflate_t *s)
+{
+    s->bits = 0;
+    s->count = 0;
+    if (s->pos + 4 > s->size)
+    {
+        s->error = 1;
+        return;
+    }
+    unsigned len = s->in[s->pos] | s->in[s->pos + 1] << 8;
+    unsigned nlen = s->in[s->pos + 2] | s->in[s->pos + 3] << 8;
+    s->pos += 4;
+    if (len != (~nlen & 0xFFFF) || s->pos + len > s->size || s->out_pos + len > s->out_size)
+    {
+        s->error = 1;
+        return;
+    }
+    memcpy(s->out + s->out_pos, s->in + s->pos, len);
+    s->pos += len;
+    s->out_pos += len;
+}
+
+static void inflate_fixed(inflate_t *s)
+{
+    unsigned char lengths[288];
+    huffman_t lcode, dcode;
+    for (int i = 0; i < 288; i++)
+        lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    huffman_build(&lcode, lengths, 288);
+    for (int i = 0; i < 30; i++)
+        lengths[i] = 5;
+    huffman_build(&dcode, lengths, 30);
+    inflate_codes(s, &lcode, &dcode);
+}
+
+static void inflate_dynamic(inflate_t *s)
+{
+    static const unsigned char order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    unsigned char lengths[320];
+    huffman_t lcode, dcode;
+    int nlen = get_bits(s, 5) + 257;
+    int ndist = get_bits(s, 5) + 1;
+    int ncode = get_bits(s, 4) + 4;
+    if (nlen > 286 || ndist > 30)
+    {
+        s->error = 1;
+        return;
+    }
+
+    memset(lengths, 0, 19);
+    for (int i = 0; i < ncode; i++)
+        lengths[order[i]] = (unsigned char)get_bits(s, 3);
+    if (huffman_build(&lcode, lengths, 19) != 0)
+    {
+        s->error = 1;
+        return;
+    }
+
+    for (int i = 0; i < nlen + ndist && !s->error;)
+    {
+        int symbol = huffman_decode(s, &lcode);
+        if (symbol < 16)
+        {
+            lengths[i++] = (unsigned char)symbol;
+            continue;
+        }
+        int repeat, value = 0;
+        if (symbol == 16)
+        {
+            if (i == 0)
+            {
+                s->error = 1;
+                return;
+            }
+            value = lengths[i - 1];
+            repeat = 3 + get_bits(s, 2);
+        }
+        else if (symbol == 17)
+            repeat = 3 + get_bits(s, 3);
+        else
+            repeat = 11 + get_bits(s, 7);
+        if (i + repeat > nlen + ndist)
+        {
+            s->error = 1;
+            return;
+        }
+        while (repeat--)
+            lengths[i++] = (unsigned char)value;
+    }
+    if (s->error || lengths[256] == 0 || huffman_build(&lcode, lengths, nlen) != 0 ||
+        huffman_build(&dcode, lengths + nlen, ndist) != 0)
+    {
+        s->error = 1;
+        return;
+    }
+    inflate_codes(s, &lcode, &dcode);
+}
+
+// inflate a raw deflate stream into out, returns the bytes read from in or 0 on error
+static size_t inflate_raw(const unsigned char *in, size_t size, unsigned char *out, size_t out_size, size_t *out_used,
+                          int *block_types)
+{
+    inflate_t s = {.in = in, .size = size, .out = out, .out_size = out_size};
+    int final = 0;
+    while (!final && !s.error)
+    {
+        final = get_bits(&s, 1);
+        int type = get_bits(&s, 2);
+        *block_types |= 1 << type;
+        if (type == 0)
+            inflate_stored(&s);
+        else if (type == 1)
+            inflate_fixed(&s);
+        else if (type == 2)
+            inflate_dynamic(&s);
+        else
+            s.error = 1;
+    }
+    *out_used = s.out_pos;
+    return s.error ? 0 : s.pos;
+}
+
+// ---------------------------------------------------------------------------
+// PNG reading
+
+static int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// check the png and decode its samples into pixels (width * height * bpp bytes), returns 0 if it is valid
+static int png_decode(const unsigned char *png, size_t size, int width, int height, int bit_depth,
+                      unsigned char *pixels, int *block_types, const char **why)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (size < 8 || memcmp(png, signature, 8) != 0)
+        return *why = "signature", -1;
+
+    // walk the chunks, check the crcs and collect the IDAT data
+    unsigned char *zdata = (unsigned char *)malloc(size);
+    size_t zsize = 0;
+    int seen_header = 0, seen_end = 0;
+    size_t pos = 8;
+    while (pos < size && !seen_end)
+    {
+        if (size - pos < 12)
+            return free(zdata), *why = "chunk past the end", -1;
+        uint32_t length = read_u32be(png + pos);
+        if (length > size - pos - 12)
+            return free(zdata), *why = "chunk length", -1;
+        const unsigned char *type = png + pos + 4;
+        const unsigned char *data = png + pos + 8;
+        if (crc32_bytes(type, length + 4) != read_u32be(data + length))
+            return free(zdata), *why = "chunk crc", -1;
+
+        if (memcmp(type, "IHDR", 4) == 0)
+        {
+            if (pos != 8 || length != 13 || (int)read_u32be(data) != width || (int)read_u32be(data + 4) != height ||
+                data[8] != bit_depth || data[9] != 0 || data[10] != 0 || data[11] != 0 || data[12] != 0)
+                return free(zdata), *why = "IHDR", -1;
+            seen_header = 1;
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            memcpy(zdata + zsize, data, length);
+            zsize += length;
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            if (length != 0)
+                return free(zdata), *why = "IEND", -1;
+            seen_end = 1;
+        }
+        pos += 12 + length;
+    }
+    if (!seen_header || !seen_end || pos != size)
+        return free(zdata), *why = "chunk order", -1;
+
+    // zlib header, deflate stream and adler32 of the filtered rows
+    int bpp = bit_depth / 8;
+    size_t row_bytes = (size_t)width * bpp;
+    size_t filtered_size = (row_bytes + 1) * height;
+    unsigned char *filtered = (unsigned char *)malloc(filtered_size + 1);
+    size_t used = 0;
+    if (zsize < 6 || (zdata[0] & 0x0F) != 8 || (zdata[0] << 8 | zdata[1]) % 31 != 0 || (zdata[1] & 0x20))
+        return free(zdata), free(filtered), *why = "zlib header", -1;
+    size_t read = inflate_raw(zdata + 2, zsize - 2, filtered, filtered_size + 1, &used, block_types);
+    if (read == 0 || used != filtered_size)
+        return free(zdata), free(filtered), *why = "deflate stream", -1;
+    if (2 + read + 4 != zsize || read_u32be(zdata + 2 + read) != adler32_bytes(filtered, filtered_size))
+        return free(zdata), free(filtered), *why = "adler32", -1;
+    free(zdata);
+
+    // undo the filters
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *in = filtered + (row_bytes + 1) * y;
+        unsigned char *row = pixels + row_bytes * y;
+        const unsigned char *above = y > 0 ? row - row_bytes : NULL;
+        for (size_t i = 0; i < row_bytes; i++)
+        {
+            int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+            int b = above ? above[i] : 0;
+            int c = above && i >= (size_t)bpp ? above[i - bpp] : 0;
+            int x = in[1 + i];
+            switch (in[0])
+            {
+            case 0:
+                break;
+            case 1:
+                x += a;
+                break;
+            case 2:
+                x += b;
+                break;
+            case 3:
+                x += (a + b) / 2;
+                break;
+            case 4:
+                x += paeth(a, b, c);
+                break;
+            default:
+                return free(filtered), *why = "filter type", -1;
+            }
+            row[i] = (unsigned char)x;
+        }
+    }
+    free(filtered);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+
+// lines, a gradient, flat areas and noise, so every filter and block type gets used
+static void fill_canvas(canvas_t *canvas)
+{
+    unsigned seed = 12345;
+    for (int y = 0; y < canvas->height; y++)
+    {
+        float *row = canvas_row(canvas, y);
+        for (int x = 0; x < canvas->width; x++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            float noise = (float)(seed >> 16 & 0xFFFF) / 65535.0f;
+            if (y < canvas->height / 3)
+                row[x] = 0.0f;
+            else if (y < 2 * canvas->height / 3)
+                row[x] = (float)x / canvas->width * 0.5f + (float)y / canvas->height * 0.5f;
+            else
+                row[x] = noise;
+        }
+    }
+    for (int i = 0; i < 20; i++)
+        draw_line_f(canvas, 0.0f, (float)i * canvas->height / 20.0f, (float)canvas->width, (float)canvas->height - i, 2.0f, 0.7f);
+}
+
+int main(void)
+{
+    int sizes[][2] = {{1, 1}, {3, 2}, {257, 67}, {1000, 300}};
+    int failed = 0, checked = 0;
+    for (int s = 0; s < 4; s++)
+    {
+        int width = sizes[s][0], height = sizes[s][1];
+        canvas_t *canvas = canvas_create(width, height);
+        if (!canvas)
+            return 1;
+        fill_canvas(canvas);
+
+        for (int bit_depth = 8; bit_depth <= 16; bit_depth += 8)
+        {
+            // the expected samples are the ones of the binary PGM
+            size_t pgm_size = canvas_encode_pgm(canvas, bit_depth, NULL, 0);
+            unsigned char *pgm = (unsigned char *)malloc(pgm_size);
+            size_t pixel_bytes = (size_t)width * height * (bit_depth / 8);
+            unsigned char *pixels = (unsigned char *)malloc(pixel_bytes);
+            if (!pgm || !pixels || canvas_encode_pgm(canvas, bit_depth, pgm, pgm_size) != pgm_size)
+                return 1;
+            const unsigned char *expected = pgm + pgm_size - pixel_bytes;
+
+            for (int level = 0; level <= 9; level++)
+            {
+                size_t size1, size4;
+                unsigned char *png1 = canvas_encode_png(canvas, bit_depth, level, 1, &size1);
+                unsigned char *png4 = canvas_encode_png(canvas, bit_depth, level, 4, &size4);
+                const char *why = "";
+                int block_types = 0;
+                int ok = png1 && png4;
+                if (!ok)
+                    why = "encode failed";
+                else if (size1 != size4 || memcmp(png1, png4, size1) != 0)
+                    ok = 0, why = "bytes depend on the threads";
+                else if (png_decode(png1, size1, width, height, bit_depth, pixels, &block_types, &why) != 0)
+                    ok = 0;
+                else if (memcmp(pixels, expected, pixel_bytes) != 0)
+                    ok = 0, why = "pixels differ";
+                else if (level == 0 && block_types != 1)
+                    ok = 0, why = "level 0 has compressed blocks";
+
+                if (!ok)
+                    printf("%dx%d %d bit level %d: FAILED (%s)\n", width, height, bit_depth, level, why);
+                failed |= !ok;
+                checked++;
+                free(png1);
+                free(png4);
+            }
+            free(pgm);
+            free(pixels);
+        }
+        canvas_destroy(canvas);
+    }
+
+    // a file written to disk is the same as the encoded one
+    canvas_t *canvas = canvas_create(64, 48);
+    fill_canvas(canvas);
+    size_t size;
+    unsigned char *png = canvas_encode_png(canvas, 8, CANVAS_PNG_DEFAULT_LEVEL, 0, &size);
+    const char *filename = "png_test_out.png";
+    int saved = png && canvas_save_png(canvas, filename, 8, CANVAS_PNG_DEFAULT_LEVEL, 0) == 0;
+    FILE *fp = saved ? fopen(filename, "rb") : NULL;
+    unsigned char *file = (unsigned char *)malloc(size + 1);
+    int same = fp && file && fread(file, 1, size + 1, fp) == size && memcmp(file, png, size) == 0;
+    if (fp)
+        fclose(fp);
+    remove(filename);
+    if (!same)
+        printf("canvas_save_png: FAILED\n");
+    failed |= !same;
+    free(file);
+    free(png);
+
+    // bad arguments
+    int rejected = !canvas_encode_png(NULL, 8, 6, 1, &size) && !canvas_encode_png(canvas, 12, 6, 1, &size) &&
+                   !canvas_encode_png(canvas, 8, 10, 1, &size);
+    if (!rejected)
+        printf("bad arguments: FAILED\n");
+    failed |= !rejected;
+    canvas_destroy(canvas);
+
+    printf("png: %d encodings checked %s\n", checked, failed ? "FAILED" : "ok");
+    return failed;
+}
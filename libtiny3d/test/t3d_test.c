@@ -0,0 +1,275 @@
+#include "mesh_io.h"
+#include "mesh_opt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define T3D_TEST_HEAP 1
+#endif
+
+// A .t3d file must give back the mesh it was saved from, with and without the 16 bit edges and the bounds,
+// broken files must be rejected, and destroying a mapped mesh that got its own 16 bit edges must free those
+// once and unmap the file once
+
+#define FILENAME "t3d_test_out.t3d"
+#define BROKEN_FILENAME "t3d_test_broken.t3d"
+
+// get edge j from the int or the 16 bit edges
+static void edge_at(const object3d_t *obj, int j, int *a, int *b)
+{
+    *a = obj->edges16 ? obj->edges16[j][0] : obj->edges[j][0];
+    *b = obj->edges16 ? obj->edges16[j][1] : obj->edges[j][1];
+}
+
+static int vec_equal(vec3f_t a, vec3f_t b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// 1 when loaded has every field of source
+static int same_mesh(const object3d_t *source, const object3d_t *loaded)
+{
+    if (loaded->vertex_count != source->vertex_count || loaded->edge_count != source->edge_count)
+        return 0;
+    if ((loaded->edges16 != NULL) != (source->edges16 != NULL) || (!loaded->edges16 && !loaded->edges))
+        return 0;
+    if (memcmp(loaded->vertices, source->vertices, (size_t)source->vertex_count * sizeof(vec3f_t)) != 0)
+        return 0;
+    for (int j = 0; j < source->edge_count; j++)
+    {
+        int a0, b0, a1, b1;
+        edge_at(source, j, &a0, &b0);
+        edge_at(loaded, j, &a1, &b1);
+        if (a0 != a1 || b0 != b1)
+            return 0;
+    }
+    if (loaded->has_bounds != source->has_bounds)
+        return 0;
+    if (source->has_bounds &&
+        (!vec_equal(loaded->bounds_min, source->bounds_min) || !vec_equal(loaded->bounds_max, source->bounds_max) ||
+         !vec_equal(loaded->bounds_center, source->bounds_center) || loaded->bounds_radius != source->bounds_radius))
+        return 0;
+    return loaded->release != NULL && !loaded->edges16_owned;
+}
+
+// save, reload and compare one variant of the soccer ball
+static int round_trip(int index16, int bounds)
+{
+    object3d_t *source = generate_soccer_ball();
+    if (!source)
+        return 0;
+    if (bounds)
+        object3d_compute_bounds(source);
+    else
+        source->has_bounds = 0;
+    if (index16 && mesh_build_index16(source, 1) != 0)
+    {
+        object3d_destroy(source);
+        return 0;
+    }
+
+    int ok = mesh_save_t3d(source, FILENAME) == 0;
+    object3d_t *loaded = ok ? mesh_load_t3d(FILENAME, 1, NULL) : NULL;
+    ok = loaded && same_mesh(source, loaded);
+    object3d_destroy(loaded);
+    object3d_destroy(source);
+    remove(FILENAME);
+    return ok;
+}
+
+// write size bytes of data to a file and 1 if it loads
+static int loads(const unsigned char *data, size_t size)
+{
+    FILE *f = fopen(BROKEN_FILENAME, "wb");
+    if (!f)
+        return 0;
+    int written = fwrite(data, 1, size, f) == size;
+    if (fclose(f) != 0 || !written)
+        return 0;
+    object3d_t *obj = mesh_load_t3d(BROKEN_FILENAME, 1, NULL);
+    object3d_destroy(obj);
+    remove(BROKEN_FILENAME);
+    return obj != NULL;
+}
+
+// 1 if the file written from data fails to load
+static int rejected(const unsigned char *data, size_t size)
+{
+    return !loads(data, size);
+}
+
+// read a whole file, NULL on failure
+static unsigned char *read_file(const char *filename, size_t *size)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = length > 0 ? (unsigned char *)malloc((size_t)length) : NULL;
+    if (data && fread(data, 1, (size_t)length, f) != (size_t)length)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = (size_t)length;
+    return data;
+}
+
+// truncate and corrupt a good file in several ways, all of them must fail to load
+static int broken_files(void)
+{
+    object3d_t *source = generate_soccer_ball();
+    if (!source)
+        return 0;
+    object3d_compute_bounds(source);
+    int saved = mesh_save_t3d(source, FILENAME) == 0;
+    object3d_destroy(source);
+    size_t size = 0;
+    unsigned char *data = saved ? read_file(FILENAME, &size) : NULL;
+    remove(FILENAME);
+    if (!data || size < sizeof(t3d_header_t))
+    {
+        free(data);
+        return 0;
+    }
+
+    int ok = loads(data, size); // the untouched file
+    ok &= rejected(data, size - 1);                 // last edge cut short
+    ok &= rejected(data, sizeof(t3d_header_t) / 2); // header cut short
+    ok &= rejected(data, 0);                        // empty
+
+    unsigned char *bad = (unsigned char *)malloc(size);
+    t3d_header_t header;
+    memcpy(&header, data, sizeof(header));
+    for (int k = 0; bad && k < 7; k++)
+    {
+        t3d_header_t corrupt = header;
+        switch (k)
+        {
+        case 0: corrupt.magic[0] = 'X'; break;
+        case 1: corrupt.version++; break;
+        case 2: corrupt.header_size--; break;
+        case 3: corrupt.file_size++; break;
+        case 4: corrupt.edge_offset += 4; break;    // not aligned
+        case 5: corrupt.edge_count += 1000; break; // past the end of the file
+        case 6: corrupt.vertex_count = (uint32_t)(corrupt.edge_offset / sizeof(vec3f_t)); break; // over the edges
+        }
+        memcpy(bad, data, size);
+        memcpy(bad, &corrupt, sizeof(corrupt));
+        ok &= rejected(bad, size);
+    }
+
+    // an edge past the last vertex is only caught with verify
+    if (bad)
+    {
+        memcpy(bad, data, size);
+        int out_of_range = header.vertex_count;
+        memcpy(bad + header.edge_offset, &out_of_range, sizeof(out_of_range));
+        ok &= rejected(bad, size);
+    }
+    ok &= bad != NULL;
+    free(bad);
+    free(data);
+    return ok;
+}
+
+// number of mappings of the process, -1 when it can not tell
+static int mapping_count(void)
+{
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/maps", "r");
+    if (!f)
+        return -1;
+    int count = 0;
+    for (int c; (c = fgetc(f)) != EOF;)
+        count += c == '\n';
+    fclose(f);
+    return count;
+#else
+    return -1;
+#endif
+}
+
+// bytes in use on the heap, -1 when it can not tell
+static long heap_in_use(void)
+{
+#ifdef T3D_TEST_HEAP
+    return (long)mallinfo2().uordblks;
+#else
+    return -1;
+#endif
+}
+
+// load, build the 16 bit edges dropping the mapped int ones and destroy, many times: the heap and the mappings
+// must not grow, and a double free or unmap would crash
+static int mapped_destroy(int index16_file, int *checked)
+{
+    object3d_t *source = generate_soccer_ball();
+    if (!source)
+        return 0;
+    if (index16_file && mesh_build_index16(source, 1) != 0)
+    {
+        object3d_destroy(source);
+        return 0;
+    }
+    int ok = mesh_save_t3d(source, FILENAME) == 0;
+    object3d_destroy(source);
+
+    long heap_before = 0;
+    int maps_before = 0;
+    for (int i = 0; ok && i < 1000; i++)
+    {
+        if (i == 10)
+        {
+            maps_before = mapping_count(); // first, the first read of the maps keeps some heap
+            heap_before = heap_in_use();
+        }
+        object3d_t *obj = mesh_load_t3d(FILENAME, 1, NULL);
+        ok = obj && mesh_build_index16(obj, 1) == 0 && obj->edges == NULL && obj->edges16 != NULL &&
+             obj->edges16_owned == !index16_file;
+        object3d_destroy(obj);
+    }
+    remove(FILENAME);
+
+    long heap_after = heap_in_use();
+    int maps_after = mapping_count();
+    *checked = heap_after >= 0 && maps_after >= 0;
+    if (heap_after >= 0 && heap_after != heap_before)
+        ok = 0;
+    if (maps_after >= 0 && maps_after != maps_before)
+        ok = 0;
+    return ok;
+}
+
+int main(void)
+{
+    int failed = 0;
+    for (int index16 = 0; index16 < 2; index16++)
+    {
+        for (int bounds = 0; bounds < 2; bounds++)
+        {
+            int ok = round_trip(index16, bounds);
+            printf("t3d round trip, %s edges, %s bounds %s\n", index16 ? "16 bit" : "int", bounds ? "with" : "without",
+                   ok ? "ok" : "FAILED");
+            failed |= !ok;
+        }
+    }
+
+    int ok = broken_files();
+    printf("t3d truncated and corrupted files rejected %s\n", ok ? "ok" : "FAILED");
+    failed |= !ok;
+
+    for (int index16_file = 0; index16_file < 2; index16_file++)
+    {
+        int checked = 0;
+        ok = mapped_destroy(index16_file, &checked);
+        printf("t3d destroy of a mapped mesh with %s edges after mesh_build_index16%s %s\n",
+               index16_file ? "16 bit" : "int", checked ? "" : " (no leak check here)", ok ? "ok" : "FAILED");
+        failed |= !ok;
+    }
+    return failed;
+}
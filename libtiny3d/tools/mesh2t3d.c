@@ -0,0 +1,61 @@
+#include "mesh_io.h"
+#include "mesh_opt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// print what a .t3d file holds
+static int print_info(const char *filename)
+{
+    mesh_load_stats_t stats;
+    object3d_t *obj = mesh_load_t3d(filename, 1, &stats);
+    if (!obj)
+    {
+        printf("%s is not a valid .t3d file\n", filename);
+        return 1;
+    }
+    printf("%s: version %d, %d vertices, %d edges (%s indices), %s, mapped in %.6f s\n", filename, T3D_VERSION,
+           obj->vertex_count, obj->edge_count, obj->edges16 ? "16 bit" : "32 bit",
+           obj->has_bounds ? "with bounds" : "no bounds", stats.seconds);
+    object3d_destroy(obj);
+    return 0;
+}
+
+// convert an .obj or .ply mesh to .t3d
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "-i") == 0)
+        return print_info(argv[2]);
+
+    if (argc < 3)
+    {
+        printf("usage: %s input.obj|input.ply output.t3d [threads]\n", argv[0]);
+        printf("       %s -i file.t3d\n", argv[0]);
+        return 1;
+    }
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+
+    mesh_load_stats_t stats;
+    object3d_t *obj = mesh_load(argv[1], threads, &stats);
+    if (!obj)
+    {
+        printf("Failed to load %s\n", argv[1]);
+        return 1;
+    }
+    printf("%s: %d vertices, %d edges, loaded in %.3f s (%.1f MB/s)\n", argv[1],
+           obj->vertex_count, obj->edge_count, stats.seconds, mesh_load_mb_per_second(&stats));
+
+    // store the mesh in cache friendly order, with 16 bit indices when it is small enough
+    if (mesh_optimize_locality(obj) != 0)
+        printf("Not enough memory to reorder the mesh, it is saved as it is\n");
+    mesh_build_index16(obj, 1);
+
+    if (mesh_save_t3d(obj, argv[2]) != 0)
+    {
+        printf("Failed to write %s\n", argv[2]);
+        object3d_destroy(obj);
+        return 1;
+    }
+    object3d_destroy(obj);
+    return print_info(argv[2]);
+}